@@ -0,0 +1,101 @@
+#ifndef APOLLO_ADDRESS_SPACE_H
+#define APOLLO_ADDRESS_SPACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "filesystem.h"
+
+// PML4 slot 0 holds the identity-mapped kernel and is shared by every
+// address space. Slots 1-255 form the per-process user half.
+#define ADDRESS_SPACE_USER_BASE 0x0000008000000000ULL
+#define ADDRESS_SPACE_USER_TOP  0x0000800000000000ULL
+
+// The top user page is never mapped. A SYSCALL in it would return to the
+// non-canonical ADDRESS_SPACE_USER_TOP, which SYSRET faults on in ring 0.
+#define ADDRESS_SPACE_USER_LIMIT (ADDRESS_SPACE_USER_TOP - 0x1000ULL)
+
+#define PAGE_PRESENT  0x001ULL
+#define PAGE_WRITABLE 0x002ULL
+#define PAGE_USER     0x004ULL
+
+// Software-available PTE bit: the page is shared read-only and gets a
+// private copy on its first write.
+#define PAGE_COPY_ON_WRITE 0x200ULL
+
+#define TLB_BATCH_MAX_PAGES 32
+
+// A region reserves a page-aligned range whose pages are only allocated on
+// first touch. File-backed regions fill pages from their handle; anything
+// past file_bytes is zero-filled.
+typedef struct address_region {
+    uint64_t start;
+    uint64_t end;
+    uint64_t page_flags;
+    fs_file_handle_t* file;
+    uint64_t file_offset;
+    uint64_t file_bytes;
+    struct address_region* next;
+} address_region_t;
+
+typedef struct {
+    uint64_t* pml4;
+    uint16_t pcid;
+    uint32_t pcid_generation;
+    uint64_t active_cpus;
+    uint32_t mapped_pages;
+    address_region_t* regions;
+} address_space_t;
+
+typedef struct {
+    bool pcid_supported;
+    bool invpcid_supported;
+    uint32_t pcid_generation;
+    uint32_t pcids_in_use;
+    uint32_t switches;
+    uint32_t switches_without_flush;
+    uint32_t shootdown_batches;
+    uint32_t pages_invalidated;
+    uint64_t last_switch_cycles;
+    uint32_t spaces_cloned;
+    uint32_t pages_shared;
+    uint32_t cow_pages_copied;
+    uint32_t cow_pages_reclaimed;
+} address_space_stats_t;
+
+void address_space_initialize(void);
+
+address_space_t* address_space_create(void);
+void address_space_destroy(address_space_t* space);
+
+// Duplicates the user half of source. Private pages are shared read-only
+// with PAGE_COPY_ON_WRITE set in both spaces, so only page tables are
+// copied; regions are duplicated with their own file handles.
+address_space_t* address_space_clone(address_space_t* source);
+
+// Resolves a write fault on a copy-on-write page. The last sharer takes the
+// frame back in place; anyone else gets a private copy.
+bool address_space_resolve_copy_on_write(address_space_t* space, uint64_t virtual_address);
+
+address_space_t* address_space_get_kernel(void);
+address_space_t* address_space_get_current(void);
+void address_space_activate(address_space_t* space);
+
+bool address_space_map_page(address_space_t* space, uint64_t virtual_address,
+                            uint64_t physical_address, uint64_t flags);
+bool address_space_unmap_page(address_space_t* space, uint64_t virtual_address);
+uint64_t* address_space_get_entry(address_space_t* space, uint64_t virtual_address);
+
+// The region takes ownership of file and closes it when the space is destroyed.
+address_region_t* address_space_add_region(address_space_t* space, uint64_t start, uint64_t end,
+                                           uint64_t page_flags, fs_file_handle_t* file,
+                                           uint64_t file_offset, uint64_t file_bytes);
+address_region_t* address_space_find_region(address_space_t* space, uint64_t virtual_address);
+
+// Invalidations are queued per address space and issued together, so a
+// multi-page unmap costs one shootdown round instead of one per page.
+void address_space_queue_invalidation(address_space_t* space, uint64_t virtual_address);
+void address_space_flush_invalidations(void);
+
+bool address_space_get_stats(address_space_stats_t* stats);
+
+#endif
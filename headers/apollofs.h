@@ -0,0 +1,17 @@
+#ifndef APOLLO_APOLLOFS_H
+#define APOLLO_APOLLOFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define APOLLOFS_DEVICE_NAME "vda"
+
+// Registers two VFS types built on the same extent-based filesystem:
+//
+//   apollofs  Kept on the named block device when it is writable and large
+//             enough, otherwise in a memory arena. A fresh instance is
+//             seeded from the root image linked into the kernel.
+//   tmpfs     Always in a memory arena and starts empty; never synced.
+void apollofs_register(void);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef APOLLO_BLOCK_DEVICE_H
+#define APOLLO_BLOCK_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BLOCK_DEVICE_MAX_DEVICES 4
+#define BLOCK_DEVICE_NAME_LENGTH 16
+#define BLOCK_DEVICE_SECTOR_SIZE 512
+
+typedef struct block_device block_device_t;
+
+typedef struct {
+    bool (*read)(block_device_t* device, uint64_t block, uint32_t count, void* buffer);
+    bool (*write)(block_device_t* device, uint64_t block, uint32_t count, const void* buffer);
+    bool (*flush)(block_device_t* device);
+} block_device_ops_t;
+
+// Drivers own the structure and register it once; the block layer only
+// bounds-checks requests and keeps counters before calling into ops.
+struct block_device {
+    char name[BLOCK_DEVICE_NAME_LENGTH];
+    uint32_t block_size;
+    uint64_t block_count;
+    bool read_only;
+    const block_device_ops_t* ops;
+    void* driver_data;
+    uint32_t read_requests;
+    uint32_t write_requests;
+    uint32_t blocks_read;
+    uint32_t blocks_written;
+};
+
+bool block_device_register(block_device_t* device);
+block_device_t* block_device_find(const char* name);
+uint32_t block_device_get_count(void);
+block_device_t* block_device_get(uint32_t index);
+
+bool block_device_read(block_device_t* device, uint64_t block, uint32_t count, void* buffer);
+bool block_device_write(block_device_t* device, uint64_t block, uint32_t count, const void* buffer);
+bool block_device_flush(block_device_t* device);
+
+#endif
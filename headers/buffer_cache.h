@@ -0,0 +1,66 @@
+#ifndef APOLLO_BUFFER_CACHE_H
+#define APOLLO_BUFFER_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "block_device.h"
+
+#define BUFFER_CACHE_BUFFERS 256
+#define BUFFER_CACHE_HASH_BUCKETS 128    // Power of two
+#define BUFFER_CACHE_BLOCK_SIZE BLOCK_DEVICE_SECTOR_SIZE
+#define BUFFER_CACHE_MAX_BATCH 64        // Blocks per device request
+
+typedef struct {
+    block_device_t* device;
+    uint64_t block;
+    uint8_t* data;
+    uint16_t reference_count;
+    bool is_valid;
+    bool is_dirty;
+    int16_t hash_next;
+    int16_t lru_prev;
+    int16_t lru_next;
+} buffer_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writebacks;
+    uint32_t evictions;
+    uint32_t dirty_buffers;
+    uint32_t readahead_blocks;
+    uint32_t read_batches;
+    uint32_t write_batches;
+    uint32_t cached_buffers;
+    uint32_t total_buffers;
+} buffer_cache_stats_t;
+
+void buffer_cache_initialize(void);
+
+// Returns the block pinned and filled from the device, or NULL if it could
+// not be read or every buffer is pinned. Pair each get with a release.
+buffer_t* buffer_cache_get(block_device_t* device, uint64_t block);
+
+// Like buffer_cache_get, but for a caller about to overwrite the whole
+// block: a miss hands back a zeroed buffer without reading the device.
+buffer_t* buffer_cache_get_new(block_device_t* device, uint64_t block);
+
+void buffer_cache_mark_dirty(buffer_t* buffer);
+void buffer_cache_release(buffer_t* buffer);
+
+// Loads the uncached blocks of [block, block + count) without pinning them,
+// reading each run of misses in one device request. Returns how many blocks
+// were brought in.
+uint32_t buffer_cache_prefetch(block_device_t* device, uint64_t block, uint32_t count);
+
+// Writes the dirty blocks of [block, block + count) back, one request per
+// contiguous dirty run.
+bool buffer_cache_flush_range(block_device_t* device, uint64_t block, uint32_t count);
+
+// Writes every dirty buffer belonging to device back to it. Dirty buffers
+// are otherwise written when evicted, together with any dirty neighbours.
+bool buffer_cache_sync(block_device_t* device);
+
+bool buffer_cache_get_stats(buffer_cache_stats_t* stats);
+
+#endif
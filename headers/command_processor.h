@@ -13,9 +13,9 @@ uint32_t command_processor_get_commands_executed(void);
 const char* command_processor_get_current_user(void);
 
 // Available commands:
-// File System: ls, dir, cd, pwd, mkdir, rmdir, rm, cp, mv, cat, touch, find, tree, grep
-// System Info: sysinfo, meminfo, df, ps, whoami, date, uptime
-// Utilities: calc, echo, history, clear, edit, palette
+// File System: ls, dir, cd, pwd, mkdir, rmdir, rm, cp, mv, snapshot, cat, touch, find, tree, grep, du, sync
+// System Info: sysinfo, meminfo, df, mount, lspci, ps, whoami, date, uptime, sysbench
+// Utilities: calc, echo, history, clear, edit, palette, run
 // Control: reboot, shutdown, help
 
 #endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef APOLLO_DESCRIPTOR_TABLES_H
+#define APOLLO_DESCRIPTOR_TABLES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define GDT_KERNEL_CODE_SELECTOR 0x08
+#define GDT_KERNEL_DATA_SELECTOR 0x10
+#define GDT_USER_DATA_SELECTOR   0x1B
+#define GDT_USER_CODE_SELECTOR   0x23
+#define GDT_TSS_SELECTOR         0x28
+
+#define INTERRUPT_VECTOR_GENERAL_PROTECTION 13
+#define INTERRUPT_VECTOR_PAGE_FAULT 14
+#define INTERRUPT_EXCEPTION_COUNT 32
+
+typedef struct {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector, error_code;
+    uint64_t rip, cs, rflags, rsp, ss;
+} interrupt_frame_t;
+
+// Returns true when the exception was resolved and execution may resume.
+typedef bool (*interrupt_handler_t)(interrupt_frame_t* frame);
+
+void descriptor_tables_initialize(void);
+
+void descriptor_tables_set_handler(uint32_t vector, interrupt_handler_t handler);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef APOLLO_DEVFS_H
+#define APOLLO_DEVFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Registers the "devfs" VFS type: a fixed directory of synthetic files that
+// are produced on read and take no storage.
+//
+//   version  Kernel build information, read-only
+//   null     Reads as empty and discards every write
+void devfs_register(void);
+
+#endif
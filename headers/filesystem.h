@@ -3,14 +3,27 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "text_index.h"
 
 #define FS_MAX_FILENAME_LENGTH 64
 #define FS_MAX_PATH_LENGTH 256
-#define FS_MAX_FILE_SIZE (64 * 1024)     // 64KB max file size
-#define FS_MAX_FILES 256
+#define FS_MAX_FILE_SIZE (1024 * 1024)   // 1MB max file size
+#define FS_INODES_PER_CHUNK 256
+#define FS_MAX_INODE_CHUNKS 256
+#define FS_MAX_FILES (FS_INODES_PER_CHUNK * FS_MAX_INODE_CHUNKS)
 #define FS_MAX_DIRECTORIES 64
 #define FS_BLOCK_SIZE 512
-#define FS_MAX_BLOCKS 1024
+#define FS_MAX_BLOCKS 4096               // 2MB block arena
+
+// The first extents live in the inode; a fragmented file spills the rest
+// into one indirect block.
+#define FS_INLINE_EXTENTS 4
+#define FS_EXTENTS_PER_BLOCK (FS_BLOCK_SIZE / sizeof(fs_extent_t))
+#define FS_MAX_EXTENTS (FS_INLINE_EXTENTS + FS_EXTENTS_PER_BLOCK)
+
+// A file no larger than this keeps its bytes in the inode, in the space the
+// extent map would otherwise use, and takes no data block until it grows.
+#define FS_INLINE_DATA_SIZE (FS_INLINE_EXTENTS * sizeof(fs_extent_t) + 2 * sizeof(uint32_t))
 
 typedef enum {
     FS_TYPE_FILE = 1,
@@ -23,6 +36,11 @@ typedef enum {
     FS_PERM_EXECUTE = 0x04
 } fs_permissions_t;
 
+typedef struct {
+    uint32_t start_block;
+    uint32_t block_count;
+} fs_extent_t;
+
 typedef struct {
     char name[FS_MAX_FILENAME_LENGTH];
     fs_file_type_t type;
@@ -31,8 +49,16 @@ typedef struct {
     uint32_t modified_time;
     uint8_t permissions;
     uint32_t parent_id;
-    uint32_t data_block;
+    fs_extent_t extents[FS_INLINE_EXTENTS];
+    uint32_t extent_count;
+    uint32_t indirect_block;
+    bool read_only;
+    bool is_inline;
     bool is_valid;
+    // For a directory, the bytes of file data and the number of nodes below
+    // it within its own mount; 0 for a file.
+    uint32_t tree_bytes;
+    uint32_t tree_nodes;
 } fs_file_info_t;
 
 typedef struct {
@@ -42,13 +68,57 @@ typedef struct {
     uint8_t permissions;
 } fs_dir_entry_t;
 
+struct vfs_superblock;
+
 typedef struct {
+    // The mount the file lives on and the backend's id for it.
+    struct vfs_superblock* superblock;
     uint32_t file_id;
     uint32_t position;
     bool is_open;
     bool write_mode;
+    // Sequential access tracking. A read or write that starts where the last
+    // one ended is sequential; anything else resets the state.
+    uint32_t next_read_position;
+    uint32_t readahead_blocks;
+    uint32_t readahead_limit;
+    uint32_t next_write_position;
+    uint32_t write_behind_start;
+    // Cache block pinned by the last filesystem_map_file, if any.
+    void* mapped_buffer;
 } fs_file_handle_t;
 
+// One piece of a scatter/gather request.
+typedef struct {
+    void* base;
+    uint32_t length;
+} fs_iovec_t;
+
+#define FS_MAX_OPEN_FILES 16
+
+// A process's open files. A descriptor names an entry in the shared
+// open-file table, which holds the handle and its position; open_mask marks
+// the descriptors in use and the lowest free one is handed out first, so
+// opening and closing never touch the heap.
+typedef struct {
+    uint32_t open_mask;
+    uint16_t files[FS_MAX_OPEN_FILES];
+} fs_fd_table_t;
+
+// A depth-first walk below one directory. It holds only the current
+// position, so memory use does not grow with the size or depth of the tree.
+typedef struct {
+    char path[FS_MAX_PATH_LENGTH];   // Full path of the current entry
+    fs_file_info_t info;             // The current entry
+    uint32_t depth;                  // 1 for entries directly in the start directory
+    // Position, private to the walk.
+    struct vfs_superblock* superblock;
+    uint32_t vnode;
+    bool is_named;
+    bool is_started;
+    bool is_pruned;
+} fs_walk_t;
+
 void filesystem_initialize(void);
 
 bool filesystem_create_directory(const char* path);
@@ -57,24 +127,104 @@ bool filesystem_change_directory(const char* path);
 bool filesystem_get_current_directory(char* buffer, uint32_t buffer_size);
 uint32_t filesystem_list_directory(const char* path, fs_dir_entry_t* entries, uint32_t max_entries);
 
+// Visits everything below path, each directory before its contents and
+// following mounts inside it. Entries within a directory come in the
+// backend's order, not by name. Each call to filesystem_walk_next moves to
+// the next entry and returns false once the walk is done. Entries whose
+// full path would not fit in FS_MAX_PATH_LENGTH are skipped along with
+// their contents. The tree must not change while a walk is in progress.
+bool filesystem_walk_begin(fs_walk_t* walk, const char* path);
+bool filesystem_walk_next(fs_walk_t* walk);
+
+// Keeps the next filesystem_walk_next out of the current directory, so a
+// walk can stop at any depth.
+void filesystem_walk_prune(fs_walk_t* walk);
+
+// False only when the text index is sure the walk's current file cannot
+// contain the pattern query was made for; see text_index.h.
+bool filesystem_walk_may_contain(const fs_walk_t* walk, const text_index_query_t* query);
+
 bool filesystem_create_file(const char* path);
 bool filesystem_delete_file(const char* path);
 bool filesystem_copy_file(const char* source, const char* destination);
 bool filesystem_move_file(const char* source, const char* destination);
+
+// Copies a directory tree within one mount. Where the backend supports it,
+// copies share data blocks with the original until either side writes
+// (as does filesystem_copy_file), so this costs only metadata. Mounts
+// inside source are not followed.
+bool filesystem_snapshot(const char* source, const char* destination);
 bool filesystem_file_exists(const char* path);
+
+// Read-only nodes whose contents live outside the filesystem, such as an
+// archive loaded by the boot loader. An attached file is read in place from
+// data, which must stay mapped for the life of the kernel. Attached nodes
+// are never written to disk, and nothing can be created under them except
+// further attached nodes.
+bool filesystem_attach_directory(const char* path);
+bool filesystem_attach_file(const char* path, const void* data, uint32_t size, uint8_t permissions);
 bool filesystem_get_file_info(const char* path, fs_file_info_t* info);
 
+// Bytes of file data at and below path and the number of nodes below it,
+// including what is mounted inside it. Directories keep running totals, so
+// this does not walk the tree.
+bool filesystem_get_usage(const char* path, uint32_t* bytes, uint32_t* nodes);
+
+// Opens into caller-owned storage. Pair with filesystem_release_handle.
+bool filesystem_open_handle(const char* path, bool write_mode, fs_file_handle_t* handle);
+void filesystem_release_handle(fs_file_handle_t* handle);
+
+// Heap-allocated handles, for holders that outlive any one process table
+// such as file-backed memory regions.
 fs_file_handle_t* filesystem_open_file(const char* path, bool write_mode);
+fs_file_handle_t* filesystem_duplicate_handle(const fs_file_handle_t* handle);
 void filesystem_close_file(fs_file_handle_t* handle);
+
+void filesystem_fd_table_initialize(fs_fd_table_t* table);
+int32_t filesystem_fd_open(fs_fd_table_t* table, const char* path, bool write_mode);
+fs_file_handle_t* filesystem_fd_get(fs_fd_table_t* table, int32_t fd);
+bool filesystem_fd_close(fs_fd_table_t* table, int32_t fd);
+void filesystem_fd_close_all(fs_fd_table_t* table);
+
+// The duplicate shares the open file with fd, so a read or write through
+// either moves the position for both.
+int32_t filesystem_fd_dup(fs_fd_table_t* table, int32_t fd);
+
+// Used by fork: the child inherits every open descriptor, sharing each open
+// file and its position with the parent as dup does.
+void filesystem_fd_table_copy(fs_fd_table_t* dest, const fs_fd_table_t* source);
+
 uint32_t filesystem_read_file(fs_file_handle_t* handle, void* buffer, uint32_t size);
 uint32_t filesystem_write_file(fs_file_handle_t* handle, const void* buffer, uint32_t size);
+
+// Vectored I/O at the handle position: the vectors are filled or written in
+// order as one contiguous range and the position advances past it.
+uint32_t filesystem_readv(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count);
+uint32_t filesystem_writev(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count);
+
+// Positional I/O leaves the handle's position untouched, so several readers
+// can share one handle without seeking.
+uint32_t filesystem_pread(fs_file_handle_t* handle, void* buffer, uint32_t size, uint32_t offset);
+uint32_t filesystem_pwrite(fs_file_handle_t* handle, const void* buffer, uint32_t size, uint32_t offset);
 bool filesystem_seek_file(fs_file_handle_t* handle, uint32_t position);
+bool filesystem_truncate_file(fs_file_handle_t* handle, uint32_t size);
+
+// Maps the file data at the handle's position without copying it and
+// advances the position past the mapped piece. Each call returns one
+// contiguous piece: a whole extent run for in-memory files, one cached block
+// on a disk. The view is read-only and valid until the next map or close.
+// Returns false at end of file.
+bool filesystem_map_file(fs_file_handle_t* handle, const void** data, uint32_t* length);
 
 bool filesystem_resolve_path(const char* path, char* resolved_path, uint32_t buffer_size);
 uint32_t filesystem_get_free_space(void);
 uint32_t filesystem_get_used_space(void);
 void filesystem_format(void);
 
+// Syncs every mount: changed metadata and dirty cached blocks go to the
+// disk. Mounts that live in memory have nothing to write.
+bool filesystem_sync(void);
+
 typedef struct {
     uint32_t total_files;
     uint32_t total_directories;
@@ -82,8 +232,15 @@ typedef struct {
     uint32_t used_blocks;
     uint32_t total_space;
     uint32_t free_space;
+    uint32_t dentry_cache_hits;
+    uint32_t dentry_cache_misses;
+    uint32_t sync_count;
+    uint32_t shared_blocks;      // Block references saved by copy-on-write
+    uint32_t data_bytes;         // Sum of all file sizes
+    bool persistent;
 } fs_stats_t;
 
+// Reports the root mount; see vfs_get_mount_info for the others.
 bool filesystem_get_stats(fs_stats_t* stats);
 
 #endif
\ No newline at end of file
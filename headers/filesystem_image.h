@@ -0,0 +1,49 @@
+#ifndef APOLLO_FILESYSTEM_IMAGE_H
+#define APOLLO_FILESYSTEM_IMAGE_H
+
+#include <stdint.h>
+#include "filesystem.h"
+
+// Structures shared by the kernel and the host-side tools/mkrootfs.
+
+#define FS_IMAGE_MAGIC 0x49465041        // "APFI"
+#define FS_IMAGE_VERSION 1
+
+#define FS_DISK_INODE_INLINE 0x01          // Data is in inline_data
+
+// A free slot has type 0. Directory chains and indexes are not stored; they
+// are rebuilt from the parent ids at mount. An inline file's bytes overlay
+// the extent map.
+typedef struct {
+    char name[FS_MAX_FILENAME_LENGTH];
+    uint32_t parent_id;
+    uint32_t type;
+    uint32_t size;
+    uint32_t created_time;
+    uint32_t modified_time;
+    uint8_t permissions;
+    uint8_t flags;
+    uint8_t reserved[2];
+    union {
+        struct {
+            fs_extent_t extents[FS_INLINE_EXTENTS];
+            uint32_t extent_count;
+            uint32_t indirect_block;
+        };
+        uint8_t inline_data[FS_INLINE_DATA_SIZE];
+    };
+} __attribute__((packed)) fs_disk_inode_t;
+
+// The root filesystem image linked into the kernel: this header, one record
+// for every inode id below inode_count (id 0 is never used), then
+// data_blocks blocks of file data that load at data block 1 onward.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t inode_count;
+    uint32_t data_blocks;
+    uint32_t system_time;
+} __attribute__((packed)) fs_image_header_t;
+
+#endif
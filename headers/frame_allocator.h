@@ -0,0 +1,31 @@
+#ifndef APOLLO_FRAME_ALLOCATOR_H
+#define APOLLO_FRAME_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FRAME_SIZE 4096
+
+void frame_allocator_initialize(void);
+
+// Frames live inside the identity-mapped first gigabyte, so the returned
+// pointer is both the kernel virtual address and the physical address.
+void* frame_allocator_allocate(void);
+void frame_allocator_free(void* frame);
+
+// Frames are reference counted so copy-on-write mappings can share them;
+// frame_allocator_free drops one reference and releases the frame at zero.
+bool frame_allocator_reference(void* frame);
+uint32_t frame_allocator_get_references(const void* frame);
+
+// A read-only page of zeros outside the pool, shared by every untouched
+// anonymous page.
+const void* frame_allocator_get_zero_frame(void);
+
+bool frame_allocator_owns(uintptr_t physical_address);
+
+size_t frame_allocator_get_free_frames(void);
+size_t frame_allocator_get_total_frames(void);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef APOLLO_INITRD_H
+#define APOLLO_INITRD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define INITRD_MODULE_NAME "initrd"
+#define INITRD_MOUNT_POINT "/initrd"
+
+typedef struct {
+    bool mounted;
+    uint64_t archive_address;
+    uint32_t archive_size;
+    uint32_t file_count;
+    uint32_t directory_count;
+    uint32_t skipped_entries;
+    uint64_t data_bytes;
+} initrd_info_t;
+
+// Mounts the boot module named "initrd" (or the only module, if there is
+// just one) at INITRD_MOUNT_POINT. The module is a ustar archive; its files
+// are attached read-only and served straight from module memory.
+bool initrd_initialize(void);
+
+bool initrd_get_info(initrd_info_t* info);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef APOLLO_MULTIBOOT_H
+#define APOLLO_MULTIBOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MULTIBOOT1_BOOTLOADER_MAGIC 0x2BADB002
+#define MULTIBOOT2_BOOTLOADER_MAGIC 0x36D76289
+
+#define MULTIBOOT_MAX_MODULES 8
+#define MULTIBOOT_MAX_COMMAND_LINE 64
+
+// Boot memory is identity-mapped only below this address.
+#define MULTIBOOT_MAPPED_LIMIT 0x40000000ULL
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    char command_line[MULTIBOOT_MAX_COMMAND_LINE];
+} multiboot_module_t;
+
+// Records the modules the boot loader passed, from either a Multiboot1 info
+// block or a Multiboot2 tag list. Modules lying outside the boot identity
+// map are skipped.
+void multiboot_initialize(uint32_t magic, uint64_t info_address);
+
+uint32_t multiboot_get_module_count(void);
+const multiboot_module_t* multiboot_get_module(uint32_t index);
+
+// Returns the module with name as one word of its command line, e.g.
+// "initrd" for "module /boot/initrd.tar initrd", or NULL.
+const multiboot_module_t* multiboot_find_module(const char* name);
+
+#endif
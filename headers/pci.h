@@ -0,0 +1,53 @@
+#ifndef APOLLO_PCI_H
+#define APOLLO_PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PCI_MAX_DEVICES 32
+
+#define PCI_CONFIG_VENDOR_ID 0x00
+#define PCI_CONFIG_DEVICE_ID 0x02
+#define PCI_CONFIG_COMMAND 0x04
+#define PCI_CONFIG_CLASS 0x08
+#define PCI_CONFIG_HEADER_TYPE 0x0E
+#define PCI_CONFIG_BAR0 0x10
+#define PCI_CONFIG_INTERRUPT_LINE 0x3C
+
+#define PCI_COMMAND_IO_SPACE 0x0001
+#define PCI_COMMAND_MEMORY_SPACE 0x0002
+#define PCI_COMMAND_BUS_MASTER 0x0004
+
+#define PCI_BAR_IO_SPACE 0x1
+#define PCI_BAR_IO_MASK 0xFFFFFFFC
+
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t interrupt_line;
+    uint32_t bars[6];
+} pci_device_t;
+
+// Walks every bus/slot/function through configuration mechanism #1 and
+// records what answers.
+void pci_initialize(void);
+
+uint32_t pci_get_device_count(void);
+const pci_device_t* pci_get_device(uint32_t index);
+const pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id);
+
+uint32_t pci_config_read32(const pci_device_t* device, uint8_t offset);
+uint16_t pci_config_read16(const pci_device_t* device, uint8_t offset);
+void pci_config_write16(const pci_device_t* device, uint8_t offset, uint16_t value);
+
+void pci_enable_device(const pci_device_t* device);
+
+const char* pci_get_class_string(uint8_t class_code);
+
+#endif
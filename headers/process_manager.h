@@ -3,6 +3,12 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "address_space.h"
+#include "program_loader.h"
+#include "filesystem.h"
+
+#define PROCESS_USER_STACK_TOP  0x00007FFFFFFFE000ULL
+#define PROCESS_USER_STACK_SIZE (64 * 1024)
 
 typedef enum {
     PROCESS_STATE_RUNNING = 0,
@@ -17,6 +23,14 @@ typedef enum {
     PROCESS_TYPE_USER = 2
 } process_type_t;
 
+// Ring 3 register state, laid out as system_call_entry saves it and
+// user_mode_enter loads it.
+typedef struct {
+    uint64_t rax, rbx, rcx, rdx, rsi, rdi, rbp;
+    uint64_t r8, r9, r10, r11, r12, r13, r14, r15;
+    uint64_t rip, rsp, rflags;
+} user_registers_t;
+
 typedef struct {
     uint32_t pid;
     char name[64];
@@ -28,6 +42,10 @@ typedef struct {
     uint32_t parent_pid;
     uint32_t start_time;
     void* entry_point;
+    address_space_t* address_space;
+    program_start_t user_start;
+    user_registers_t user_registers;  // Where process_run enters ring 3
+    int32_t exit_status;
     bool is_active;
 } process_t;
 
@@ -51,9 +69,32 @@ uint32_t process_list(process_t* processes, uint32_t max_count);
 bool process_get_stats(process_stats_t* stats);
 
 uint32_t process_get_current_pid(void);
+
+// Open files of a live process, or NULL. Descriptors are inherited across
+// fork and closed when the process terminates.
+fs_fd_table_t* process_get_fd_table(uint32_t pid);
 void process_yield(void);
 void process_scheduler_tick(void);
 
+// Creates a user process from an ELF64 executable in the filesystem. The
+// process is left READY; process_run starts it.
+uint32_t process_create_from_file(const char* path, uint32_t argc, const char* const* argv);
+int32_t process_run(uint32_t pid);
+
+// Clones a user process. The child shares every resident page copy-on-write
+// and resumes with the given registers (or the parent's own start state when
+// NULL) except for rax = 0.
+uint32_t process_fork(uint32_t pid, const user_registers_t* registers);
+
+// Returns a forked child of parent_pid that is waiting to run, or 0.
+uint32_t process_get_ready_child(uint32_t parent_pid);
+
+// Runs a user process in ring 3 until it exits or faults and returns its
+// exit status. process_exit_user_mode unwinds back into this call.
+int32_t process_run_user_mode(uint32_t pid, uint64_t entry, uint64_t stack_pointer,
+                              uint64_t arg0, uint64_t arg1);
+void process_exit_user_mode(int32_t status);
+
 void process_update_memory_usage(uint32_t pid, uint32_t memory_bytes);
 void process_update_cpu_time(uint32_t pid, uint32_t time_slice);
 
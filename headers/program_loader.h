@@ -0,0 +1,36 @@
+#ifndef APOLLO_PROGRAM_LOADER_H
+#define APOLLO_PROGRAM_LOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "address_space.h"
+
+#define PROGRAM_MAX_SEGMENTS 16
+#define PROGRAM_MAX_ARGUMENTS 16
+
+typedef struct {
+    uint64_t entry;
+    uint64_t stack_pointer;
+    uint64_t argc;
+    uint64_t argv;
+} program_start_t;
+
+typedef struct {
+    uint32_t programs_loaded;
+    uint32_t pages_faulted;
+    uint32_t file_pages_read;
+    uint32_t zero_pages_filled;
+    uint32_t zero_pages_shared;
+} program_loader_stats_t;
+
+void program_loader_initialize(void);
+
+// Validates an ELF64 executable and reserves its PT_LOAD segments and user
+// stack in space. Segment pages are faulted in from the file on first touch;
+// only the top stack page holding argv/envp is populated up front.
+bool program_loader_load(address_space_t* space, const char* path,
+                         uint32_t argc, const char* const* argv, program_start_t* start);
+
+bool program_loader_get_stats(program_loader_stats_t* stats);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef APOLLO_REGEX_H
+#define APOLLO_REGEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define REGEX_MAX_NODES 256
+#define REGEX_MAX_DFA_STATES 64
+
+// Extended regular expressions for searching lines of text:
+//
+//   c         the byte c; \c for any byte that is otherwise special
+//   .         any byte but a newline
+//   [a-z_]    a class of bytes, [^...] for its complement
+//   \d \w \s  digits, word bytes, white space; \D \W \S for the rest
+//   ^ $       start and end of the line
+//   ( ) |     grouping and alternation
+//   * + ?     zero or more, one or more, zero or one of what precedes
+//
+// A pattern compiles to an NFA, and matching runs the DFA built from it
+// one state at a time, as the text needs them. Each byte costs one table
+// lookup once its transition is known, so a search is linear in the text
+// whatever the pattern. At most REGEX_MAX_DFA_STATES states are kept; when
+// they run out the cache is emptied and rebuilt from the state in use.
+
+typedef struct regex regex_t;
+
+// Returns NULL and points error at a message if pattern is malformed, too
+// long or memory runs out.
+regex_t* regex_compile(const char* pattern, const char** error);
+void regex_free(regex_t* regex);
+
+// True if some part of the line matches. The line holds no newline.
+bool regex_search(regex_t* regex, const char* line, uint32_t length);
+
+// True if pattern has no special bytes and so matches only itself.
+bool regex_is_literal(const char* pattern);
+
+#endif
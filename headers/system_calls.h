@@ -0,0 +1,33 @@
+#ifndef APOLLO_SYSTEM_CALLS_H
+#define APOLLO_SYSTEM_CALLS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Numbers are passed in rax; arguments in rdi, rsi, rdx, r10, r8.
+typedef enum {
+    SYS_EXIT = 0,
+    SYS_WRITE = 1,
+    SYS_GETPID = 2,
+    SYS_FORK = 3,
+    SYS_OPEN = 4,      // path, write_mode -> fd
+    SYS_CLOSE = 5,     // fd
+    SYS_DUP = 6,       // fd -> new fd
+    SYS_READ = 7,      // fd, buffer, length
+    SYS_PREAD = 8,     // fd, buffer, length, offset
+    SYS_PWRITE = 9,    // fd, buffer, length, offset
+    SYSTEM_CALL_COUNT
+} system_call_number_t;
+
+#define SYSTEM_CALL_ERROR ((uint64_t)-1)
+
+void system_calls_initialize(void);
+
+uint64_t system_call_dispatch(uint64_t number, uint64_t arg0, uint64_t arg1,
+                              uint64_t arg2, uint64_t arg3, uint64_t arg4);
+
+// Runs a ring 3 loop of SYS_GETPID calls and returns average cycles per
+// round trip, or 0 if the benchmark process could not be set up.
+uint64_t system_call_benchmark(uint32_t iterations);
+
+#endif
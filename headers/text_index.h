@@ -0,0 +1,45 @@
+#ifndef APOLLO_TEXT_INDEX_H
+#define APOLLO_TEXT_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TEXT_INDEX_MAX_FILES 1024
+#define TEXT_INDEX_BUCKETS 4096          // Power of two
+#define TEXT_INDEX_FILE_BUCKETS 256      // Power of two
+
+// A trigram index over file contents that narrows a search down to the
+// files that can contain a string. Each run of three bytes within a line
+// hashes to a bucket listing the files that contain it, so a hash collision
+// only ever adds a candidate. Files are named by the VFS as (volume, node)
+// pairs.
+//
+// The index only vouches for a file whose every byte it has seen: one
+// created empty and only appended to since, or one read through from start
+// to end. Files it cannot vouch for, including any past
+// TEXT_INDEX_MAX_FILES, are always candidates, so a search that reads its
+// candidates never misses a match.
+
+typedef struct {
+    bool is_filtered;     // False when the pattern has no trigram to look up
+    uint32_t candidates[TEXT_INDEX_MAX_FILES / 32];
+} text_index_query_t;
+
+// Changes reported by the VFS as they happen.
+void text_index_file_created(const void* volume, uint32_t node);
+void text_index_file_written(const void* volume, uint32_t node, uint32_t offset,
+                             const void* data, uint32_t size);
+void text_index_file_truncated(const void* volume, uint32_t node, uint32_t size);
+void text_index_file_removed(const void* volume, uint32_t node);
+
+// Reads reported by the VFS. A file read in order from offset 0 up to
+// text_index_file_read_done is indexed on the way.
+void text_index_file_read(const void* volume, uint32_t node, uint32_t offset,
+                          const void* data, uint32_t size);
+void text_index_file_read_done(const void* volume, uint32_t node, uint32_t file_size);
+
+// Picks the files that hold every trigram of pattern.
+void text_index_query(const char* pattern, text_index_query_t* query);
+bool text_index_may_contain(const text_index_query_t* query, const void* volume, uint32_t node);
+
+#endif
@@ -4,10 +4,76 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// Every user address space maps the time page read-only at this address,
+// just above the user stack and below the unmapped top user page.
+#define TIME_PAGE_USER_ADDRESS 0x00007FFFFFFFE000ULL
+
+#define TIME_PAGE_FLAG_CALIBRATED 0x01
+#define TIME_PAGE_FLAG_INVARIANT_TSC 0x02
+
+// Published with a seqlock: sequence is odd while the kernel is updating
+// the page, and readers retry if it changed underneath them.
+typedef struct {
+    volatile uint32_t sequence;
+    uint32_t flags;
+    uint64_t tsc_frequency;
+    uint64_t tsc_base;
+    uint64_t tsc_multiplier;
+    uint32_t tsc_shift;
+    uint32_t reserved;
+    uint64_t monotonic_base_ns;
+    uint64_t wall_base_ns;
+} time_page_t;
+
+static inline uint64_t time_page_read_tsc(void) {
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t time_page_scale_ticks(uint64_t ticks, uint64_t multiplier, uint32_t shift) {
+    uint64_t low, high;
+    __asm__("mulq %3" : "=a"(low), "=d"(high) : "a"(ticks), "rm"(multiplier));
+    if (shift == 0) return low;
+    return (low >> shift) | (high << (64 - shift));
+}
+
+// Syscall-free clock read usable from the kernel and from ring 3. Until the
+// TSC is calibrated the clocks stand still at their bases.
+static inline void time_page_read(const time_page_t* page, uint64_t* monotonic_ns, uint64_t* wall_ns) {
+    uint32_t sequence;
+    uint64_t elapsed;
+    uint64_t monotonic_base;
+    uint64_t wall_base;
+
+    do {
+        sequence = page->sequence;
+        __asm__ volatile("" ::: "memory");
+        elapsed = 0;
+        if (page->flags & TIME_PAGE_FLAG_CALIBRATED) {
+            elapsed = time_page_scale_ticks(time_page_read_tsc() - page->tsc_base,
+                                            page->tsc_multiplier, page->tsc_shift);
+        }
+        monotonic_base = page->monotonic_base_ns;
+        wall_base = page->wall_base_ns;
+        __asm__ volatile("" ::: "memory");
+    } while ((sequence & 1) || sequence != page->sequence);
+
+    if (monotonic_ns) *monotonic_ns = monotonic_base + elapsed;
+    if (wall_ns) *wall_ns = wall_base + elapsed;
+}
+
 void time_keeper_initialize(void);
 
 void time_keeper_get_datetime(int* year, int* month, int* day, int* hour, int* minute, int* second);
 
 uint64_t time_keeper_get_uptime_seconds(void);
+uint64_t time_keeper_get_monotonic_ns(void);
+uint64_t time_keeper_get_wall_ns(void);
+
+const time_page_t* time_keeper_get_time_page(void);
+
+// Folds elapsed ticks into the page bases so the scaled delta stays small.
+void time_keeper_update_time_page(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef APOLLO_VFS_H
+#define APOLLO_VFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "filesystem.h"
+
+#define VFS_MAX_FILESYSTEM_TYPES 4
+#define VFS_MAX_MOUNTS 8
+#define VFS_SOURCE_LENGTH 16
+
+// The filesystem_* calls are the VFS: they normalize the path, pick the
+// mount with the longest matching prefix and hand the rest of the path to
+// that mount's backend. Backends plug in through the tables below.
+
+typedef struct vfs_superblock vfs_superblock_t;
+
+// Namespace operations. Paths are relative to the mount: always absolute
+// ("/" is the mount root) and already normalized, so backends never see "."
+// or ".." and are free to keep their own lookup caches keyed by path
+// component. A vnode is the backend's id for a node, 0 for none.
+typedef struct {
+    uint32_t (*lookup)(vfs_superblock_t* superblock, const char* path);
+    bool (*get_info)(vfs_superblock_t* superblock, uint32_t vnode, fs_file_info_t* info);
+    bool (*create)(vfs_superblock_t* superblock, const char* path, fs_file_type_t type);
+    bool (*remove)(vfs_superblock_t* superblock, const char* path);
+    uint32_t (*list)(vfs_superblock_t* superblock, const char* path,
+                     fs_dir_entry_t* entries, uint32_t max_entries);
+    // Optional: step through a tree one vnode at a time, for filesystem_walk.
+    // first_child takes a directory and next_sibling any node below the
+    // mount root; both return 0 when there is none, in the backend's order.
+    // Without them the walk does not look inside this mount.
+    uint32_t (*first_child)(vfs_superblock_t* superblock, uint32_t directory);
+    uint32_t (*next_sibling)(vfs_superblock_t* superblock, uint32_t vnode);
+    // Optional: read-only nodes backed by caller memory (see
+    // filesystem_attach_file). A directory passes NULL data.
+    bool (*attach)(vfs_superblock_t* superblock, const char* path, fs_file_type_t type,
+                   const void* data, uint32_t size, uint8_t permissions);
+    // Optional: copies a file, or a directory and everything below it,
+    // sharing data blocks instead of copying them.
+    bool (*clone)(vfs_superblock_t* superblock, const char* source, const char* destination);
+    bool (*sync)(vfs_superblock_t* superblock);
+    bool (*get_stats)(vfs_superblock_t* superblock, fs_stats_t* stats);
+} vfs_superblock_ops_t;
+
+// Per-file operations on an open handle. Every transfer names its offset and
+// the VFS moves the handle's position afterwards, so an offset equal to
+// handle->position marks a streaming access a backend may read ahead for.
+typedef struct {
+    uint32_t (*read)(fs_file_handle_t* handle, void* buffer, uint32_t size, uint32_t offset);
+    uint32_t (*write)(fs_file_handle_t* handle, const void* buffer, uint32_t size, uint32_t offset);
+    // Optional; without them the VFS issues one read or write per vector.
+    uint32_t (*readv)(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count,
+                      uint32_t offset);
+    uint32_t (*writev)(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count,
+                       uint32_t offset);
+    // Optional; see filesystem_map_file. Returns false at end of file.
+    bool (*map)(fs_file_handle_t* handle, uint32_t offset, const void** data, uint32_t* length);
+    bool (*truncate)(fs_file_handle_t* handle, uint32_t size);
+    // Optional; drops whatever the backend keeps pinned for the handle.
+    void (*release)(fs_file_handle_t* handle);
+} vfs_vnode_ops_t;
+
+typedef struct {
+    const char* name;
+    // Builds a new instance into superblock->private_data. source names the
+    // backing device, or is NULL for types that need none.
+    bool (*mount)(vfs_superblock_t* superblock, const char* source);
+    const vfs_superblock_ops_t* superblock_ops;
+    const vfs_vnode_ops_t* vnode_ops;
+} vfs_filesystem_type_t;
+
+// One per mount, owned by the mount table; open handles point at it.
+struct vfs_superblock {
+    const vfs_filesystem_type_t* type;
+    void* private_data;
+};
+
+typedef struct {
+    char path[FS_MAX_PATH_LENGTH];
+    char source[VFS_SOURCE_LENGTH];
+    const char* type_name;
+    fs_stats_t stats;
+    bool has_stats;
+} vfs_mount_info_t;
+
+// Types register once at startup; the type must stay valid for the life of
+// the kernel.
+bool vfs_register_filesystem(const vfs_filesystem_type_t* type);
+
+// Mounts a new instance of the named type at path, which must be "/" for the
+// first mount and an existing directory for the rest. source may be NULL.
+bool vfs_mount(const char* type_name, const char* source, const char* path);
+
+uint32_t vfs_get_mount_count(void);
+bool vfs_get_mount_info(uint32_t index, vfs_mount_info_t* info);
+
+#endif
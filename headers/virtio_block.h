@@ -0,0 +1,28 @@
+#ifndef APOLLO_VIRTIO_BLOCK_H
+#define APOLLO_VIRTIO_BLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VIRTIO_VENDOR_ID 0x1AF4
+#define VIRTIO_BLOCK_LEGACY_DEVICE_ID 0x1001
+
+#define VIRTIO_BLOCK_DEVICE_NAME "vda"
+
+typedef struct {
+    uint64_t capacity_sectors;
+    uint16_t queue_size;
+    bool flush_supported;
+    bool read_only;
+    uint32_t requests_completed;
+    uint32_t requests_failed;
+} virtio_block_info_t;
+
+// Probes PCI for a legacy virtio-blk function, sets up its single request
+// queue and registers it with the block layer as "vda". Requests complete
+// synchronously by polling the used ring, since interrupts stay masked.
+bool virtio_block_initialize(void);
+
+bool virtio_block_get_info(virtio_block_info_t* info);
+
+#endif
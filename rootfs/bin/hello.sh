@@ -0,0 +1,10 @@
+#!/bin/sh
+# Apollo OS Hello Script
+echo "Hello from Apollo Operating System!"
+echo "Current directory: $(pwd)"
+echo "Available commands:"
+ls /bin
+echo "System information:"
+sysinfo
+echo "File system usage:"
+df
@@ -0,0 +1,598 @@
+#include "address_space.h"
+#include "frame_allocator.h"
+#include "heap_allocator.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PML4_KERNEL_SLOTS 1
+#define PML4_USER_SLOTS 256
+#define TABLE_ENTRIES 512
+
+#define ENTRY_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+#define ENTRY_LARGE_PAGE 0x080ULL
+
+#define CR0_WRITE_PROTECT (1ULL << 16)
+#define CR3_NO_FLUSH (1ULL << 63)
+#define CR4_PCIDE (1ULL << 17)
+#define PCID_COUNT 4096
+
+#define CPUID_01_ECX_PCID (1U << 17)
+#define CPUID_07_EBX_INVPCID (1U << 10)
+
+#define INVPCID_INDIVIDUAL_ADDRESS 0
+#define INVPCID_SINGLE_CONTEXT 1
+
+// Only the bootstrap processor is brought up. active_cpus is still tracked
+// per address space so a shootdown batch knows which remote CPUs would
+// need the IPI carrying it once APs are started.
+#define BOOT_CPU_ID 0
+
+typedef struct {
+    address_space_t kernel_space;
+    address_space_t* current;
+    uint16_t next_pcid;
+    address_space_t* batch_space;
+    uint64_t batch_pages[TLB_BATCH_MAX_PAGES];
+    uint32_t batch_count;
+    bool batch_full_flush;
+    address_space_stats_t stats;
+    bool is_initialized;
+} address_space_state_t;
+
+static address_space_state_t as_state = {0};
+
+static inline uint64_t read_cr0(void) {
+    uint64_t value;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(uint64_t value) {
+    __asm__ volatile("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint64_t read_cr3(void) {
+    uint64_t value;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr3(uint64_t value) {
+    __asm__ volatile("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t value;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint64_t value) {
+    __asm__ volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* eax, uint32_t* ebx,
+                         uint32_t* ecx, uint32_t* edx) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+static inline void invlpg(uint64_t virtual_address) {
+    __asm__ volatile("invlpg (%0)" : : "r"(virtual_address) : "memory");
+}
+
+static inline void invpcid(uint64_t type, uint16_t pcid, uint64_t virtual_address) {
+    struct {
+        uint64_t pcid;
+        uint64_t address;
+    } __attribute__((packed)) descriptor = { pcid, virtual_address };
+
+    __asm__ volatile("invpcid %0, %1" : : "m"(descriptor), "r"(type) : "memory");
+}
+
+static inline uint64_t read_timestamp(void) {
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static uint64_t* entry_table(uint64_t entry) {
+    return (uint64_t*)(uintptr_t)(entry & ENTRY_ADDRESS_MASK);
+}
+
+static bool is_user_address(uint64_t virtual_address) {
+    return virtual_address >= ADDRESS_SPACE_USER_BASE &&
+           virtual_address < ADDRESS_SPACE_USER_LIMIT;
+}
+
+static uint64_t* walk_to_entry(address_space_t* space, uint64_t virtual_address, bool create) {
+    uint64_t* table = space->pml4;
+    uint32_t shifts[3] = { 39, 30, 21 };
+
+    for (uint32_t level = 0; level < 3; level++) {
+        uint64_t* entry = &table[(virtual_address >> shifts[level]) & (TABLE_ENTRIES - 1)];
+
+        if (!(*entry & PAGE_PRESENT)) {
+            if (!create) return NULL;
+
+            uint64_t* next = frame_allocator_allocate();
+            if (!next) return NULL;
+
+            *entry = (uint64_t)(uintptr_t)next | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+        } else if (*entry & ENTRY_LARGE_PAGE) {
+            return NULL;
+        }
+
+        table = entry_table(*entry);
+    }
+
+    return &table[(virtual_address >> 12) & (TABLE_ENTRIES - 1)];
+}
+
+static void assign_pcid(address_space_t* space) {
+    if (as_state.next_pcid >= PCID_COUNT) {
+        // Every PCID handed out in the old generation is retired at once;
+        // each address space picks up a fresh one on its next activation
+        // and flushes it then.
+        as_state.stats.pcid_generation++;
+        as_state.stats.pcids_in_use = 0;
+        as_state.next_pcid = 1;
+    }
+
+    space->pcid = as_state.next_pcid++;
+    space->pcid_generation = as_state.stats.pcid_generation;
+    as_state.stats.pcids_in_use++;
+}
+
+static void free_table_level(uint64_t* table, uint32_t level) {
+    for (uint32_t i = 0; i < TABLE_ENTRIES; i++) {
+        uint64_t entry = table[i];
+        if (!(entry & PAGE_PRESENT)) continue;
+
+        if (level < 3) {
+            free_table_level(entry_table(entry), level + 1);
+        } else {
+            frame_allocator_free(entry_table(entry));
+        }
+    }
+
+    frame_allocator_free(table);
+}
+
+static bool clone_table_level(address_space_t* source, address_space_t* target,
+                              uint64_t* source_table, uint64_t* target_table,
+                              uint32_t level, uint64_t base_address) {
+    uint32_t shift = 39 - level * 9;
+
+    for (uint32_t i = 0; i < TABLE_ENTRIES; i++) {
+        uint64_t entry = source_table[i];
+        if (!(entry & PAGE_PRESENT)) continue;
+
+        uint64_t address = base_address | ((uint64_t)i << shift);
+
+        if (level < 3) {
+            uint64_t* next = frame_allocator_allocate();
+            if (!next) return false;
+
+            target_table[i] = (uint64_t)(uintptr_t)next | (entry & ~ENTRY_ADDRESS_MASK);
+            if (!clone_table_level(source, target, entry_table(entry), next, level + 1, address)) {
+                return false;
+            }
+            continue;
+        }
+
+        // Frames outside the pool (the zero frame, the time page) are never
+        // freed, so they are shared as-is without a reference.
+        uint64_t* frame = entry_table(entry);
+        if (frame_allocator_owns((uintptr_t)frame)) {
+            if (entry & PAGE_WRITABLE) {
+                entry = (entry & ~PAGE_WRITABLE) | PAGE_COPY_ON_WRITE;
+                source_table[i] = entry;
+                address_space_queue_invalidation(source, address);
+            }
+
+            if (!frame_allocator_reference(frame)) return false;
+            as_state.stats.pages_shared++;
+        }
+
+        target_table[i] = entry;
+        target->mapped_pages++;
+    }
+
+    return true;
+}
+
+static bool clone_regions(address_space_t* source, address_space_t* target) {
+    address_region_t** tail = &target->regions;
+
+    for (address_region_t* region = source->regions; region; region = region->next) {
+        address_region_t* copy = apollo_allocate_memory(sizeof(address_region_t));
+        if (!copy) return false;
+
+        *copy = *region;
+        copy->next = NULL;
+
+        if (region->file) {
+            copy->file = filesystem_duplicate_handle(region->file);
+            if (!copy->file) {
+                apollo_free_memory(copy);
+                return false;
+            }
+        }
+
+        *tail = copy;
+        tail = &copy->next;
+    }
+
+    return true;
+}
+
+void address_space_initialize(void) {
+    if (as_state.is_initialized) return;
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    as_state.stats.pcid_supported = (ecx & CPUID_01_ECX_PCID) != 0;
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+        as_state.stats.invpcid_supported = (ebx & CPUID_07_EBX_INVPCID) != 0;
+    }
+
+    // Ring 0 writes through user pointers must honour read-only PTEs, or a
+    // system call could scribble on a frame still shared copy-on-write.
+    write_cr0(read_cr0() | CR0_WRITE_PROTECT);
+
+    uint64_t boot_cr3 = read_cr3();
+
+    // CR4.PCIDE may only be set while CR3[11:0] is zero, which holds for
+    // the boot page tables.
+    if (as_state.stats.pcid_supported && (boot_cr3 & 0xFFF) == 0) {
+        write_cr4(read_cr4() | CR4_PCIDE);
+    } else {
+        as_state.stats.pcid_supported = false;
+        as_state.stats.invpcid_supported = false;
+    }
+
+    as_state.kernel_space.pml4 = entry_table(boot_cr3);
+    as_state.kernel_space.pcid = 0;
+    as_state.kernel_space.pcid_generation = 1;
+    as_state.kernel_space.active_cpus = 1ULL << BOOT_CPU_ID;
+    as_state.kernel_space.mapped_pages = 0;
+    as_state.kernel_space.regions = NULL;
+
+    as_state.current = &as_state.kernel_space;
+    as_state.next_pcid = 1;
+    as_state.stats.pcid_generation = 1;
+    as_state.batch_space = NULL;
+    as_state.batch_count = 0;
+    as_state.batch_full_flush = false;
+    as_state.is_initialized = true;
+}
+
+address_space_t* address_space_create(void) {
+    if (!as_state.is_initialized) {
+        address_space_initialize();
+    }
+
+    address_space_t* space = apollo_allocate_memory(sizeof(address_space_t));
+    if (!space) return NULL;
+
+    space->pml4 = frame_allocator_allocate();
+    if (!space->pml4) {
+        apollo_free_memory(space);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < PML4_KERNEL_SLOTS; i++) {
+        space->pml4[i] = as_state.kernel_space.pml4[i];
+    }
+
+    space->pcid = 0;
+    space->pcid_generation = 0;
+    space->active_cpus = 0;
+    space->mapped_pages = 0;
+    space->regions = NULL;
+
+    return space;
+}
+
+void address_space_destroy(address_space_t* space) {
+    if (!space || space == &as_state.kernel_space) return;
+
+    if (as_state.current == space) {
+        address_space_activate(&as_state.kernel_space);
+    }
+
+    if (as_state.batch_space == space) {
+        as_state.batch_space = NULL;
+        as_state.batch_count = 0;
+        as_state.batch_full_flush = false;
+    }
+
+    for (uint32_t i = PML4_KERNEL_SLOTS; i < PML4_USER_SLOTS; i++) {
+        if (space->pml4[i] & PAGE_PRESENT) {
+            free_table_level(entry_table(space->pml4[i]), 1);
+        }
+    }
+
+    frame_allocator_free(space->pml4);
+
+    while (space->regions) {
+        address_region_t* region = space->regions;
+        space->regions = region->next;
+        if (region->file) {
+            filesystem_close_file(region->file);
+        }
+        apollo_free_memory(region);
+    }
+
+    if (space->pcid_generation == as_state.stats.pcid_generation && space->pcid != 0 &&
+        as_state.stats.pcids_in_use > 0) {
+        as_state.stats.pcids_in_use--;
+    }
+
+    apollo_free_memory(space);
+}
+
+address_space_t* address_space_clone(address_space_t* source) {
+    if (!source || source == &as_state.kernel_space) return NULL;
+
+    address_space_t* target = address_space_create();
+    if (!target) return NULL;
+
+    bool cloned = clone_regions(source, target);
+
+    for (uint32_t i = PML4_KERNEL_SLOTS; cloned && i < PML4_USER_SLOTS; i++) {
+        uint64_t entry = source->pml4[i];
+        if (!(entry & PAGE_PRESENT)) continue;
+
+        uint64_t* next = frame_allocator_allocate();
+        if (!next) {
+            cloned = false;
+            break;
+        }
+
+        target->pml4[i] = (uint64_t)(uintptr_t)next | (entry & ~ENTRY_ADDRESS_MASK);
+        cloned = clone_table_level(source, target, entry_table(entry), next, 1, (uint64_t)i << 39);
+    }
+
+    // The source may return to ring 3 right after this, so its downgraded
+    // entries must not survive in the TLB.
+    address_space_flush_invalidations();
+
+    if (!cloned) {
+        address_space_destroy(target);
+        return NULL;
+    }
+
+    as_state.stats.spaces_cloned++;
+    return target;
+}
+
+bool address_space_resolve_copy_on_write(address_space_t* space, uint64_t virtual_address) {
+    if (!space || space == &as_state.kernel_space || !is_user_address(virtual_address)) return false;
+
+    virtual_address &= ~(uint64_t)(FRAME_SIZE - 1);
+
+    uint64_t* entry = walk_to_entry(space, virtual_address, false);
+    if (!entry || !(*entry & PAGE_PRESENT) || !(*entry & PAGE_COPY_ON_WRITE)) return false;
+
+    uint64_t* frame = entry_table(*entry);
+    uint64_t flags = (*entry & ~ENTRY_ADDRESS_MASK & ~PAGE_COPY_ON_WRITE) | PAGE_WRITABLE;
+
+    if (frame_allocator_get_references(frame) == 1) {
+        *entry = (uint64_t)(uintptr_t)frame | flags;
+        as_state.stats.cow_pages_reclaimed++;
+    } else {
+        uint64_t* copy = frame_allocator_allocate();
+        if (!copy) return false;
+
+        if (frame != (const uint64_t*)frame_allocator_get_zero_frame()) {
+            for (uint32_t i = 0; i < FRAME_SIZE / sizeof(uint64_t); i++) {
+                copy[i] = frame[i];
+            }
+        }
+
+        *entry = (uint64_t)(uintptr_t)copy | flags;
+        frame_allocator_free(frame);
+        as_state.stats.cow_pages_copied++;
+    }
+
+    address_space_queue_invalidation(space, virtual_address);
+    address_space_flush_invalidations();
+    return true;
+}
+
+address_space_t* address_space_get_kernel(void) {
+    return &as_state.kernel_space;
+}
+
+address_space_t* address_space_get_current(void) {
+    return as_state.current ? as_state.current : &as_state.kernel_space;
+}
+
+void address_space_activate(address_space_t* space) {
+    if (!as_state.is_initialized) return;
+    if (!space) space = &as_state.kernel_space;
+    if (space == as_state.current) return;
+
+    uint64_t start = read_timestamp();
+
+    if (as_state.batch_count > 0 || as_state.batch_full_flush) {
+        address_space_flush_invalidations();
+    }
+
+    uint64_t cr3 = (uint64_t)(uintptr_t)space->pml4;
+
+    if (as_state.stats.pcid_supported) {
+        bool needs_flush = false;
+
+        if (space != &as_state.kernel_space &&
+            space->pcid_generation != as_state.stats.pcid_generation) {
+            assign_pcid(space);
+            needs_flush = true;
+        }
+
+        cr3 |= space->pcid;
+        if (!needs_flush) {
+            cr3 |= CR3_NO_FLUSH;
+            as_state.stats.switches_without_flush++;
+        }
+    }
+
+    write_cr3(cr3);
+
+    as_state.current->active_cpus &= ~(1ULL << BOOT_CPU_ID);
+    space->active_cpus |= 1ULL << BOOT_CPU_ID;
+    as_state.current = space;
+
+    as_state.stats.switches++;
+    as_state.stats.last_switch_cycles = read_timestamp() - start;
+}
+
+bool address_space_map_page(address_space_t* space, uint64_t virtual_address,
+                            uint64_t physical_address, uint64_t flags) {
+    if (!space || !is_user_address(virtual_address)) return false;
+
+    virtual_address &= ~(uint64_t)(FRAME_SIZE - 1);
+
+    uint64_t* entry = walk_to_entry(space, virtual_address, true);
+    if (!entry) return false;
+
+    if (*entry & PAGE_PRESENT) {
+        address_space_queue_invalidation(space, virtual_address);
+    } else {
+        space->mapped_pages++;
+    }
+
+    *entry = (physical_address & ENTRY_ADDRESS_MASK) | flags | PAGE_PRESENT;
+    return true;
+}
+
+bool address_space_unmap_page(address_space_t* space, uint64_t virtual_address) {
+    if (!space || !is_user_address(virtual_address)) return false;
+
+    virtual_address &= ~(uint64_t)(FRAME_SIZE - 1);
+
+    uint64_t* entry = walk_to_entry(space, virtual_address, false);
+    if (!entry || !(*entry & PAGE_PRESENT)) return false;
+
+    frame_allocator_free(entry_table(*entry));
+    *entry = 0;
+    space->mapped_pages--;
+
+    address_space_queue_invalidation(space, virtual_address);
+    return true;
+}
+
+uint64_t* address_space_get_entry(address_space_t* space, uint64_t virtual_address) {
+    if (!space || !is_user_address(virtual_address)) return NULL;
+    return walk_to_entry(space, virtual_address, false);
+}
+
+address_region_t* address_space_add_region(address_space_t* space, uint64_t start, uint64_t end,
+                                           uint64_t page_flags, fs_file_handle_t* file,
+                                           uint64_t file_offset, uint64_t file_bytes) {
+    if (!space || space == &as_state.kernel_space) return NULL;
+    if ((start & (FRAME_SIZE - 1)) != 0 || (end & (FRAME_SIZE - 1)) != 0) return NULL;
+    if (start >= end || !is_user_address(start) || end > ADDRESS_SPACE_USER_LIMIT) return NULL;
+
+    for (address_region_t* existing = space->regions; existing; existing = existing->next) {
+        if (start < existing->end && existing->start < end) {
+            return NULL;
+        }
+    }
+
+    address_region_t* region = apollo_allocate_memory(sizeof(address_region_t));
+    if (!region) return NULL;
+
+    region->start = start;
+    region->end = end;
+    region->page_flags = page_flags | PAGE_USER;
+    region->file = file;
+    region->file_offset = file_offset;
+    region->file_bytes = file ? file_bytes : 0;
+    region->next = space->regions;
+    space->regions = region;
+
+    return region;
+}
+
+address_region_t* address_space_find_region(address_space_t* space, uint64_t virtual_address) {
+    if (!space) return NULL;
+
+    for (address_region_t* region = space->regions; region; region = region->next) {
+        if (virtual_address >= region->start && virtual_address < region->end) {
+            return region;
+        }
+    }
+
+    return NULL;
+}
+
+void address_space_queue_invalidation(address_space_t* space, uint64_t virtual_address) {
+    if (!space) return;
+
+    if (as_state.batch_space != space && (as_state.batch_count > 0 || as_state.batch_full_flush)) {
+        address_space_flush_invalidations();
+    }
+
+    as_state.batch_space = space;
+
+    if (as_state.batch_count < TLB_BATCH_MAX_PAGES) {
+        as_state.batch_pages[as_state.batch_count++] = virtual_address;
+    } else {
+        as_state.batch_full_flush = true;
+    }
+}
+
+void address_space_flush_invalidations(void) {
+    address_space_t* space = as_state.batch_space;
+    if (!space || (as_state.batch_count == 0 && !as_state.batch_full_flush)) return;
+
+    if (space == as_state.current) {
+        if (as_state.batch_full_flush) {
+            write_cr3((uint64_t)(uintptr_t)space->pml4 | space->pcid);
+        } else {
+            for (uint32_t i = 0; i < as_state.batch_count; i++) {
+                invlpg(as_state.batch_pages[i]);
+            }
+        }
+    } else if (as_state.stats.pcid_supported && space->pcid_generation == as_state.stats.pcid_generation) {
+        // The space is switched out but its PCID may still tag live TLB
+        // entries on this CPU.
+        if (as_state.stats.invpcid_supported) {
+            if (as_state.batch_full_flush) {
+                invpcid(INVPCID_SINGLE_CONTEXT, space->pcid, 0);
+            } else {
+                for (uint32_t i = 0; i < as_state.batch_count; i++) {
+                    invpcid(INVPCID_INDIVIDUAL_ADDRESS, space->pcid, as_state.batch_pages[i]);
+                }
+            }
+        } else {
+            space->pcid_generation = 0;
+        }
+    }
+
+    // Remote CPUs in space->active_cpus would receive the whole batch in
+    // one IPI here; with only the BSP online that set is always empty.
+
+    as_state.stats.shootdown_batches++;
+    as_state.stats.pages_invalidated += as_state.batch_count;
+
+    as_state.batch_space = NULL;
+    as_state.batch_count = 0;
+    as_state.batch_full_flush = false;
+}
+
+bool address_space_get_stats(address_space_stats_t* stats) {
+    if (!stats) return false;
+
+    *stats = as_state.stats;
+    return true;
+}
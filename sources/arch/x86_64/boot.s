@@ -1,4 +1,6 @@
 global boot_entry_point
+global multiboot_magic
+global multiboot_info_address
 extern apollo_long_mode_entry
 
 section .multiboot
@@ -40,6 +42,9 @@ boot_entry_point:
     jmp error_no_multiboot
 
 continue_boot:
+    mov [multiboot_magic], eax
+    mov [multiboot_info_address], ebx
+    
     call check_cpu_features
     
     call setup_page_tables
@@ -165,6 +170,12 @@ gdt64_pointer:
     dd gdt64                         ; Base
 
 section .bss
+align 4
+multiboot_magic:
+    resd 1
+multiboot_info_address:
+    resd 1
+
 align 4096
 p4_table:
     resb 4096
@@ -0,0 +1,163 @@
+#include "descriptor_tables.h"
+#include "terminal.h"
+#include "process_manager.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define GDT_ENTRY_COUNT 7
+#define IDT_ENTRY_COUNT 256
+
+#define IDT_INTERRUPT_GATE 0x8E
+#define TSS_AVAILABLE_64 0x89
+
+typedef struct {
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed)) task_state_segment_t;
+
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attributes;
+    uint16_t offset_middle;
+    uint32_t offset_high;
+    uint32_t reserved;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed)) descriptor_pointer_t;
+
+extern uint8_t kernel_entry_stack_top[];
+extern uint64_t interrupt_stub_table[INTERRUPT_EXCEPTION_COUNT];
+
+static uint64_t gdt[GDT_ENTRY_COUNT] __attribute__((aligned(16)));
+static idt_entry_t idt[IDT_ENTRY_COUNT] __attribute__((aligned(16)));
+static task_state_segment_t tss __attribute__((aligned(16)));
+static interrupt_handler_t exception_handlers[INTERRUPT_EXCEPTION_COUNT];
+
+static const char* exception_names[INTERRUPT_EXCEPTION_COUNT] = {
+    "Divide Error", "Debug", "NMI", "Breakpoint", "Overflow", "Bound Range",
+    "Invalid Opcode", "Device Not Available", "Double Fault", "Coprocessor Overrun",
+    "Invalid TSS", "Segment Not Present", "Stack Fault", "General Protection",
+    "Page Fault", "Reserved", "x87 Floating Point", "Alignment Check", "Machine Check",
+    "SIMD Floating Point", "Virtualization", "Control Protection", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Hypervisor Injection",
+    "VMM Communication", "Security", "Reserved"
+};
+
+static void build_gdt(void) {
+    gdt[0] = 0;                          // Null descriptor
+    gdt[1] = 0x00af9a000000ffffULL;      // 0x08: kernel code
+    gdt[2] = 0x00af92000000ffffULL;      // 0x10: kernel data
+    gdt[3] = 0x00aff2000000ffffULL;      // 0x18: user data (SYSRET SS)
+    gdt[4] = 0x00affa000000ffffULL;      // 0x20: user code (SYSRET CS)
+
+    uint64_t base = (uint64_t)(uintptr_t)&tss;
+    uint64_t limit = sizeof(tss) - 1;
+
+    gdt[5] = (limit & 0xFFFF) |
+             ((base & 0xFFFFFF) << 16) |
+             ((uint64_t)TSS_AVAILABLE_64 << 40) |
+             (((limit >> 16) & 0xF) << 48) |
+             (((base >> 24) & 0xFF) << 56);
+    gdt[6] = base >> 32;
+}
+
+static void load_gdt(void) {
+    descriptor_pointer_t pointer = { sizeof(gdt) - 1, (uint64_t)(uintptr_t)gdt };
+
+    __asm__ volatile(
+        "lgdt %0\n"
+        "pushq %1\n"
+        "leaq 1f(%%rip), %%rax\n"
+        "pushq %%rax\n"
+        "lretq\n"
+        "1:\n"
+        "movw %w2, %%ax\n"
+        "movw %%ax, %%ds\n"
+        "movw %%ax, %%es\n"
+        "movw %%ax, %%ss\n"
+        :
+        : "m"(pointer), "i"(GDT_KERNEL_CODE_SELECTOR), "i"(GDT_KERNEL_DATA_SELECTOR)
+        : "rax", "memory");
+
+    __asm__ volatile("ltr %w0" : : "r"(GDT_TSS_SELECTOR));
+}
+
+static void set_idt_gate(uint32_t vector, uint64_t handler) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = GDT_KERNEL_CODE_SELECTOR;
+    idt[vector].ist = 0;
+    idt[vector].type_attributes = IDT_INTERRUPT_GATE;
+    idt[vector].offset_middle = (handler >> 16) & 0xFFFF;
+    idt[vector].offset_high = (uint32_t)(handler >> 32);
+    idt[vector].reserved = 0;
+}
+
+static void load_idt(void) {
+    descriptor_pointer_t pointer = { sizeof(idt) - 1, (uint64_t)(uintptr_t)idt };
+    __asm__ volatile("lidt %0" : : "m"(pointer) : "memory");
+}
+
+static void report_exception(const char* prefix, interrupt_frame_t* frame) {
+    terminal_set_color(12, 0); // Red
+    terminal_write_string(prefix);
+    terminal_write_string(exception_names[frame->vector]);
+    terminal_write_string(" (error ");
+    terminal_write_hex(frame->error_code);
+    terminal_write_string(") at RIP ");
+    terminal_write_hex(frame->rip);
+    terminal_write_string("\n");
+    terminal_set_color(7, 0);
+}
+
+void interrupt_dispatch(interrupt_frame_t* frame) {
+    if (frame->vector < INTERRUPT_EXCEPTION_COUNT && exception_handlers[frame->vector]) {
+        if (exception_handlers[frame->vector](frame)) {
+            return;
+        }
+    }
+
+    if (frame->vector >= INTERRUPT_EXCEPTION_COUNT) {
+        return;
+    }
+
+    if ((frame->cs & 3) == 3) {
+        report_exception("\nUser process terminated: ", frame);
+        process_exit_user_mode(-(int32_t)frame->vector - 1);
+    }
+
+    report_exception("\nKERNEL PANIC: ", frame);
+    while (1) {
+        __asm__ volatile("cli; hlt");
+    }
+}
+
+void descriptor_tables_initialize(void) {
+    tss.rsp[0] = (uint64_t)(uintptr_t)kernel_entry_stack_top;
+    tss.iomap_base = sizeof(tss);
+
+    build_gdt();
+    load_gdt();
+
+    for (uint32_t vector = 0; vector < INTERRUPT_EXCEPTION_COUNT; vector++) {
+        set_idt_gate(vector, interrupt_stub_table[vector]);
+        exception_handlers[vector] = NULL;
+    }
+
+    load_idt();
+}
+
+void descriptor_tables_set_handler(uint32_t vector, interrupt_handler_t handler) {
+    if (vector < INTERRUPT_EXCEPTION_COUNT) {
+        exception_handlers[vector] = handler;
+    }
+}
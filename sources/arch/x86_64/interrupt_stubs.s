@@ -0,0 +1,100 @@
+global interrupt_stub_table
+extern interrupt_dispatch
+
+section .text
+bits 64
+
+%macro EXCEPTION_NO_ERROR 1
+exception_stub_%1:
+    push 0
+    push %1
+    jmp interrupt_common
+%endmacro
+
+%macro EXCEPTION_WITH_ERROR 1
+exception_stub_%1:
+    push %1
+    jmp interrupt_common
+%endmacro
+
+EXCEPTION_NO_ERROR 0
+EXCEPTION_NO_ERROR 1
+EXCEPTION_NO_ERROR 2
+EXCEPTION_NO_ERROR 3
+EXCEPTION_NO_ERROR 4
+EXCEPTION_NO_ERROR 5
+EXCEPTION_NO_ERROR 6
+EXCEPTION_NO_ERROR 7
+EXCEPTION_WITH_ERROR 8
+EXCEPTION_NO_ERROR 9
+EXCEPTION_WITH_ERROR 10
+EXCEPTION_WITH_ERROR 11
+EXCEPTION_WITH_ERROR 12
+EXCEPTION_WITH_ERROR 13
+EXCEPTION_WITH_ERROR 14
+EXCEPTION_NO_ERROR 15
+EXCEPTION_NO_ERROR 16
+EXCEPTION_WITH_ERROR 17
+EXCEPTION_NO_ERROR 18
+EXCEPTION_NO_ERROR 19
+EXCEPTION_NO_ERROR 20
+EXCEPTION_WITH_ERROR 21
+EXCEPTION_NO_ERROR 22
+EXCEPTION_NO_ERROR 23
+EXCEPTION_NO_ERROR 24
+EXCEPTION_NO_ERROR 25
+EXCEPTION_NO_ERROR 26
+EXCEPTION_NO_ERROR 27
+EXCEPTION_NO_ERROR 28
+EXCEPTION_WITH_ERROR 29
+EXCEPTION_WITH_ERROR 30
+EXCEPTION_NO_ERROR 31
+
+; Builds an interrupt_frame_t on the stack and hands it to C.
+interrupt_common:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov rdi, rsp
+    call interrupt_dispatch
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+
+    add rsp, 16
+    iretq
+
+section .rodata
+align 8
+interrupt_stub_table:
+%assign vector 0
+%rep 32
+    dq exception_stub_%+vector
+%assign vector vector + 1
+%endrep
@@ -1,5 +1,7 @@
 global apollo_long_mode_entry
 extern apollo_kernel_main
+extern multiboot_magic
+extern multiboot_info_address
 
 section .text
 bits 64
@@ -19,6 +21,8 @@ apollo_long_mode_entry:
     
     call initialize_fpu
     
+    mov edi, [multiboot_magic]
+    mov esi, [multiboot_info_address]
     call apollo_kernel_main
     
 apollo_halt_loop:
@@ -0,0 +1,10 @@
+global rootfs_image_start
+global rootfs_image_end
+
+; Root filesystem image built from rootfs/ by tools/mkrootfs. The build
+; directory is on the include path, so incbin finds the generated file.
+section .rodata
+align 16
+rootfs_image_start:
+    incbin "rootfs.img"
+rootfs_image_end:
@@ -0,0 +1,195 @@
+global user_mode_enter
+global user_mode_exit
+global system_call_entry
+global kernel_entry_stack_top
+global user_saved_registers
+global user_benchmark_blob_start
+global user_benchmark_blob_end
+extern system_call_dispatch
+
+USER_CODE_SELECTOR equ 0x23
+USER_DATA_SELECTOR equ 0x1B
+KERNEL_DATA_SELECTOR equ 0x10
+
+; Offsets into user_registers_t (process_manager.h).
+REGISTER_RAX equ 0
+REGISTER_RBX equ 8
+REGISTER_RCX equ 16
+REGISTER_RDX equ 24
+REGISTER_RSI equ 32
+REGISTER_RDI equ 40
+REGISTER_RBP equ 48
+REGISTER_R8 equ 56
+REGISTER_R9 equ 64
+REGISTER_R10 equ 72
+REGISTER_R11 equ 80
+REGISTER_R12 equ 88
+REGISTER_R13 equ 96
+REGISTER_R14 equ 104
+REGISTER_R15 equ 112
+REGISTER_RIP equ 120
+REGISTER_RSP equ 128
+REGISTER_RFLAGS equ 136
+USER_REGISTERS_SIZE equ 144
+
+SYS_EXIT equ 0
+SYS_GETPID equ 2
+
+section .text
+bits 64
+
+; uint64_t user_mode_enter(const user_registers_t* registers)
+; Drops to ring 3 with every general register, rip, rsp and rflags taken
+; from registers. Returns only when user_mode_exit is called from a system
+; call or fault handler, with its status in rax.
+user_mode_enter:
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+    mov [user_return_rsp], rsp
+
+    push USER_DATA_SELECTOR
+    push qword [rdi + REGISTER_RSP]
+    push qword [rdi + REGISTER_RFLAGS]
+    push USER_CODE_SELECTOR
+    push qword [rdi + REGISTER_RIP]
+
+    mov ax, USER_DATA_SELECTOR
+    mov ds, ax
+    mov es, ax
+
+    mov rax, [rdi + REGISTER_RAX]
+    mov rbx, [rdi + REGISTER_RBX]
+    mov rcx, [rdi + REGISTER_RCX]
+    mov rdx, [rdi + REGISTER_RDX]
+    mov rsi, [rdi + REGISTER_RSI]
+    mov rbp, [rdi + REGISTER_RBP]
+    mov r8, [rdi + REGISTER_R8]
+    mov r9, [rdi + REGISTER_R9]
+    mov r10, [rdi + REGISTER_R10]
+    mov r11, [rdi + REGISTER_R11]
+    mov r12, [rdi + REGISTER_R12]
+    mov r13, [rdi + REGISTER_R13]
+    mov r14, [rdi + REGISTER_R14]
+    mov r15, [rdi + REGISTER_R15]
+    mov rdi, [rdi + REGISTER_RDI]
+
+    iretq
+
+; void user_mode_exit(uint64_t status)
+; Unwinds back to the kernel context saved by user_mode_enter.
+user_mode_exit:
+    mov rax, rdi
+    mov rsp, [user_return_rsp]
+
+    mov cx, KERNEL_DATA_SELECTOR
+    mov ds, cx
+    mov es, cx
+    mov ss, cx
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
+
+; SYSCALL entry: rax = number, rdi/rsi/rdx/r10/r8 = arguments.
+; rcx and r11 hold the user rip and rflags for SYSRET. The whole user
+; register frame is kept in user_saved_registers for fork.
+system_call_entry:
+    mov [user_saved_registers + REGISTER_RAX], rax
+    mov [user_saved_registers + REGISTER_RBX], rbx
+    mov [user_saved_registers + REGISTER_RCX], rcx
+    mov [user_saved_registers + REGISTER_RDX], rdx
+    mov [user_saved_registers + REGISTER_RSI], rsi
+    mov [user_saved_registers + REGISTER_RDI], rdi
+    mov [user_saved_registers + REGISTER_RBP], rbp
+    mov [user_saved_registers + REGISTER_R8], r8
+    mov [user_saved_registers + REGISTER_R9], r9
+    mov [user_saved_registers + REGISTER_R10], r10
+    mov [user_saved_registers + REGISTER_R11], r11
+    mov [user_saved_registers + REGISTER_R12], r12
+    mov [user_saved_registers + REGISTER_R13], r13
+    mov [user_saved_registers + REGISTER_R14], r14
+    mov [user_saved_registers + REGISTER_R15], r15
+    mov [user_saved_registers + REGISTER_RIP], rcx
+    mov [user_saved_registers + REGISTER_RSP], rsp
+    mov [user_saved_registers + REGISTER_RFLAGS], r11
+    mov rsp, kernel_entry_stack_top
+
+    push rcx
+    push r11
+    push rdi
+    push rsi
+    push rdx
+    push r10
+    push r8
+    push r9
+
+    mov r9, r8
+    mov r8, r10
+    mov rcx, rdx
+    mov rdx, rsi
+    mov rsi, rdi
+    mov rdi, rax
+    call system_call_dispatch
+
+    pop r9
+    pop r8
+    pop r10
+    pop rdx
+    pop rsi
+    pop rdi
+    pop r11
+    pop rcx
+
+    ; SYSRET faults in ring 0 on a non-canonical rcx, after the user rsp
+    ; is already loaded. Anything outside the lower half goes back
+    ; through IRETQ, which faults on the kernel stack instead.
+    push rax
+    mov rax, rcx
+    shr rax, 47
+    pop rax
+    jnz .return_with_iretq
+
+    mov rsp, [user_saved_registers + REGISTER_RSP]
+    o64 sysret
+
+.return_with_iretq:
+    push USER_DATA_SELECTOR
+    push qword [user_saved_registers + REGISTER_RSP]
+    push r11
+    push USER_CODE_SELECTOR
+    push rcx
+    iretq
+
+; Position-independent ring 3 loop used by the system call benchmark.
+; rdi = iterations.
+user_benchmark_blob_start:
+    mov r12, rdi
+.next_call:
+    mov eax, SYS_GETPID
+    syscall
+    dec r12
+    jnz .next_call
+    xor edi, edi
+    mov eax, SYS_EXIT
+    syscall
+user_benchmark_blob_end:
+
+section .bss
+align 16
+user_return_rsp:
+    resq 1
+user_saved_registers:
+    resb USER_REGISTERS_SIZE
+
+align 16
+kernel_entry_stack_bottom:
+    resb 16384    ; 16KB stack for system calls and ring 3 interrupts
+kernel_entry_stack_top:
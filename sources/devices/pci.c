@@ -0,0 +1,152 @@
+#include "pci.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PCI_CONFIG_ADDRESS_PORT 0xCF8
+#define PCI_CONFIG_DATA_PORT 0xCFC
+#define PCI_CONFIG_ENABLE 0x80000000
+
+#define PCI_MAX_BUSES 256
+#define PCI_MAX_SLOTS 32
+#define PCI_MAX_FUNCTIONS 8
+
+#define PCI_VENDOR_NONE 0xFFFF
+#define PCI_HEADER_MULTI_FUNCTION 0x80
+#define PCI_HEADER_TYPE_MASK 0x7F
+
+static struct {
+    pci_device_t devices[PCI_MAX_DEVICES];
+    uint32_t device_count;
+    bool is_initialized;
+} pci_state = {0};
+
+static inline void outl(uint16_t port, uint32_t data) {
+    __asm__ volatile("outl %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t result;
+    __asm__ volatile("inl %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS_PORT, PCI_CONFIG_ENABLE | ((uint32_t)bus << 16) |
+                                  ((uint32_t)slot << 11) | ((uint32_t)function << 8) |
+                                  (offset & 0xFC));
+    return inl(PCI_CONFIG_DATA_PORT);
+}
+
+static void config_write(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS_PORT, PCI_CONFIG_ENABLE | ((uint32_t)bus << 16) |
+                                  ((uint32_t)slot << 11) | ((uint32_t)function << 8) |
+                                  (offset & 0xFC));
+    outl(PCI_CONFIG_DATA_PORT, value);
+}
+
+static void record_function(uint8_t bus, uint8_t slot, uint8_t function) {
+    if (pci_state.device_count >= PCI_MAX_DEVICES) return;
+
+    pci_device_t* device = &pci_state.devices[pci_state.device_count++];
+    uint32_t id = config_read(bus, slot, function, PCI_CONFIG_VENDOR_ID);
+    uint32_t class_info = config_read(bus, slot, function, PCI_CONFIG_CLASS);
+
+    device->bus = bus;
+    device->slot = slot;
+    device->function = function;
+    device->vendor_id = (uint16_t)(id & 0xFFFF);
+    device->device_id = (uint16_t)(id >> 16);
+    device->class_code = (uint8_t)(class_info >> 24);
+    device->subclass = (uint8_t)(class_info >> 16);
+    device->prog_if = (uint8_t)(class_info >> 8);
+    device->interrupt_line = (uint8_t)config_read(bus, slot, function, PCI_CONFIG_INTERRUPT_LINE);
+
+    for (uint32_t i = 0; i < 6; i++) {
+        device->bars[i] = config_read(bus, slot, function, PCI_CONFIG_BAR0 + i * 4);
+    }
+}
+
+void pci_initialize(void) {
+    if (pci_state.is_initialized) return;
+
+    pci_state.device_count = 0;
+
+    for (uint32_t bus = 0; bus < PCI_MAX_BUSES; bus++) {
+        for (uint32_t slot = 0; slot < PCI_MAX_SLOTS; slot++) {
+            uint32_t id = config_read(bus, slot, 0, PCI_CONFIG_VENDOR_ID);
+            if ((id & 0xFFFF) == PCI_VENDOR_NONE) continue;
+
+            uint8_t header_type = (uint8_t)(config_read(bus, slot, 0, PCI_CONFIG_HEADER_TYPE & 0xFC) >>
+                                            ((PCI_CONFIG_HEADER_TYPE & 3) * 8));
+            uint32_t functions = (header_type & PCI_HEADER_MULTI_FUNCTION) ? PCI_MAX_FUNCTIONS : 1;
+
+            for (uint32_t function = 0; function < functions; function++) {
+                id = config_read(bus, slot, function, PCI_CONFIG_VENDOR_ID);
+                if ((id & 0xFFFF) == PCI_VENDOR_NONE) continue;
+
+                record_function(bus, slot, function);
+            }
+        }
+    }
+
+    pci_state.is_initialized = true;
+}
+
+uint32_t pci_get_device_count(void) {
+    return pci_state.device_count;
+}
+
+const pci_device_t* pci_get_device(uint32_t index) {
+    if (index >= pci_state.device_count) return NULL;
+    return &pci_state.devices[index];
+}
+
+const pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id) {
+    for (uint32_t i = 0; i < pci_state.device_count; i++) {
+        if (pci_state.devices[i].vendor_id == vendor_id &&
+            pci_state.devices[i].device_id == device_id) {
+            return &pci_state.devices[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t pci_config_read32(const pci_device_t* device, uint8_t offset) {
+    return config_read(device->bus, device->slot, device->function, offset);
+}
+
+uint16_t pci_config_read16(const pci_device_t* device, uint8_t offset) {
+    uint32_t value = config_read(device->bus, device->slot, device->function, offset);
+    return (uint16_t)(value >> ((offset & 2) * 8));
+}
+
+void pci_config_write16(const pci_device_t* device, uint8_t offset, uint16_t value) {
+    uint32_t current = config_read(device->bus, device->slot, device->function, offset);
+    uint32_t shift = (offset & 2) * 8;
+
+    current &= ~(0xFFFFU << shift);
+    current |= (uint32_t)value << shift;
+    config_write(device->bus, device->slot, device->function, offset, current);
+}
+
+void pci_enable_device(const pci_device_t* device) {
+    uint16_t command = pci_config_read16(device, PCI_CONFIG_COMMAND);
+    command |= PCI_COMMAND_IO_SPACE | PCI_COMMAND_MEMORY_SPACE | PCI_COMMAND_BUS_MASTER;
+    pci_config_write16(device, PCI_CONFIG_COMMAND, command);
+}
+
+const char* pci_get_class_string(uint8_t class_code) {
+    switch (class_code) {
+        case 0x01: return "storage";
+        case 0x02: return "network";
+        case 0x03: return "display";
+        case 0x04: return "multimedia";
+        case 0x05: return "memory";
+        case 0x06: return "bridge";
+        case 0x07: return "communication";
+        case 0x08: return "system";
+        case 0x0C: return "serial bus";
+        default: return "other";
+    }
+}
@@ -0,0 +1,334 @@
+#include "virtio_block.h"
+#include "block_device.h"
+#include "pci.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Legacy virtio PCI register block, found through BAR0 in I/O space.
+#define VIRTIO_REG_DEVICE_FEATURES 0x00
+#define VIRTIO_REG_GUEST_FEATURES 0x04
+#define VIRTIO_REG_QUEUE_PFN 0x08
+#define VIRTIO_REG_QUEUE_SIZE 0x0C
+#define VIRTIO_REG_QUEUE_SELECT 0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY 0x10
+#define VIRTIO_REG_DEVICE_STATUS 0x12
+#define VIRTIO_REG_ISR_STATUS 0x13
+#define VIRTIO_REG_BLOCK_CAPACITY 0x14
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+
+#define VIRTIO_BLOCK_FEATURE_READ_ONLY (1U << 5)
+#define VIRTIO_BLOCK_FEATURE_FLUSH (1U << 9)
+
+#define VIRTIO_BLOCK_REQUEST_IN 0
+#define VIRTIO_BLOCK_REQUEST_OUT 1
+#define VIRTIO_BLOCK_REQUEST_FLUSH 4
+
+#define VIRTIO_BLOCK_STATUS_OK 0
+
+#define VRING_DESC_FLAG_NEXT 0x1
+#define VRING_DESC_FLAG_WRITE 0x2
+#define VRING_AVAIL_FLAG_NO_INTERRUPT 0x1
+
+#define VIRTIO_QUEUE_ALIGNMENT 4096
+#define VIRTIO_QUEUE_MAX_SIZE 1024
+#define VIRTIO_QUEUE_MEMORY_SIZE (32 * 1024)
+
+#define VIRTIO_BLOCK_MAX_SECTORS_PER_REQUEST 128
+#define VIRTIO_BLOCK_POLL_LIMIT 100000000U
+
+typedef struct {
+    uint64_t address;
+    uint32_t length;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t index;
+    uint16_t ring[];
+} __attribute__((packed)) vring_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t length;
+} __attribute__((packed)) vring_used_element_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t index;
+    vring_used_element_t ring[];
+} __attribute__((packed)) vring_used_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_block_request_header_t;
+
+static uint8_t virtio_queue_memory[VIRTIO_QUEUE_MEMORY_SIZE] __attribute__((aligned(VIRTIO_QUEUE_ALIGNMENT)));
+
+static struct {
+    uint16_t io_base;
+    uint16_t queue_size;
+    uint16_t last_used_index;
+    volatile vring_desc_t* descriptors;
+    volatile vring_avail_t* available;
+    volatile vring_used_t* used;
+    virtio_block_request_header_t header;
+    volatile uint8_t request_status;
+    uint64_t capacity_sectors;
+    bool flush_supported;
+    uint32_t requests_completed;
+    uint32_t requests_failed;
+    block_device_t device;
+    bool is_initialized;
+    bool is_failed;
+} virtio_state = {0};
+
+static inline void outb(uint16_t port, uint8_t data) {
+    __asm__ volatile("outb %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t result;
+    __asm__ volatile("inb %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline void outw(uint16_t port, uint16_t data) {
+    __asm__ volatile("outw %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t result;
+    __asm__ volatile("inw %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline void outl(uint16_t port, uint32_t data) {
+    __asm__ volatile("outl %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t result;
+    __asm__ volatile("inl %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline void memory_barrier(void) {
+    __asm__ volatile("mfence" ::: "memory");
+}
+
+static void memory_set(void* dest, uint8_t value, size_t size) {
+    uint8_t* d = (uint8_t*)dest;
+    for (size_t i = 0; i < size; i++) {
+        d[i] = value;
+    }
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t queue_memory_size(uint16_t queue_size) {
+    size_t driver_area = sizeof(vring_desc_t) * queue_size + sizeof(uint16_t) * (3 + queue_size);
+    size_t device_area = sizeof(uint16_t) * 3 + sizeof(vring_used_element_t) * queue_size;
+    return align_up(driver_area, VIRTIO_QUEUE_ALIGNMENT) + align_up(device_area, VIRTIO_QUEUE_ALIGNMENT);
+}
+
+// Everything the device touches is identity mapped, so a kernel pointer is
+// also its physical address.
+static uint64_t physical_address(const volatile void* pointer) {
+    return (uint64_t)(uintptr_t)pointer;
+}
+
+static void set_descriptor(uint16_t index, const volatile void* buffer, uint32_t length,
+                           uint16_t flags, uint16_t next) {
+    volatile vring_desc_t* desc = &virtio_state.descriptors[index];
+    desc->address = physical_address(buffer);
+    desc->length = length;
+    desc->flags = flags;
+    desc->next = next;
+}
+
+// Queues one descriptor chain starting at slot 0 and spins until the device
+// hands it back. Only one request is ever in flight.
+static bool submit_request(uint32_t type, uint64_t sector, void* data, uint32_t data_length) {
+    if (virtio_state.is_failed) return false;
+
+    virtio_state.header.type = type;
+    virtio_state.header.reserved = 0;
+    virtio_state.header.sector = sector;
+    virtio_state.request_status = 0xFF;
+
+    if (data_length > 0) {
+        uint16_t data_flags = VRING_DESC_FLAG_NEXT;
+        if (type == VIRTIO_BLOCK_REQUEST_IN) data_flags |= VRING_DESC_FLAG_WRITE;
+
+        set_descriptor(0, &virtio_state.header, sizeof(virtio_state.header), VRING_DESC_FLAG_NEXT, 1);
+        set_descriptor(1, data, data_length, data_flags, 2);
+        set_descriptor(2, &virtio_state.request_status, 1, VRING_DESC_FLAG_WRITE, 0);
+    } else {
+        set_descriptor(0, &virtio_state.header, sizeof(virtio_state.header), VRING_DESC_FLAG_NEXT, 1);
+        set_descriptor(1, &virtio_state.request_status, 1, VRING_DESC_FLAG_WRITE, 0);
+    }
+
+    uint16_t avail_index = virtio_state.available->index;
+    virtio_state.available->ring[avail_index % virtio_state.queue_size] = 0;
+    memory_barrier();
+    virtio_state.available->index = avail_index + 1;
+    memory_barrier();
+
+    outw(virtio_state.io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+
+    uint32_t spins = 0;
+    while (virtio_state.used->index == virtio_state.last_used_index) {
+        if (++spins >= VIRTIO_BLOCK_POLL_LIMIT) {
+            // The device may still own the chain and the shared header, so
+            // neither can be reused. A reset takes the queue away from it
+            // and every later request fails.
+            outb(virtio_state.io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+            outb(virtio_state.io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+            virtio_state.is_failed = true;
+            virtio_state.requests_failed++;
+            return false;
+        }
+        __asm__ volatile("pause" ::: "memory");
+    }
+    memory_barrier();
+
+    virtio_state.last_used_index++;
+    (void)inb(virtio_state.io_base + VIRTIO_REG_ISR_STATUS);
+
+    if (virtio_state.request_status != VIRTIO_BLOCK_STATUS_OK) {
+        virtio_state.requests_failed++;
+        return false;
+    }
+
+    virtio_state.requests_completed++;
+    return true;
+}
+
+static bool transfer(uint32_t type, uint64_t block, uint32_t count, void* buffer) {
+    uint8_t* cursor = (uint8_t*)buffer;
+
+    while (count > 0) {
+        uint32_t chunk = count;
+        if (chunk > VIRTIO_BLOCK_MAX_SECTORS_PER_REQUEST) chunk = VIRTIO_BLOCK_MAX_SECTORS_PER_REQUEST;
+
+        if (!submit_request(type, block, cursor, chunk * BLOCK_DEVICE_SECTOR_SIZE)) {
+            return false;
+        }
+
+        cursor += chunk * BLOCK_DEVICE_SECTOR_SIZE;
+        block += chunk;
+        count -= chunk;
+    }
+
+    return true;
+}
+
+static bool virtio_block_read(block_device_t* device, uint64_t block, uint32_t count, void* buffer) {
+    (void)device;
+    return transfer(VIRTIO_BLOCK_REQUEST_IN, block, count, buffer);
+}
+
+static bool virtio_block_write(block_device_t* device, uint64_t block, uint32_t count, const void* buffer) {
+    (void)device;
+    return transfer(VIRTIO_BLOCK_REQUEST_OUT, block, count, (void*)(uintptr_t)buffer);
+}
+
+static bool virtio_block_flush(block_device_t* device) {
+    (void)device;
+    if (!virtio_state.flush_supported) return true;
+    return submit_request(VIRTIO_BLOCK_REQUEST_FLUSH, 0, NULL, 0);
+}
+
+static const block_device_ops_t virtio_block_ops = {
+    .read = virtio_block_read,
+    .write = virtio_block_write,
+    .flush = virtio_block_flush,
+};
+
+bool virtio_block_initialize(void) {
+    if (virtio_state.is_initialized) return true;
+
+    const pci_device_t* pci = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLOCK_LEGACY_DEVICE_ID);
+    if (!pci || !(pci->bars[0] & PCI_BAR_IO_SPACE)) return false;
+
+    pci_enable_device(pci);
+    virtio_state.io_base = (uint16_t)(pci->bars[0] & PCI_BAR_IO_MASK);
+    uint16_t io = virtio_state.io_base;
+
+    outb(io + VIRTIO_REG_DEVICE_STATUS, 0);
+    outb(io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    uint32_t features = inl(io + VIRTIO_REG_DEVICE_FEATURES);
+    uint32_t accepted = features & (VIRTIO_BLOCK_FEATURE_READ_ONLY | VIRTIO_BLOCK_FEATURE_FLUSH);
+    outl(io + VIRTIO_REG_GUEST_FEATURES, accepted);
+
+    outw(io + VIRTIO_REG_QUEUE_SELECT, 0);
+    uint16_t queue_size = inw(io + VIRTIO_REG_QUEUE_SIZE);
+    if (queue_size == 0 || queue_size > VIRTIO_QUEUE_MAX_SIZE ||
+        queue_memory_size(queue_size) > VIRTIO_QUEUE_MEMORY_SIZE) {
+        outb(io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        return false;
+    }
+
+    memory_set(virtio_queue_memory, 0, sizeof(virtio_queue_memory));
+    size_t used_offset = align_up(sizeof(vring_desc_t) * queue_size + sizeof(uint16_t) * (3 + queue_size),
+                                  VIRTIO_QUEUE_ALIGNMENT);
+
+    virtio_state.queue_size = queue_size;
+    virtio_state.last_used_index = 0;
+    virtio_state.descriptors = (volatile vring_desc_t*)virtio_queue_memory;
+    virtio_state.available = (volatile vring_avail_t*)(virtio_queue_memory + sizeof(vring_desc_t) * queue_size);
+    virtio_state.used = (volatile vring_used_t*)(virtio_queue_memory + used_offset);
+
+    // Completions are polled, so ask the device not to raise interrupts.
+    virtio_state.available->flags = VRING_AVAIL_FLAG_NO_INTERRUPT;
+
+    outl(io + VIRTIO_REG_QUEUE_PFN, (uint32_t)(physical_address(virtio_queue_memory) / VIRTIO_QUEUE_ALIGNMENT));
+
+    outb(io + VIRTIO_REG_DEVICE_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    virtio_state.capacity_sectors = (uint64_t)inl(io + VIRTIO_REG_BLOCK_CAPACITY) |
+                                    ((uint64_t)inl(io + VIRTIO_REG_BLOCK_CAPACITY + 4) << 32);
+    virtio_state.flush_supported = (accepted & VIRTIO_BLOCK_FEATURE_FLUSH) != 0;
+
+    block_device_t* device = &virtio_state.device;
+    const char* name = VIRTIO_BLOCK_DEVICE_NAME;
+    for (uint32_t i = 0; name[i] && i < BLOCK_DEVICE_NAME_LENGTH - 1; i++) {
+        device->name[i] = name[i];
+    }
+    device->block_size = BLOCK_DEVICE_SECTOR_SIZE;
+    device->block_count = virtio_state.capacity_sectors;
+    device->read_only = (accepted & VIRTIO_BLOCK_FEATURE_READ_ONLY) != 0;
+    device->ops = &virtio_block_ops;
+    device->driver_data = NULL;
+
+    if (!block_device_register(device)) return false;
+
+    virtio_state.is_initialized = true;
+    return true;
+}
+
+bool virtio_block_get_info(virtio_block_info_t* info) {
+    if (!info || !virtio_state.is_initialized) return false;
+
+    info->capacity_sectors = virtio_state.capacity_sectors;
+    info->queue_size = virtio_state.queue_size;
+    info->flush_supported = virtio_state.flush_supported;
+    info->read_only = virtio_state.device.read_only;
+    info->requests_completed = virtio_state.requests_completed;
+    info->requests_failed = virtio_state.requests_failed;
+    return true;
+}
@@ -4,8 +4,17 @@
 #include "input_manager.h"
 #include "command_processor.h"
 #include "heap_allocator.h"
+#include "frame_allocator.h"
+#include "address_space.h"
+#include "descriptor_tables.h"
+#include "system_calls.h"
+#include "program_loader.h"
 #include "time_keeper.h"
 #include "filesystem.h"
+#include "pci.h"
+#include "virtio_block.h"
+#include "multiboot.h"
+#include "initrd.h"
 #include "process_manager.h"
 #include "text_editor.h"
 
@@ -13,9 +22,11 @@
 #define APOLLO_ARCH "x86_64"
 #define APOLLO_BUILD_DATE __DATE__
 #define APOLLO_BUILD_TIME __TIME__
+#define APOLLO_SYNC_INTERVAL_SECONDS 5
 
 static struct {
     uint32_t boot_time;
+    uint32_t last_sync_time;
     uint32_t initialization_steps;
     bool all_systems_ready;
 } system_state = {0};
@@ -83,11 +94,27 @@ static void apollo_initialize_all_systems(void) {
     
     heap_allocator_initialize();
     
+    descriptor_tables_initialize();
+    
+    system_calls_initialize();
+    
+    program_loader_initialize();
+    
+    frame_allocator_initialize();
+    
+    address_space_initialize();
+    
     time_keeper_initialize();
     system_state.boot_time = time_keeper_get_uptime_seconds();
     
+    pci_initialize();
+    
+    virtio_block_initialize();
+    
     filesystem_initialize();
     
+    initrd_initialize();
+    
     process_manager_initialize();
     
     terminal_initialize(); // Re-initialize for consistency
@@ -176,12 +203,22 @@ static void update_system_activity(void) {
     extern void process_scheduler_tick(void);
     process_scheduler_tick();
     
+    time_keeper_update_time_page();
+    
+    uint32_t now = time_keeper_get_uptime_seconds();
+    if (now - system_state.last_sync_time >= APOLLO_SYNC_INTERVAL_SECONDS) {
+        filesystem_sync();
+        system_state.last_sync_time = now;
+    }
+    
     uint32_t current_heap_usage = heap_allocator_get_used_memory();
     extern void process_update_memory_usage(uint32_t pid, uint32_t memory_bytes);
     process_update_memory_usage(5, current_heap_usage); // Shell process
 }
 
-void apollo_kernel_main(void) {
+void apollo_kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info_address) {
+    
+    multiboot_initialize(multiboot_magic, multiboot_info_address);
     
     terminal_initialize();
 
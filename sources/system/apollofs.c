@@ -0,0 +1,2216 @@
+#include "apollofs.h"
+#include "vfs.h"
+#include "heap_allocator.h"
+#include "time_keeper.h"
+#include "block_device.h"
+#include "buffer_cache.h"
+#include "filesystem_image.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FS_DIRECTORY_HASH_BUCKETS 16  // Initial size, power of two
+#define FS_DIRECTORY_MAX_LOAD 4       // Average chain length before doubling
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+#define FS_DENTRY_CACHE_SIZE 128       // Power of two
+#define FS_BITMAP_WORDS ((FS_MAX_BLOCKS + 63) / 64)
+#define FS_READAHEAD_MIN_BLOCKS 4
+#define FS_READAHEAD_MAX_BLOCKS BUFFER_CACHE_MAX_BATCH
+#define FS_WRITE_BEHIND_BLOCKS BUFFER_CACHE_MAX_BATCH
+
+// On-disk layout, in device blocks: superblock, block bitmap, inode table
+// with a slot for every possible inode id, then the data blocks.
+#define FS_DEVICE_NAME "vda"
+#define FS_SUPERBLOCK_MAGIC 0x53465041   // "APFS"
+#define FS_DISK_VERSION 1
+#define FS_DISK_INODES_PER_BLOCK (FS_BLOCK_SIZE / sizeof(fs_disk_inode_t))
+#define FS_BITMAP_BLOCKS ((FS_BITMAP_WORDS * 8 + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE)
+#define FS_INODE_TABLE_BLOCKS (FS_MAX_FILES / FS_DISK_INODES_PER_BLOCK)
+#define FS_SUPERBLOCK_LBA 0
+#define FS_BITMAP_LBA 1
+#define FS_INODE_TABLE_LBA (FS_BITMAP_LBA + FS_BITMAP_BLOCKS)
+#define FS_DATA_LBA (FS_INODE_TABLE_LBA + FS_INODE_TABLE_BLOCKS)
+#define FS_DISK_BLOCKS (FS_DATA_LBA + FS_MAX_BLOCKS)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t data_blocks;
+    uint32_t max_inodes;
+    uint32_t inode_chunk_count;
+    uint32_t system_time;
+} __attribute__((packed)) fs_superblock_t;
+
+// A cached (parent, component) -> inode resolution. Entries are only
+// trusted while their generation matches the filesystem's, which is bumped
+// whenever a name disappears.
+typedef struct {
+    uint32_t parent_id;
+    uint32_t name_hash;
+    uint32_t file_id;
+    uint32_t generation;
+} fs_dentry_t;
+
+// Per-directory name index. Doubles once chains average more than
+// FS_DIRECTORY_MAX_LOAD entries so lookups stay short in huge directories.
+typedef struct {
+    uint32_t bucket_count;
+    uint32_t entry_count;
+    uint32_t buckets[];
+} fs_directory_index_t;
+
+// Cold per-inode metadata, only touched once a lookup has settled on an
+// inode.
+typedef struct {
+    char name[FS_MAX_FILENAME_LENGTH];
+    fs_file_type_t type;
+    uint32_t size;
+    uint32_t created_time;
+    uint32_t modified_time;
+    uint8_t permissions;
+    // A file of up to FS_INLINE_DATA_SIZE bytes is created inline and is
+    // promoted to blocks when it grows past that; bytes past its size are
+    // kept zero.
+    bool is_inline;
+    union {
+        struct {
+            fs_extent_t extents[FS_INLINE_EXTENTS];
+            uint32_t extent_count;
+            uint32_t indirect_block;
+        };
+        uint8_t inline_data[FS_INLINE_DATA_SIZE];
+    };
+    // Attached nodes cannot be changed and are never written to disk. An
+    // attached file's data is read in place from backing_data.
+    bool read_only;
+    const uint8_t* backing_data;
+    // For a directory, the bytes of file data and the number of nodes below
+    // it at any depth. Kept up to date on every change, so du never walks;
+    // not stored on disk but rebuilt at mount.
+    uint32_t tree_bytes;
+    uint32_t tree_nodes;
+} fs_inode_t;
+
+// Inodes are allocated a chunk at a time and chunks are never released, so
+// an inode id stays a stable index for the life of the filesystem. Fields
+// are split into dense arrays so chain walks and scans touch only the
+// validity bits, parents and hashes, not the 100-odd bytes of metadata.
+typedef struct {
+    uint64_t valid_bits[FS_INODES_PER_CHUNK / 64];
+    uint32_t parent_ids[FS_INODES_PER_CHUNK];
+    uint32_t name_hashes[FS_INODES_PER_CHUNK];
+    // Directory chain link while the inode is in use, free-list link while
+    // it is not. 0 ends either list since inode 0 is never handed out.
+    uint32_t next_ids[FS_INODES_PER_CHUNK];
+    fs_directory_index_t* directory_indexes[FS_INODES_PER_CHUNK];
+    // Inodes changed since the table was last written to the device.
+    uint64_t dirty_bits[FS_INODES_PER_CHUNK / 64];
+    fs_inode_t inodes[FS_INODES_PER_CHUNK];
+} fs_inode_chunk_t;
+
+typedef struct {
+    fs_inode_chunk_t* inode_chunks[FS_MAX_INODE_CHUNKS];
+    uint32_t inode_chunk_count;
+    uint32_t free_inode_head;
+    uint32_t file_count;
+    uint32_t directory_count;
+    fs_dentry_t dentry_cache[FS_DENTRY_CACHE_SIZE];
+    uint32_t dentry_generation;
+    uint32_t dentry_hits;
+    uint32_t dentry_misses;
+    uint32_t sync_count;
+    uint8_t* block_arena;
+    block_device_t* device;
+    uint64_t block_bitmap[FS_BITMAP_WORDS];
+    // Owners of each block beyond the first, for blocks that copies share.
+    // Not stored on disk; rebuilt from the extent maps at mount.
+    uint16_t block_shares[FS_MAX_BLOCKS];
+    uint32_t shared_references;
+    uint32_t free_block_count;
+    uint32_t next_fit_hint;
+    bool bitmap_dirty;
+    bool metadata_dirty;
+    uint32_t system_time;
+} apollofs_state_t;
+
+// Every mount has its own state, reached through its superblock. The
+// operations below select it on entry and the helpers work on it from there;
+// nothing runs concurrently, so one pointer is enough.
+static apollofs_state_t* fs = NULL;
+
+// Built from rootfs/ by tools/mkrootfs and pulled in by rootfs_image.s.
+extern const uint8_t rootfs_image_start[];
+extern const uint8_t rootfs_image_end[];
+
+static uint32_t string_length(const char* str) {
+    uint32_t len = 0;
+    while (str && str[len] != '\0') len++;
+    return len;
+}
+
+static void string_copy(char* dest, const char* src) {
+    while (*src) {
+        *dest++ = *src++;
+    }
+    *dest = '\0';
+}
+
+static int string_compare(const char* str1, const char* str2) {
+    while (*str1 && *str2 && *str1 == *str2) {
+        str1++;
+        str2++;
+    }
+    return *str1 - *str2;
+}
+
+static void memory_copy(void* dest, const void* src, uint32_t size) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (uint32_t i = 0; i < size; i++) {
+        d[i] = s[i];
+    }
+}
+
+static void memory_set(void* dest, uint8_t value, uint32_t size) {
+    uint8_t* d = (uint8_t*)dest;
+    for (uint32_t i = 0; i < size; i++) {
+        d[i] = value;
+    }
+}
+
+static uint32_t get_current_time(void) {
+    return ++fs->system_time;
+}
+
+// Data blocks live in one contiguous arena when there is no disk, so an
+// extent is one run of memory and is copied in a single pass. With a disk
+// they go through the buffer cache a block at a time. Ranges may span
+// consecutive blocks.
+static bool storage_read(uint32_t block_id, uint32_t offset, void* buffer, uint32_t size) {
+    if (!fs->device) {
+        memory_copy(buffer, fs->block_arena + block_id * FS_BLOCK_SIZE + offset, size);
+        return true;
+    }
+    
+    uint8_t* dest = (uint8_t*)buffer;
+    while (size > 0) {
+        block_id += offset / FS_BLOCK_SIZE;
+        offset %= FS_BLOCK_SIZE;
+        
+        uint32_t chunk = FS_BLOCK_SIZE - offset;
+        if (chunk > size) chunk = size;
+        
+        buffer_t* cached = buffer_cache_get(fs->device, FS_DATA_LBA + block_id);
+        if (!cached) return false;
+        
+        memory_copy(dest, cached->data + offset, chunk);
+        buffer_cache_release(cached);
+        
+        dest += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+static bool storage_write(uint32_t block_id, uint32_t offset, const void* buffer, uint32_t size) {
+    if (!fs->device) {
+        memory_copy(fs->block_arena + block_id * FS_BLOCK_SIZE + offset, buffer, size);
+        return true;
+    }
+    
+    const uint8_t* src = (const uint8_t*)buffer;
+    while (size > 0) {
+        block_id += offset / FS_BLOCK_SIZE;
+        offset %= FS_BLOCK_SIZE;
+        
+        uint32_t chunk = FS_BLOCK_SIZE - offset;
+        if (chunk > size) chunk = size;
+        
+        // A whole-block overwrite has no use for the old contents.
+        buffer_t* cached = (chunk == FS_BLOCK_SIZE)
+            ? buffer_cache_get_new(fs->device, FS_DATA_LBA + block_id)
+            : buffer_cache_get(fs->device, FS_DATA_LBA + block_id);
+        if (!cached) return false;
+        
+        memory_copy(cached->data + offset, src, chunk);
+        buffer_cache_mark_dirty(cached);
+        buffer_cache_release(cached);
+        
+        src += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+static bool storage_zero(uint32_t block_id, uint32_t offset, uint32_t size) {
+    if (!fs->device) {
+        memory_set(fs->block_arena + block_id * FS_BLOCK_SIZE + offset, 0, size);
+        return true;
+    }
+    
+    uint8_t zeros[FS_BLOCK_SIZE];
+    memory_set(zeros, 0, FS_BLOCK_SIZE);
+    
+    while (size > 0) {
+        uint32_t chunk = FS_BLOCK_SIZE - (offset % FS_BLOCK_SIZE);
+        if (chunk > size) chunk = size;
+        
+        if (!storage_write(block_id, offset, zeros, chunk)) return false;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+static uint64_t bit_range_mask(uint32_t first_bit, uint32_t count) {
+    uint64_t bits = (count >= 64) ? ~0ULL : ((1ULL << count) - 1);
+    return bits << first_bit;
+}
+
+// Finds the first free block at or after the next-fit hint, wrapping once.
+// Each probe tests 64 blocks with a single find-first-zero.
+static uint32_t find_free_block(void) {
+    if (fs->free_block_count == 0) return 0;
+    
+    uint32_t first_word = fs->next_fit_hint / 64;
+    for (uint32_t scanned = 0; scanned <= FS_BITMAP_WORDS; scanned++) {
+        uint32_t word = (first_word + scanned) % FS_BITMAP_WORDS;
+        uint64_t free_bits = ~fs->block_bitmap[word];
+        
+        if (scanned == 0) {
+            free_bits &= ~0ULL << (fs->next_fit_hint % 64);
+        }
+        
+        if (free_bits != 0) {
+            uint32_t block = word * 64 + (uint32_t)__builtin_ctzll(free_bits);
+            if (block < FS_MAX_BLOCKS) return block;
+        }
+    }
+    return 0;
+}
+
+// Claims up to max_count free blocks starting exactly at start, a word's
+// worth at a time, and zeroes them.
+static uint32_t claim_blocks(uint32_t start, uint32_t max_count) {
+    uint32_t count = 0;
+    
+    while (count < max_count && start + count < FS_MAX_BLOCKS) {
+        uint32_t block = start + count;
+        uint32_t bit = block % 64;
+        uint64_t used = fs->block_bitmap[block / 64] >> bit;
+        uint32_t run = used ? (uint32_t)__builtin_ctzll(used) : 64 - bit;
+        
+        if (run == 0) break;
+        if (run > max_count - count) run = max_count - count;
+        if (run > FS_MAX_BLOCKS - block) run = FS_MAX_BLOCKS - block;
+        
+        fs->block_bitmap[block / 64] |= bit_range_mask(bit, run);
+        fs->bitmap_dirty = true;
+        count += run;
+        
+        if (bit + run < 64) break;
+    }
+    
+    if (count > 0) {
+        fs->free_block_count -= count;
+        fs->next_fit_hint = (start + count) % FS_MAX_BLOCKS;
+        storage_zero(start, 0, count * FS_BLOCK_SIZE);
+    }
+    return count;
+}
+
+static uint32_t allocate_block(void) {
+    uint32_t block = find_free_block();
+    if (block == 0) return 0;
+    
+    claim_blocks(block, 1);
+    return block;
+}
+
+static void free_block_run(uint32_t start, uint32_t count) {
+    while (count > 0 && start < FS_MAX_BLOCKS) {
+        uint32_t bit = start % 64;
+        uint32_t run = 64 - bit;
+        if (run > count) run = count;
+        
+        uint64_t mask = bit_range_mask(bit, run);
+        if (start / 64 == 0) mask &= ~1ULL;  // Block 0 is reserved
+        
+        fs->free_block_count += __builtin_popcountll(fs->block_bitmap[start / 64] & mask);
+        fs->block_bitmap[start / 64] &= ~mask;
+        fs->bitmap_dirty = true;
+        
+        start += run;
+        count -= run;
+    }
+}
+
+// Drops one owner from each block; a block still shared with another file
+// stays allocated.
+static void free_blocks(uint32_t start, uint32_t count) {
+    if (fs->shared_references == 0) {
+        free_block_run(start, count);
+        return;
+    }
+    
+    uint32_t run_start = start;
+    for (uint32_t block = start; block < start + count && block < FS_MAX_BLOCKS; block++) {
+        if (fs->block_shares[block] == 0) continue;
+        
+        free_block_run(run_start, block - run_start);
+        fs->block_shares[block]--;
+        fs->shared_references--;
+        run_start = block + 1;
+    }
+    if (run_start < start + count) {
+        free_block_run(run_start, start + count - run_start);
+    }
+}
+
+static fs_extent_t get_extent(fs_inode_t* file, uint32_t index) {
+    if (index < FS_INLINE_EXTENTS) {
+        return file->extents[index];
+    }
+    
+    fs_extent_t extent = {0, 0};
+    storage_read(file->indirect_block, (index - FS_INLINE_EXTENTS) * sizeof(fs_extent_t),
+                 &extent, sizeof(extent));
+    return extent;
+}
+
+static void set_extent(fs_inode_t* file, uint32_t index, fs_extent_t extent) {
+    if (index < FS_INLINE_EXTENTS) {
+        file->extents[index] = extent;
+        return;
+    }
+    
+    storage_write(file->indirect_block, (index - FS_INLINE_EXTENTS) * sizeof(fs_extent_t),
+                  &extent, sizeof(extent));
+}
+
+static uint32_t file_block_count(fs_inode_t* file) {
+    uint32_t blocks = 0;
+    for (uint32_t i = 0; i < file->extent_count; i++) {
+        blocks += get_extent(file, i).block_count;
+    }
+    return blocks;
+}
+
+// Maps a byte offset to its block and the number of blocks left in the
+// same extent from there.
+static bool map_file_offset(fs_inode_t* file, uint32_t offset,
+                            uint32_t* block_id, uint32_t* run_blocks) {
+    uint32_t logical = offset / FS_BLOCK_SIZE;
+    
+    for (uint32_t i = 0; i < file->extent_count; i++) {
+        fs_extent_t extent = get_extent(file, i);
+        if (logical < extent.block_count) {
+            *block_id = extent.start_block + logical;
+            *run_blocks = extent.block_count - logical;
+            return true;
+        }
+        logical -= extent.block_count;
+    }
+    return false;
+}
+
+// Loads file blocks [first, first + count) into the buffer cache, one device
+// request per contiguous run.
+static void prefetch_file_blocks(fs_inode_t* file, uint32_t first, uint32_t count) {
+    while (count > 0) {
+        uint32_t block_id, run_blocks;
+        if (!map_file_offset(file, first * FS_BLOCK_SIZE, &block_id, &run_blocks)) return;
+        if (run_blocks > count) run_blocks = count;
+        
+        buffer_cache_prefetch(fs->device, FS_DATA_LBA + block_id, run_blocks);
+        first += run_blocks;
+        count -= run_blocks;
+    }
+}
+
+static void flush_file_blocks(fs_inode_t* file, uint32_t first, uint32_t count) {
+    while (count > 0) {
+        uint32_t block_id, run_blocks;
+        if (!map_file_offset(file, first * FS_BLOCK_SIZE, &block_id, &run_blocks)) return;
+        if (run_blocks > count) run_blocks = count;
+        
+        buffer_cache_flush_range(fs->device, FS_DATA_LBA + block_id, run_blocks);
+        first += run_blocks;
+        count -= run_blocks;
+    }
+}
+
+static bool add_extent(fs_inode_t* file, uint32_t start, uint32_t count) {
+    if (file->extent_count >= FS_MAX_EXTENTS) return false;
+    
+    if (file->extent_count == FS_INLINE_EXTENTS && file->indirect_block == 0) {
+        file->indirect_block = allocate_block();
+        if (file->indirect_block == 0) return false;
+    }
+    
+    fs_extent_t extent = {start, count};
+    set_extent(file, file->extent_count, extent);
+    file->extent_count++;
+    return true;
+}
+
+static bool insert_extent(fs_inode_t* file, uint32_t index, fs_extent_t extent) {
+    if (!add_extent(file, 0, 0)) return false;
+    
+    for (uint32_t i = file->extent_count - 1; i > index; i--) {
+        set_extent(file, i, get_extent(file, i - 1));
+    }
+    set_extent(file, index, extent);
+    return true;
+}
+
+static void remove_extent(fs_inode_t* file, uint32_t index) {
+    for (uint32_t i = index; i + 1 < file->extent_count; i++) {
+        set_extent(file, i, get_extent(file, i + 1));
+    }
+    file->extent_count--;
+}
+
+// Grows a file by count blocks, extending its last extent in place where
+// the following blocks are free. Returns how many blocks were added.
+static uint32_t append_blocks(fs_inode_t* file, uint32_t count) {
+    uint32_t added = 0;
+    
+    while (added < count) {
+        if (file->extent_count > 0) {
+            fs_extent_t last = get_extent(file, file->extent_count - 1);
+            uint32_t grown = claim_blocks(last.start_block + last.block_count, count - added);
+            if (grown > 0) {
+                last.block_count += grown;
+                set_extent(file, file->extent_count - 1, last);
+                added += grown;
+                continue;
+            }
+        }
+        
+        uint32_t start = find_free_block();
+        if (start == 0) break;
+        
+        uint32_t claimed = claim_blocks(start, count - added);
+        if (!add_extent(file, start, claimed)) {
+            free_blocks(start, claimed);
+            break;
+        }
+        added += claimed;
+    }
+    
+    return added;
+}
+
+// Releases every block past the first keep_blocks of the file.
+static void release_blocks_from(fs_inode_t* file, uint32_t keep_blocks) {
+    if (file->is_inline) return;
+    
+    uint32_t kept_extents = 0;
+    
+    for (uint32_t i = 0; i < file->extent_count; i++) {
+        fs_extent_t extent = get_extent(file, i);
+        
+        if (keep_blocks >= extent.block_count) {
+            keep_blocks -= extent.block_count;
+            kept_extents++;
+        } else {
+            free_blocks(extent.start_block + keep_blocks, extent.block_count - keep_blocks);
+            extent.block_count = keep_blocks;
+            set_extent(file, i, extent);
+            if (keep_blocks > 0) kept_extents++;
+            keep_blocks = 0;
+        }
+    }
+    
+    file->extent_count = kept_extents;
+    
+    if (kept_extents <= FS_INLINE_EXTENTS && file->indirect_block != 0) {
+        free_blocks(file->indirect_block, 1);
+        file->indirect_block = 0;
+    }
+}
+
+static uint32_t read_file_data(fs_inode_t* file, uint32_t position, void* buffer, uint32_t size) {
+    if (position >= file->size) return 0;
+    if (size > file->size - position) size = file->size - position;
+    
+    if (file->backing_data) {
+        memory_copy(buffer, file->backing_data + position, size);
+        return size;
+    }
+    
+    if (file->is_inline) {
+        memory_copy(buffer, file->inline_data + position, size);
+        return size;
+    }
+    
+    uint8_t* dest = (uint8_t*)buffer;
+    uint32_t done = 0;
+    
+    while (done < size) {
+        uint32_t block_id, run_blocks;
+        if (!map_file_offset(file, position + done, &block_id, &run_blocks)) break;
+        
+        uint32_t block_offset = (position + done) % FS_BLOCK_SIZE;
+        uint32_t chunk = run_blocks * FS_BLOCK_SIZE - block_offset;
+        if (chunk > size - done) chunk = size - done;
+        
+        if (!storage_read(block_id, block_offset, dest + done, chunk)) break;
+        done += chunk;
+    }
+    
+    return done;
+}
+
+// Replaces a whole extent with a private copy in one new run of blocks, for
+// when the extent map has no room to split it.
+static bool unshare_extent(fs_inode_t* file, uint32_t index, fs_extent_t extent) {
+    uint32_t start = find_free_block();
+    if (start == 0) return false;
+    
+    uint32_t claimed = claim_blocks(start, extent.block_count);
+    if (claimed < extent.block_count) {
+        free_blocks(start, claimed);
+        return false;
+    }
+    
+    uint8_t data[FS_BLOCK_SIZE];
+    for (uint32_t b = 0; b < extent.block_count; b++) {
+        if (!storage_read(extent.start_block + b, 0, data, FS_BLOCK_SIZE) ||
+            !storage_write(start + b, 0, data, FS_BLOCK_SIZE)) {
+            free_blocks(start, claimed);
+            return false;
+        }
+    }
+    
+    set_extent(file, index, (fs_extent_t){start, extent.block_count});
+    free_blocks(extent.start_block, extent.block_count);
+    return true;
+}
+
+// Gives the file its own copy of the shared block at logical block index
+// logical, splitting the extent that held it. The copy joins the previous
+// extent when it lands right after it, so rewriting a shared file from the
+// front keeps it to a few extents.
+static bool unshare_block(fs_inode_t* file, uint32_t logical) {
+    uint32_t index = 0;
+    fs_extent_t extent = {0, 0};
+    for (; index < file->extent_count; index++) {
+        extent = get_extent(file, index);
+        if (logical < extent.block_count) break;
+        logical -= extent.block_count;
+    }
+    if (index == file->extent_count) return false;
+    
+    // A split can add two extents.
+    if (file->extent_count + 2 > FS_MAX_EXTENTS) {
+        return unshare_extent(file, index, extent);
+    }
+    
+    uint32_t old_block = extent.start_block + logical;
+    uint32_t new_block = allocate_block();
+    if (new_block == 0) return false;
+    
+    uint8_t data[FS_BLOCK_SIZE];
+    if (!storage_read(old_block, 0, data, FS_BLOCK_SIZE) ||
+        !storage_write(new_block, 0, data, FS_BLOCK_SIZE)) {
+        free_blocks(new_block, 1);
+        return false;
+    }
+    
+    fs_extent_t pieces[3];
+    uint32_t piece_count = 0;
+    
+    if (logical > 0) {
+        pieces[piece_count++] = (fs_extent_t){extent.start_block, logical};
+    }
+    
+    fs_extent_t previous = (index > 0) ? get_extent(file, index - 1) : (fs_extent_t){0, 0};
+    bool joins_previous = logical == 0 && index > 0 &&
+                          previous.start_block + previous.block_count == new_block;
+    if (!joins_previous) {
+        pieces[piece_count++] = (fs_extent_t){new_block, 1};
+    }
+    
+    if (logical + 1 < extent.block_count) {
+        pieces[piece_count++] = (fs_extent_t){old_block + 1, extent.block_count - logical - 1};
+    }
+    
+    // Make room first so a full extent map fails before anything changes.
+    for (uint32_t i = 1; i < piece_count; i++) {
+        if (!insert_extent(file, index + i, pieces[i])) {
+            while (--i > 0) remove_extent(file, index + 1);
+            free_blocks(new_block, 1);
+            return false;
+        }
+    }
+    
+    if (joins_previous) {
+        previous.block_count++;
+        set_extent(file, index - 1, previous);
+    }
+    if (piece_count > 0) {
+        set_extent(file, index, pieces[0]);
+    } else {
+        remove_extent(file, index);
+    }
+    
+    free_blocks(old_block, 1);
+    return true;
+}
+
+// Copies on write: makes every shared block under [position, position +
+// size) private to the file. Returns how much of the range is safe to
+// write, which falls short only when blocks or extents run out.
+static uint32_t unshare_blocks(fs_inode_t* file, uint32_t position, uint32_t size) {
+    if (fs->shared_references == 0 || size == 0) return size;
+    
+    uint32_t logical = position / FS_BLOCK_SIZE;
+    uint32_t end = (position + size - 1) / FS_BLOCK_SIZE + 1;
+    
+    while (logical < end) {
+        uint32_t block_id, run_blocks;
+        if (!map_file_offset(file, logical * FS_BLOCK_SIZE, &block_id, &run_blocks)) break;
+        if (run_blocks > end - logical) run_blocks = end - logical;
+        
+        uint32_t i = 0;
+        while (i < run_blocks && fs->block_shares[block_id + i] == 0) i++;
+        logical += i;
+        if (i == run_blocks) continue;
+        
+        if (!unshare_block(file, logical)) {
+            uint32_t safe = logical * FS_BLOCK_SIZE;
+            return (safe > position) ? safe - position : 0;
+        }
+        logical++;
+    }
+    return size;
+}
+
+// Moves an inline file's bytes out to a data block so it can grow. The
+// file is left inline if no block is free.
+static bool promote_inline_data(fs_inode_t* file) {
+    uint8_t data[FS_INLINE_DATA_SIZE];
+    memory_copy(data, file->inline_data, FS_INLINE_DATA_SIZE);
+    
+    file->is_inline = false;
+    file->extent_count = 0;
+    file->indirect_block = 0;
+    if (file->size == 0) return true;
+    
+    if (append_blocks(file, 1) != 1) {
+        memory_copy(file->inline_data, data, FS_INLINE_DATA_SIZE);
+        file->is_inline = true;
+        return false;
+    }
+    return storage_write(file->extents[0].start_block, 0, data, file->size);
+}
+
+// Brings a file of at most FS_INLINE_DATA_SIZE bytes back into its inode,
+// freeing its blocks.
+static void demote_to_inline(fs_inode_t* file) {
+    uint8_t data[FS_INLINE_DATA_SIZE];
+    memory_set(data, 0, FS_INLINE_DATA_SIZE);
+    read_file_data(file, 0, data, file->size);
+    
+    release_blocks_from(file, 0);
+    file->is_inline = true;
+    memory_copy(file->inline_data, data, FS_INLINE_DATA_SIZE);
+}
+
+// Makes sure storage backs [position, position + size) and returns how much
+// of that range can actually be written.
+static uint32_t reserve_file_data(fs_inode_t* file, uint32_t position, uint32_t size) {
+    if (position >= FS_MAX_FILE_SIZE) return 0;
+    if (size > FS_MAX_FILE_SIZE - position) size = FS_MAX_FILE_SIZE - position;
+    if (size == 0) return 0;
+    
+    if (file->is_inline) {
+        if (position + size <= FS_INLINE_DATA_SIZE) return size;
+        if (!promote_inline_data(file)) return 0;
+    }
+    
+    uint32_t needed = (position + size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    uint32_t have = file_block_count(file);
+    if (needed > have) {
+        have += append_blocks(file, needed - have);
+        if (have * FS_BLOCK_SIZE <= position) return 0;
+        if (position + size > have * FS_BLOCK_SIZE) size = have * FS_BLOCK_SIZE - position;
+    }
+    
+    return unshare_blocks(file, position, size);
+}
+
+// Copies into blocks already reserved; size and mtime are left to the caller.
+static uint32_t copy_file_data(fs_inode_t* file, uint32_t position,
+                               const void* buffer, uint32_t size) {
+    if (file->is_inline) {
+        memory_copy(file->inline_data + position, buffer, size);
+        return size;
+    }
+    
+    const uint8_t* src = (const uint8_t*)buffer;
+    uint32_t done = 0;
+    
+    while (done < size) {
+        uint32_t block_id, run_blocks;
+        if (!map_file_offset(file, position + done, &block_id, &run_blocks)) break;
+        
+        uint32_t block_offset = (position + done) % FS_BLOCK_SIZE;
+        uint32_t chunk = run_blocks * FS_BLOCK_SIZE - block_offset;
+        if (chunk > size - done) chunk = size - done;
+        
+        if (!storage_write(block_id, block_offset, src + done, chunk)) break;
+        done += chunk;
+    }
+    
+    return done;
+}
+
+static void finish_file_write(fs_inode_t* file, uint32_t end) {
+    if (end > file->size) {
+        file->size = end;
+    }
+    file->modified_time = get_current_time();
+}
+
+static uint32_t write_file_data(fs_inode_t* file, uint32_t position,
+                                const void* buffer, uint32_t size) {
+    size = reserve_file_data(file, position, size);
+    if (size == 0) return 0;
+    
+    uint32_t done = copy_file_data(file, position, buffer, size);
+    finish_file_write(file, position + done);
+    
+    return done;
+}
+
+// Sequential readers keep a window of blocks cached past the request. The
+// window doubles on every sequential read up to FS_READAHEAD_MAX_BLOCKS and
+// is topped up once less than half of it remains ahead, so each refill is a
+// large request. A seek drops the window; the request's own blocks are
+// still fetched as one batch.
+static void read_ahead(fs_file_handle_t* handle, fs_inode_t* file, uint32_t position, uint32_t size) {
+    if (position >= file->size || size == 0 || file->backing_data || file->is_inline) return;
+    if (size > file->size - position) size = file->size - position;
+    
+    if (position == handle->next_read_position) {
+        handle->readahead_blocks = (handle->readahead_blocks == 0) ? FS_READAHEAD_MIN_BLOCKS
+                                                                    : handle->readahead_blocks * 2;
+        if (handle->readahead_blocks > FS_READAHEAD_MAX_BLOCKS) {
+            handle->readahead_blocks = FS_READAHEAD_MAX_BLOCKS;
+        }
+    } else {
+        handle->readahead_blocks = 0;
+        handle->readahead_limit = 0;
+    }
+    
+    uint32_t first = position / FS_BLOCK_SIZE;
+    uint32_t end = (position + size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    if (end + handle->readahead_blocks / 2 <= handle->readahead_limit) return;
+    
+    uint32_t window_end = end + handle->readahead_blocks;
+    uint32_t file_blocks = (file->size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    if (window_end > file_blocks) window_end = file_blocks;
+    
+    uint32_t start = (handle->readahead_limit > first) ? handle->readahead_limit : first;
+    if (start < window_end) {
+        prefetch_file_blocks(file, start, window_end - start);
+    }
+    handle->readahead_limit = window_end;
+}
+
+// Sequential writers push completed blocks to the device every
+// FS_WRITE_BEHIND_BLOCKS rather than leaving them to trickle out one
+// eviction at a time. The partly written last block stays cached.
+static void write_behind(fs_file_handle_t* handle, fs_inode_t* file, uint32_t start, uint32_t end) {
+    if (file->is_inline) return;
+    
+    if (start != handle->next_write_position) {
+        handle->write_behind_start = start - (start % FS_BLOCK_SIZE);
+    }
+    handle->next_write_position = end;
+    
+    uint32_t first = handle->write_behind_start / FS_BLOCK_SIZE;
+    uint32_t complete = end / FS_BLOCK_SIZE;
+    if (complete < first + FS_WRITE_BEHIND_BLOCKS) return;
+    
+    flush_file_blocks(file, first, complete - first);
+    handle->write_behind_start = complete * FS_BLOCK_SIZE;
+}
+
+static fs_inode_chunk_t* inode_chunk(uint32_t file_id) {
+    return fs->inode_chunks[file_id / FS_INODES_PER_CHUNK];
+}
+
+static fs_inode_t* inode(uint32_t file_id) {
+    return &inode_chunk(file_id)->inodes[file_id % FS_INODES_PER_CHUNK];
+}
+
+static bool inode_is_valid(uint32_t file_id) {
+    uint32_t index = file_id % FS_INODES_PER_CHUNK;
+    return (inode_chunk(file_id)->valid_bits[index / 64] >> (index % 64)) & 1;
+}
+
+static void set_inode_valid(uint32_t file_id, bool valid) {
+    uint32_t index = file_id % FS_INODES_PER_CHUNK;
+    uint64_t* word = &inode_chunk(file_id)->valid_bits[index / 64];
+    
+    if (valid) {
+        *word |= 1ULL << (index % 64);
+    } else {
+        *word &= ~(1ULL << (index % 64));
+    }
+}
+
+static void mark_inode_dirty(uint32_t file_id) {
+    uint32_t index = file_id % FS_INODES_PER_CHUNK;
+    inode_chunk(file_id)->dirty_bits[index / 64] |= 1ULL << (index % 64);
+    fs->metadata_dirty = true;
+}
+
+static uint32_t* inode_parent(uint32_t file_id) {
+    return &inode_chunk(file_id)->parent_ids[file_id % FS_INODES_PER_CHUNK];
+}
+
+static uint32_t* inode_name_hash(uint32_t file_id) {
+    return &inode_chunk(file_id)->name_hashes[file_id % FS_INODES_PER_CHUNK];
+}
+
+static uint32_t* inode_next_id(uint32_t file_id) {
+    return &inode_chunk(file_id)->next_ids[file_id % FS_INODES_PER_CHUNK];
+}
+
+static fs_directory_index_t** inode_directory_index(uint32_t file_id) {
+    return &inode_chunk(file_id)->directory_indexes[file_id % FS_INODES_PER_CHUNK];
+}
+
+static bool grow_inode_table(void) {
+    if (fs->inode_chunk_count >= FS_MAX_INODE_CHUNKS) return false;
+    
+    fs_inode_chunk_t* chunk = apollo_allocate_memory(sizeof(fs_inode_chunk_t));
+    if (!chunk) return false;
+    
+    memory_set(chunk, 0, sizeof(fs_inode_chunk_t));
+    
+    // Whatever the disk held in these slots is stale until written over.
+    for (uint32_t i = 0; i < FS_INODES_PER_CHUNK / 64; i++) {
+        chunk->dirty_bits[i] = ~0ULL;
+    }
+    fs->metadata_dirty = true;
+    
+    uint32_t base = fs->inode_chunk_count * FS_INODES_PER_CHUNK;
+    fs->inode_chunks[fs->inode_chunk_count++] = chunk;
+    
+    // Pushed in reverse so the lowest new id is handed out first. Inode 0 is
+    // never used and inode 1 is the root.
+    for (uint32_t i = FS_INODES_PER_CHUNK; i > 0; i--) {
+        uint32_t file_id = base + i - 1;
+        if (file_id < 2) continue;
+        
+        chunk->next_ids[i - 1] = fs->free_inode_head;
+        fs->free_inode_head = file_id;
+    }
+    return true;
+}
+
+static uint32_t allocate_file_id(void) {
+    if (fs->free_inode_head == 0 && !grow_inode_table()) {
+        return 0;
+    }
+    
+    uint32_t file_id = fs->free_inode_head;
+    fs->free_inode_head = *inode_next_id(file_id);
+    *inode_next_id(file_id) = 0;
+    return file_id;
+}
+
+static void release_file_id(uint32_t file_id) {
+    set_inode_valid(file_id, false);
+    mark_inode_dirty(file_id);
+    *inode_next_id(file_id) = fs->free_inode_head;
+    fs->free_inode_head = file_id;
+}
+
+static void extract_filename(const char* path, char* filename) {
+    const char* last_slash = path;
+    const char* current = path;
+    
+    while (*current) {
+        if (*current == '/') {
+            last_slash = current + 1;
+        }
+        current++;
+    }
+    
+    string_copy(filename, last_slash);
+}
+
+static void extract_directory(const char* path, char* directory) {
+    const char* last_slash = NULL;
+    const char* current = path;
+    
+    while (*current) {
+        if (*current == '/') {
+            last_slash = current;
+        }
+        current++;
+    }
+    
+    if (last_slash) {
+        uint32_t len = last_slash - path;
+        for (uint32_t i = 0; i < len && i < FS_MAX_PATH_LENGTH - 1; i++) {
+            directory[i] = path[i];
+        }
+        directory[len] = '\0';
+        if (len == 0) {
+            string_copy(directory, "/");
+        }
+    } else {
+        string_copy(directory, "/");
+    }
+}
+
+static uint32_t hash_name(const char* name) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static fs_directory_index_t* allocate_directory_index(uint32_t bucket_count) {
+    uint32_t bytes = sizeof(fs_directory_index_t) + bucket_count * sizeof(uint32_t);
+    fs_directory_index_t* index = apollo_allocate_memory(bytes);
+    if (!index) return NULL;
+    
+    memory_set(index, 0, bytes);
+    index->bucket_count = bucket_count;
+    return index;
+}
+
+static void directory_index_grow(uint32_t dir_id) {
+    fs_directory_index_t* old_index = *inode_directory_index(dir_id);
+    fs_directory_index_t* new_index = allocate_directory_index(old_index->bucket_count * 2);
+    if (!new_index) return;  // Keep the longer chains
+    
+    for (uint32_t bucket = 0; bucket < old_index->bucket_count; bucket++) {
+        uint32_t file_id = old_index->buckets[bucket];
+        while (file_id != 0) {
+            uint32_t next = *inode_next_id(file_id);
+            uint32_t* head = &new_index->buckets[*inode_name_hash(file_id) & (new_index->bucket_count - 1)];
+            *inode_next_id(file_id) = *head;
+            *head = file_id;
+            file_id = next;
+        }
+    }
+    
+    new_index->entry_count = old_index->entry_count;
+    *inode_directory_index(dir_id) = new_index;
+    apollo_free_memory(old_index);
+}
+
+static void directory_index_insert(uint32_t dir_id, uint32_t file_id) {
+    fs_directory_index_t* index = *inode_directory_index(dir_id);
+    if (index->entry_count >= index->bucket_count * FS_DIRECTORY_MAX_LOAD) {
+        directory_index_grow(dir_id);
+        index = *inode_directory_index(dir_id);
+    }
+    
+    uint32_t hash = hash_name(inode(file_id)->name);
+    uint32_t* bucket = &index->buckets[hash & (index->bucket_count - 1)];
+    
+    *inode_name_hash(file_id) = hash;
+    *inode_next_id(file_id) = *bucket;
+    *bucket = file_id;
+    index->entry_count++;
+}
+
+static void directory_index_remove(uint32_t dir_id, uint32_t file_id) {
+    fs_directory_index_t* index = *inode_directory_index(dir_id);
+    uint32_t* link = &index->buckets[*inode_name_hash(file_id) & (index->bucket_count - 1)];
+    
+    while (*link != 0) {
+        if (*link == file_id) {
+            *link = *inode_next_id(file_id);
+            *inode_next_id(file_id) = 0;
+            index->entry_count--;
+            return;
+        }
+        link = inode_next_id(*link);
+    }
+}
+
+static bool directory_is_empty(uint32_t dir_id) {
+    return (*inode_directory_index(dir_id))->entry_count == 0;
+}
+
+static uint32_t find_file_in_directory(uint32_t dir_id, const char* name) {
+    fs_directory_index_t* index = *inode_directory_index(dir_id);
+    if (!index) return 0;
+    
+    uint32_t hash = hash_name(name);
+    uint32_t file_id = index->buckets[hash & (index->bucket_count - 1)];
+    
+    while (file_id != 0) {
+        if (*inode_name_hash(file_id) == hash &&
+            string_compare(inode(file_id)->name, name) == 0) {
+            return file_id;
+        }
+        file_id = *inode_next_id(file_id);
+    }
+    return 0;
+}
+
+static bool initialize_inode(uint32_t file_id, const char* name, fs_file_type_t type,
+                             uint8_t permissions, uint32_t parent_id) {
+    if (type == FS_TYPE_DIRECTORY) {
+        fs_directory_index_t* index = allocate_directory_index(FS_DIRECTORY_HASH_BUCKETS);
+        if (!index) return false;
+        
+        *inode_directory_index(file_id) = index;
+        fs->directory_count++;
+    } else {
+        fs->file_count++;
+    }
+    
+    set_inode_valid(file_id, true);
+    *inode_parent(file_id) = parent_id;
+    
+    fs_inode_t* file = inode(file_id);
+    string_copy(file->name, name);
+    file->type = type;
+    file->size = 0;
+    file->created_time = get_current_time();
+    file->modified_time = file->created_time;
+    file->permissions = permissions;
+    file->is_inline = (type == FS_TYPE_FILE);
+    memory_set(file->inline_data, 0, FS_INLINE_DATA_SIZE);
+    file->read_only = false;
+    file->backing_data = NULL;
+    file->tree_bytes = 0;
+    file->tree_nodes = 0;
+    mark_inode_dirty(file_id);
+    return true;
+}
+
+// Carries a change below file_id up to every directory above it. The root
+// is its own parent, so the climb ends there.
+static void add_to_ancestors(uint32_t file_id, int64_t bytes, int32_t nodes) {
+    while (file_id != 1) {
+        file_id = *inode_parent(file_id);
+        
+        fs_inode_t* directory = inode(file_id);
+        directory->tree_bytes += (uint32_t)bytes;
+        directory->tree_nodes += (uint32_t)nodes;
+    }
+}
+
+static uint32_t dentry_slot(uint32_t parent_id, uint32_t name_hash) {
+    return (name_hash ^ (parent_id * FNV_PRIME)) & (FS_DENTRY_CACHE_SIZE - 1);
+}
+
+static void dentry_invalidate_all(void) {
+    fs->dentry_generation++;
+}
+
+static uint32_t lookup_component(uint32_t dir_id, const char* name) {
+    uint32_t hash = hash_name(name);
+    fs_dentry_t* dentry = &fs->dentry_cache[dentry_slot(dir_id, hash)];
+    
+    if (dentry->generation == fs->dentry_generation &&
+        dentry->parent_id == dir_id && dentry->name_hash == hash &&
+        string_compare(inode(dentry->file_id)->name, name) == 0) {
+        fs->dentry_hits++;
+        return dentry->file_id;
+    }
+    
+    fs->dentry_misses++;
+    
+    uint32_t file_id = find_file_in_directory(dir_id, name);
+    if (file_id != 0) {
+        dentry->parent_id = dir_id;
+        dentry->name_hash = hash;
+        dentry->file_id = file_id;
+        dentry->generation = fs->dentry_generation;
+    }
+    return file_id;
+}
+
+// Paths arrive from the VFS absolute within this mount and already
+// normalized, so they contain no "." or ".." components.
+static uint32_t resolve_path_to_id(const char* path) {
+    uint32_t current_id = 1;
+    char component[FS_MAX_FILENAME_LENGTH];
+    uint32_t comp_pos = 0;
+    
+    for (;; path++) {
+        if (*path == '/' || *path == '\0') {
+            if (comp_pos > 0) {
+                component[comp_pos] = '\0';
+                current_id = lookup_component(current_id, component);
+                if (current_id == 0) return 0;
+                comp_pos = 0;
+            }
+            if (*path == '\0') break;
+        } else if (comp_pos < FS_MAX_FILENAME_LENGTH - 1) {
+            component[comp_pos++] = *path;
+        }
+    }
+    
+    return current_id;
+}
+
+static void reset_block_bitmap(void) {
+    for (uint32_t i = 0; i < FS_BITMAP_WORDS; i++) {
+        fs->block_bitmap[i] = 0;
+    }
+    
+    // Block 0 means "no block", and bits past FS_MAX_BLOCKS never exist.
+    fs->block_bitmap[0] = 1;
+    if (FS_MAX_BLOCKS % 64 != 0) {
+        fs->block_bitmap[FS_BITMAP_WORDS - 1] |= ~0ULL << (FS_MAX_BLOCKS % 64);
+    }
+    fs->free_block_count = FS_MAX_BLOCKS - 1;
+    fs->next_fit_hint = 1;
+    fs->bitmap_dirty = true;
+}
+
+static bool read_device_block(uint32_t lba, void* data, uint32_t offset, uint32_t size) {
+    buffer_t* buffer = buffer_cache_get(fs->device, lba);
+    if (!buffer) return false;
+    
+    memory_copy(data, buffer->data + offset, size);
+    buffer_cache_release(buffer);
+    return true;
+}
+
+// Metadata blocks are rebuilt whole from memory, so they never need reading
+// first. A block whose bytes did not change is left clean.
+static bool write_device_block(uint32_t lba, const void* data) {
+    buffer_t* buffer = buffer_cache_get_new(fs->device, lba);
+    if (!buffer) return false;
+    
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (uint32_t i = 0; i < FS_BLOCK_SIZE; i++) {
+        if (buffer->data[i] != bytes[i]) {
+            memory_copy(buffer->data, data, FS_BLOCK_SIZE);
+            buffer_cache_mark_dirty(buffer);
+            break;
+        }
+    }
+    
+    buffer_cache_release(buffer);
+    return true;
+}
+
+static void pack_inode(uint32_t file_id, fs_disk_inode_t* record) {
+    memory_set(record, 0, sizeof(fs_disk_inode_t));
+    if (file_id == 0 || !inode_is_valid(file_id) || inode(file_id)->read_only) return;
+    
+    fs_inode_t* file = inode(file_id);
+    string_copy(record->name, file->name);
+    record->parent_id = *inode_parent(file_id);
+    record->type = file->type;
+    record->size = file->size;
+    record->created_time = file->created_time;
+    record->modified_time = file->modified_time;
+    record->permissions = file->permissions;
+    record->flags = file->is_inline ? FS_DISK_INODE_INLINE : 0;
+    
+    // The extent map or the inline bytes, whichever the file holds.
+    memory_copy(record->inline_data, file->inline_data, FS_INLINE_DATA_SIZE);
+}
+
+static bool write_inode_table(void) {
+    fs_disk_inode_t records[FS_DISK_INODES_PER_BLOCK];
+    
+    for (uint32_t c = 0; c < fs->inode_chunk_count; c++) {
+        fs_inode_chunk_t* chunk = fs->inode_chunks[c];
+        
+        for (uint32_t word = 0; word < FS_INODES_PER_CHUNK / 64; word++) {
+            while (chunk->dirty_bits[word] != 0) {
+                uint32_t index = word * 64 + (uint32_t)__builtin_ctzll(chunk->dirty_bits[word]);
+                uint32_t first = index - (index % FS_DISK_INODES_PER_BLOCK);
+                uint32_t base_id = c * FS_INODES_PER_CHUNK + first;
+                
+                for (uint32_t i = 0; i < FS_DISK_INODES_PER_BLOCK; i++) {
+                    pack_inode(base_id + i, &records[i]);
+                }
+                
+                if (!write_device_block(FS_INODE_TABLE_LBA + base_id / FS_DISK_INODES_PER_BLOCK, records)) {
+                    return false;
+                }
+                
+                chunk->dirty_bits[word] &= ~bit_range_mask(first % 64, FS_DISK_INODES_PER_BLOCK);
+            }
+        }
+    }
+    return true;
+}
+
+static bool write_metadata(void) {
+    uint8_t block[FS_BLOCK_SIZE];
+    
+    memory_set(block, 0, FS_BLOCK_SIZE);
+    fs_superblock_t* superblock = (fs_superblock_t*)block;
+    superblock->magic = FS_SUPERBLOCK_MAGIC;
+    superblock->version = FS_DISK_VERSION;
+    superblock->block_size = FS_BLOCK_SIZE;
+    superblock->data_blocks = FS_MAX_BLOCKS;
+    superblock->max_inodes = FS_MAX_FILES;
+    superblock->inode_chunk_count = fs->inode_chunk_count;
+    superblock->system_time = fs->system_time;
+    if (!write_device_block(FS_SUPERBLOCK_LBA, block)) return false;
+    
+    if (fs->bitmap_dirty) {
+        const uint8_t* bitmap = (const uint8_t*)fs->block_bitmap;
+        for (uint32_t i = 0; i < FS_BITMAP_BLOCKS; i++) {
+            uint32_t offset = i * FS_BLOCK_SIZE;
+            uint32_t size = sizeof(fs->block_bitmap) - offset;
+            if (size > FS_BLOCK_SIZE) size = FS_BLOCK_SIZE;
+            
+            memory_set(block, 0, FS_BLOCK_SIZE);
+            memory_copy(block, bitmap + offset, size);
+            if (!write_device_block(FS_BITMAP_LBA + i, block)) return false;
+        }
+        fs->bitmap_dirty = false;
+    }
+    
+    if (!write_inode_table()) return false;
+    
+    fs->metadata_dirty = false;
+    return true;
+}
+
+// Extents and the indirect block must name data blocks in the arena;
+// block 0 means "no block".
+static bool extents_in_range(fs_inode_t* file) {
+    if (file->extent_count > FS_MAX_EXTENTS) return false;
+    if (file->extent_count > FS_INLINE_EXTENTS &&
+        (file->indirect_block == 0 || file->indirect_block >= FS_MAX_BLOCKS)) {
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < file->extent_count; i++) {
+        fs_extent_t extent = get_extent(file, i);
+        if (extent.start_block == 0 || extent.start_block >= FS_MAX_BLOCKS ||
+            extent.block_count > FS_MAX_BLOCKS - extent.start_block) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Nothing read back is trusted: a bad type, parent or block number fails
+// the mount instead of indexing past the tables.
+static bool restore_inode(uint32_t file_id, const fs_disk_inode_t* record) {
+    if (file_id == 0 || record->type == 0) return true;
+    
+    uint32_t inode_count = fs->inode_chunk_count * FS_INODES_PER_CHUNK;
+    if (record->type != FS_TYPE_FILE && record->type != FS_TYPE_DIRECTORY) return false;
+    if (record->parent_id >= inode_count) return false;
+    if (file_id == 1 && (record->type != FS_TYPE_DIRECTORY || record->parent_id != 1)) return false;
+    if (record->type == FS_TYPE_FILE && record->size > FS_MAX_FILE_SIZE) return false;
+    
+    char name[FS_MAX_FILENAME_LENGTH];
+    memory_copy(name, record->name, FS_MAX_FILENAME_LENGTH - 1);
+    name[FS_MAX_FILENAME_LENGTH - 1] = '\0';
+    
+    if (!initialize_inode(file_id, name, (fs_file_type_t)record->type,
+                          record->permissions, record->parent_id)) {
+        return false;
+    }
+    
+    fs_inode_t* file = inode(file_id);
+    file->size = record->size;
+    file->created_time = record->created_time;
+    file->modified_time = record->modified_time;
+    file->is_inline = record->type == FS_TYPE_FILE && (record->flags & FS_DISK_INODE_INLINE) &&
+                      record->size <= FS_INLINE_DATA_SIZE;
+    memory_copy(file->inline_data, record->inline_data, FS_INLINE_DATA_SIZE);
+    
+    return file->type != FS_TYPE_FILE || file->is_inline || extents_in_range(file);
+}
+
+static uint32_t first_child(uint32_t dir_id) {
+    fs_directory_index_t* index = *inode_directory_index(dir_id);
+    if (!index) return 0;
+    
+    for (uint32_t bucket = 0; bucket < index->bucket_count; bucket++) {
+        if (index->buckets[bucket] != 0) return index->buckets[bucket];
+    }
+    return 0;
+}
+
+// The entry after file_id in its directory's index, continuing from its
+// own chain to the following buckets.
+static uint32_t next_sibling(uint32_t file_id) {
+    if (*inode_next_id(file_id) != 0) return *inode_next_id(file_id);
+    
+    fs_directory_index_t* index = *inode_directory_index(*inode_parent(file_id));
+    uint32_t bucket = *inode_name_hash(file_id) & (index->bucket_count - 1);
+    
+    while (++bucket < index->bucket_count) {
+        if (index->buckets[bucket] != 0) return index->buckets[bucket];
+    }
+    return 0;
+}
+
+// Links every restored inode into its parent's index and threads the rest
+// of the table onto the free-list, lowest id first. Fails when a parent is
+// missing or is not a directory.
+static bool link_restored_inodes(void) {
+    uint32_t inode_count = fs->inode_chunk_count * FS_INODES_PER_CHUNK;
+    
+    fs->free_inode_head = 0;
+    for (uint32_t file_id = inode_count; file_id > 2; file_id--) {
+        uint32_t id = file_id - 1;
+        if (inode_is_valid(id)) {
+            uint32_t parent_id = *inode_parent(id);
+            if (!inode_is_valid(parent_id) || inode(parent_id)->type != FS_TYPE_DIRECTORY) {
+                return false;
+            }
+            directory_index_insert(parent_id, id);
+        } else {
+            *inode_next_id(id) = fs->free_inode_head;
+            fs->free_inode_head = id;
+        }
+    }
+    return true;
+}
+
+// Rebuilds the share counts: a block named by more than one extent is
+// shared by that many files.
+static void count_block_shares(void) {
+    uint32_t inode_count = fs->inode_chunk_count * FS_INODES_PER_CHUNK;
+    
+    for (uint32_t file_id = 2; file_id < inode_count; file_id++) {
+        if (!inode_is_valid(file_id)) continue;
+        
+        fs_inode_t* file = inode(file_id);
+        if (file->type != FS_TYPE_FILE || file->is_inline) continue;
+        
+        for (uint32_t i = 0; i < file->extent_count; i++) {
+            fs_extent_t extent = get_extent(file, i);
+            for (uint32_t b = 0; b < extent.block_count && extent.start_block + b < FS_MAX_BLOCKS; b++) {
+                fs->block_shares[extent.start_block + b]++;
+            }
+        }
+    }
+    
+    fs->shared_references = 0;
+    for (uint32_t block = 0; block < FS_MAX_BLOCKS; block++) {
+        if (fs->block_shares[block] > 0) {
+            fs->block_shares[block]--;
+            fs->shared_references += fs->block_shares[block];
+        }
+    }
+}
+
+// Rebuilds every directory's totals in one walk down from the root. A node
+// is folded into its parent once the walk leaves it, by which time all of
+// its own children have been folded into it. Fails when some node is not
+// below the root, which means its parent chain loops.
+static bool count_tree_totals(void) {
+    uint32_t current = first_child(1);
+    
+    while (current != 0) {
+        if (inode(current)->type == FS_TYPE_DIRECTORY && first_child(current) != 0) {
+            current = first_child(current);
+            continue;
+        }
+        
+        while (current != 0) {
+            fs_inode_t* node = inode(current);
+            fs_inode_t* parent = inode(*inode_parent(current));
+            parent->tree_bytes += node->tree_bytes + node->size;
+            parent->tree_nodes += node->tree_nodes + 1;
+            
+            if (next_sibling(current) != 0) {
+                current = next_sibling(current);
+                break;
+            }
+            current = *inode_parent(current);
+            if (current == 1) current = 0;
+        }
+    }
+    
+    return inode(1)->tree_nodes == fs->file_count + fs->directory_count - 1;
+}
+
+// Loads an existing filesystem from the device. found is left false only
+// when the disk was readable and holds no filesystem, which is the one case
+// where formatting it is safe; nothing has been allocated by then.
+static bool mount_device(bool* found) {
+    fs_superblock_t superblock;
+    *found = true;
+    
+    if (!read_device_block(FS_SUPERBLOCK_LBA, &superblock, 0, sizeof(superblock))) return false;
+    
+    if (superblock.magic != FS_SUPERBLOCK_MAGIC || superblock.version != FS_DISK_VERSION ||
+        superblock.block_size != FS_BLOCK_SIZE || superblock.data_blocks != FS_MAX_BLOCKS ||
+        superblock.max_inodes != FS_MAX_FILES || superblock.inode_chunk_count == 0 ||
+        superblock.inode_chunk_count > FS_MAX_INODE_CHUNKS) {
+        *found = false;
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < FS_BITMAP_BLOCKS; i++) {
+        uint32_t offset = i * FS_BLOCK_SIZE;
+        uint32_t size = sizeof(fs->block_bitmap) - offset;
+        if (size > FS_BLOCK_SIZE) size = FS_BLOCK_SIZE;
+        
+        if (!read_device_block(FS_BITMAP_LBA + i, (uint8_t*)fs->block_bitmap + offset, 0, size)) {
+            return false;
+        }
+    }
+    
+    uint32_t used_bits = 0;
+    for (uint32_t i = 0; i < FS_BITMAP_WORDS; i++) {
+        used_bits += __builtin_popcountll(fs->block_bitmap[i]);
+    }
+    fs->free_block_count = FS_BITMAP_WORDS * 64 - used_bits;
+    fs->next_fit_hint = 1;
+    
+    while (fs->inode_chunk_count < superblock.inode_chunk_count) {
+        if (!grow_inode_table()) return false;
+    }
+    
+    // First pass restores every inode; the second links each into its
+    // parent's index once all directory indexes exist.
+    fs_disk_inode_t records[FS_DISK_INODES_PER_BLOCK];
+    uint32_t inode_count = fs->inode_chunk_count * FS_INODES_PER_CHUNK;
+    
+    for (uint32_t base_id = 0; base_id < inode_count; base_id += FS_DISK_INODES_PER_BLOCK) {
+        if (!read_device_block(FS_INODE_TABLE_LBA + base_id / FS_DISK_INODES_PER_BLOCK,
+                               records, 0, sizeof(records))) {
+            return false;
+        }
+        
+        for (uint32_t i = 0; i < FS_DISK_INODES_PER_BLOCK; i++) {
+            if (!restore_inode(base_id + i, &records[i])) return false;
+        }
+    }
+    
+    if (!inode_is_valid(1)) return false;
+    
+    if (!link_restored_inodes()) return false;
+    count_block_shares();
+    if (!count_tree_totals()) return false;
+    
+    // Everything in memory now matches the disk.
+    for (uint32_t c = 0; c < fs->inode_chunk_count; c++) {
+        for (uint32_t i = 0; i < FS_INODES_PER_CHUNK / 64; i++) {
+            fs->inode_chunks[c]->dirty_bits[i] = 0;
+        }
+    }
+    fs->system_time = superblock.system_time;
+    fs->bitmap_dirty = false;
+    fs->metadata_dirty = false;
+    return true;
+}
+
+// Returns the linked-in root image if it is complete and matches this
+// layout, or NULL to fall back to an empty root.
+static const fs_image_header_t* find_root_image(void) {
+    uint32_t image_size = (uint32_t)(rootfs_image_end - rootfs_image_start);
+    if (image_size < sizeof(fs_image_header_t)) return NULL;
+    
+    const fs_image_header_t* header = (const fs_image_header_t*)rootfs_image_start;
+    if (header->magic != FS_IMAGE_MAGIC || header->version != FS_IMAGE_VERSION ||
+        header->block_size != FS_BLOCK_SIZE || header->inode_count < 2 ||
+        header->inode_count > FS_MAX_FILES || header->data_blocks >= FS_MAX_BLOCKS) {
+        return NULL;
+    }
+    
+    uint32_t payload = header->inode_count * sizeof(fs_disk_inode_t) +
+                       header->data_blocks * FS_BLOCK_SIZE;
+    if (image_size - sizeof(fs_image_header_t) < payload) return NULL;
+    
+    return header;
+}
+
+// Formats from the root image: the records become inodes at their own ids
+// and the data region is copied to data block 1 onward in one pass, so
+// nothing is created or looked up by path.
+static bool mount_image(const fs_image_header_t* header) {
+    const fs_disk_inode_t* records = (const fs_disk_inode_t*)(header + 1);
+    const uint8_t* data = (const uint8_t*)(records + header->inode_count);
+    
+    while (fs->inode_chunk_count * FS_INODES_PER_CHUNK < header->inode_count) {
+        if (!grow_inode_table()) return false;
+    }
+    
+    if (header->data_blocks > 0) {
+        if (claim_blocks(1, header->data_blocks) != header->data_blocks) return false;
+        if (!storage_write(1, 0, data, header->data_blocks * FS_BLOCK_SIZE)) return false;
+    }
+    
+    for (uint32_t file_id = 1; file_id < header->inode_count; file_id++) {
+        if (!restore_inode(file_id, &records[file_id])) return false;
+    }
+    
+    if (!inode_is_valid(1)) return false;
+    
+    if (!link_restored_inodes() || !count_tree_totals()) return false;
+    fs->system_time = header->system_time;
+    return true;
+}
+
+static void release_instance(apollofs_state_t* state) {
+    for (uint32_t c = 0; c < state->inode_chunk_count; c++) {
+        fs_inode_chunk_t* chunk = state->inode_chunks[c];
+        for (uint32_t i = 0; i < FS_INODES_PER_CHUNK; i++) {
+            if (chunk->directory_indexes[i]) {
+                apollo_free_memory(chunk->directory_indexes[i]);
+            }
+        }
+        apollo_free_memory(chunk);
+    }
+    
+    if (state->block_arena) {
+        apollo_free_memory(state->block_arena);
+    }
+    apollo_free_memory(state);
+}
+
+// Builds the instance in fs. A writable disk big enough for the layout
+// holds the filesystem; without one everything stays in a memory arena.
+static bool build_instance(const char* source, bool seed) {
+    // Cache entries start at generation 0, so starting the filesystem at 1
+    // leaves them all invalid.
+    fs->dentry_generation = 1;
+    
+    block_device_t* device = source ? block_device_find(source) : NULL;
+    if (device && !device->read_only && device->block_count >= FS_DISK_BLOCKS &&
+        device->block_size == FS_BLOCK_SIZE) {
+        buffer_cache_initialize();
+        fs->device = device;
+        
+        bool found;
+        if (mount_device(&found)) return true;
+        if (found) return false;
+    } else {
+        fs->block_arena = apollo_allocate_memory(FS_MAX_BLOCKS * FS_BLOCK_SIZE);
+        if (!fs->block_arena) return false;
+    }
+    
+    if (!grow_inode_table()) return false;
+    reset_block_bitmap();
+    
+    fs->system_time = 1000;
+    
+    const fs_image_header_t* image = seed ? find_root_image() : NULL;
+    if (image) {
+        return mount_image(image);
+    }
+    return initialize_inode(1, "/", FS_TYPE_DIRECTORY,
+                            FS_PERM_READ | FS_PERM_WRITE | FS_PERM_EXECUTE, 1);
+}
+
+static bool sync_instance(void) {
+    if (!fs->device) return true;
+    
+    buffer_cache_stats_t cache_stats;
+    buffer_cache_get_stats(&cache_stats);
+    if (!fs->metadata_dirty && cache_stats.dirty_buffers == 0) return true;
+    
+    if (fs->metadata_dirty && !write_metadata()) return false;
+    if (!buffer_cache_sync(fs->device)) return false;
+    
+    fs->sync_count++;
+    return block_device_flush(fs->device);
+}
+
+static bool mount_instance(vfs_superblock_t* superblock, const char* source, bool seed) {
+    apollofs_state_t* state = apollo_allocate_memory(sizeof(apollofs_state_t));
+    if (!state) return false;
+    
+    memory_set(state, 0, sizeof(apollofs_state_t));
+    fs = state;
+    
+    if (!build_instance(source, seed)) {
+        release_instance(state);
+        return false;
+    }
+    
+    superblock->private_data = state;
+    sync_instance();
+    return true;
+}
+
+static void use_superblock(vfs_superblock_t* superblock) {
+    fs = (apollofs_state_t*)superblock->private_data;
+}
+
+static void use_handle(fs_file_handle_t* handle) {
+    use_superblock(handle->superblock);
+}
+
+static bool apollofs_sync(vfs_superblock_t* superblock) {
+    use_superblock(superblock);
+    return sync_instance();
+}
+
+// Creates name inside an existing directory. A read-only tree only takes
+// attached nodes.
+static uint32_t create_child(uint32_t parent_id, const char* name, fs_file_type_t type,
+                             uint8_t permissions, bool attached) {
+    if (parent_id == 0 || inode(parent_id)->type != FS_TYPE_DIRECTORY) {
+        return 0;
+    }
+    
+    if (inode(parent_id)->read_only && !attached) {
+        return 0;
+    }
+    
+    if (find_file_in_directory(parent_id, name) != 0) {
+        return 0;
+    }
+    
+    uint32_t new_id = allocate_file_id();
+    if (new_id == 0) return 0;
+    
+    if (!initialize_inode(new_id, name, type, permissions, parent_id)) {
+        release_file_id(new_id);
+        return 0;
+    }
+    inode(new_id)->read_only = attached;
+    directory_index_insert(parent_id, new_id);
+    add_to_ancestors(new_id, 0, 1);
+    
+    return new_id;
+}
+
+static uint32_t create_node(const char* path, fs_file_type_t type, uint8_t permissions,
+                            bool attached) {
+    char parent_path[FS_MAX_PATH_LENGTH];
+    char name[FS_MAX_FILENAME_LENGTH];
+    
+    extract_directory(path, parent_path);
+    extract_filename(path, name);
+    if (string_length(name) == 0) return 0;
+    
+    return create_child(resolve_path_to_id(parent_path), name, type, permissions, attached);
+}
+
+static bool apollofs_create(vfs_superblock_t* superblock, const char* path, fs_file_type_t type) {
+    use_superblock(superblock);
+    
+    uint8_t permissions = FS_PERM_READ | FS_PERM_WRITE;
+    if (type == FS_TYPE_DIRECTORY) permissions |= FS_PERM_EXECUTE;
+    return create_node(path, type, permissions, false) != 0;
+}
+
+static bool apollofs_attach(vfs_superblock_t* superblock, const char* path, fs_file_type_t type,
+                            const void* data, uint32_t size, uint8_t permissions) {
+    use_superblock(superblock);
+    
+    uint32_t file_id = create_node(path, type, permissions & ~FS_PERM_WRITE, true);
+    if (file_id == 0) return false;
+    
+    fs_inode_t* file = inode(file_id);
+    file->is_inline = false;
+    file->backing_data = (const uint8_t*)data;
+    file->size = size;
+    add_to_ancestors(file_id, size, 0);
+    return true;
+}
+
+static bool remove_node(uint32_t file_id) {
+    if (file_id == 0 || file_id == 1 || inode(file_id)->read_only) return false;
+    
+    if (inode(file_id)->type == FS_TYPE_DIRECTORY && !directory_is_empty(file_id)) {
+        return false;
+    }
+    
+    if (inode(file_id)->type == FS_TYPE_FILE) {
+        release_blocks_from(inode(file_id), 0);
+    }
+    
+    fs_inode_t* file = inode(file_id);
+    add_to_ancestors(file_id, -(int64_t)file->size, -1);
+    directory_index_remove(*inode_parent(file_id), file_id);
+    
+    if (file->type == FS_TYPE_DIRECTORY) {
+        apollo_free_memory(*inode_directory_index(file_id));
+        *inode_directory_index(file_id) = NULL;
+        fs->directory_count--;
+    } else {
+        fs->file_count--;
+    }
+    
+    release_file_id(file_id);
+    dentry_invalidate_all();
+    
+    return true;
+}
+
+static bool apollofs_remove(vfs_superblock_t* superblock, const char* path) {
+    use_superblock(superblock);
+    return remove_node(resolve_path_to_id(path));
+}
+
+// Points copy at every block of source, taking a share of each. The copy
+// gets its own indirect block, since extent maps are never shared.
+static bool share_extents(fs_inode_t* source, fs_inode_t* copy) {
+    for (uint32_t i = 0; i < source->extent_count; i++) {
+        fs_extent_t extent = get_extent(source, i);
+        for (uint32_t b = 0; b < extent.block_count; b++) {
+            if (fs->block_shares[extent.start_block + b] == UINT16_MAX) return false;
+        }
+    }
+    
+    for (uint32_t i = 0; i < source->extent_count; i++) {
+        fs_extent_t extent = get_extent(source, i);
+        if (!add_extent(copy, extent.start_block, extent.block_count)) {
+            // Nothing is shared yet, so dropping the map frees nothing but
+            // the indirect block.
+            copy->extent_count = 0;
+            release_blocks_from(copy, 0);
+            return false;
+        }
+    }
+    
+    for (uint32_t i = 0; i < source->extent_count; i++) {
+        fs_extent_t extent = get_extent(source, i);
+        for (uint32_t b = 0; b < extent.block_count; b++) {
+            fs->block_shares[extent.start_block + b]++;
+        }
+        fs->shared_references += extent.block_count;
+    }
+    return true;
+}
+
+// Makes name in parent_id a copy of source_id that shares its blocks;
+// only a file attached from outside the filesystem is copied byte by byte.
+static uint32_t clone_file(uint32_t source_id, uint32_t parent_id, const char* name) {
+    fs_inode_t* source = inode(source_id);
+    uint8_t permissions = source->permissions;
+    if (source->read_only) permissions |= FS_PERM_WRITE;
+    
+    uint32_t copy_id = create_child(parent_id, name, FS_TYPE_FILE, permissions, false);
+    if (copy_id == 0) return 0;
+    
+    fs_inode_t* copy = inode(copy_id);
+    uint32_t before = copy->size;
+    bool copied;
+    
+    if (source->backing_data) {
+        copied = write_file_data(copy, 0, source->backing_data, source->size) == source->size;
+    } else if (source->is_inline) {
+        memory_copy(copy->inline_data, source->inline_data, FS_INLINE_DATA_SIZE);
+        copied = true;
+    } else {
+        copy->is_inline = false;
+        copied = share_extents(source, copy);
+    }
+    
+    // A byte-by-byte copy has already moved the size, perhaps only part of
+    // the way; the parents must see that before remove_node takes it back.
+    add_to_ancestors(copy_id, (int64_t)copy->size - before, 0);
+    
+    if (!copied) {
+        remove_node(copy_id);
+        return 0;
+    }
+    
+    add_to_ancestors(copy_id, (int64_t)source->size - copy->size, 0);
+    copy->size = source->size;
+    mark_inode_dirty(copy_id);
+    return copy_id;
+}
+
+static bool is_within(uint32_t file_id, uint32_t ancestor_id) {
+    while (file_id != ancestor_id) {
+        if (file_id == 1) return false;
+        file_id = *inode_parent(file_id);
+    }
+    return true;
+}
+
+// Copies everything below source_id into the empty directory copy_id. The
+// walk keeps no stack: it steps to siblings through the directory indexes
+// and climbs back out through parent ids, with copy_parent tracking the
+// copy of the current entry's directory.
+static bool clone_tree(uint32_t source_id, uint32_t copy_id) {
+    uint32_t current = first_child(source_id);
+    uint32_t copy_parent = copy_id;
+    
+    while (current != 0) {
+        fs_inode_t* node = inode(current);
+        uint32_t copy;
+        
+        if (node->type == FS_TYPE_DIRECTORY) {
+            copy = create_child(copy_parent, node->name, FS_TYPE_DIRECTORY,
+                                node->permissions | FS_PERM_WRITE, false);
+        } else {
+            copy = clone_file(current, copy_parent, node->name);
+        }
+        if (copy == 0) return false;
+        
+        if (node->type == FS_TYPE_DIRECTORY && first_child(current) != 0) {
+            copy_parent = copy;
+            current = first_child(current);
+            continue;
+        }
+        
+        while (current != source_id && next_sibling(current) == 0) {
+            current = *inode_parent(current);
+            copy_parent = *inode_parent(copy_parent);
+        }
+        current = (current == source_id) ? 0 : next_sibling(current);
+    }
+    return true;
+}
+
+static bool apollofs_clone(vfs_superblock_t* superblock, const char* source, const char* destination) {
+    use_superblock(superblock);
+    
+    uint32_t source_id = resolve_path_to_id(source);
+    if (source_id == 0) return false;
+    
+    char parent_path[FS_MAX_PATH_LENGTH];
+    char name[FS_MAX_FILENAME_LENGTH];
+    extract_directory(destination, parent_path);
+    extract_filename(destination, name);
+    
+    uint32_t parent_id = resolve_path_to_id(parent_path);
+    if (string_length(name) == 0 || parent_id == 0) return false;
+    
+    if (inode(source_id)->type == FS_TYPE_FILE) {
+        return clone_file(source_id, parent_id, name) != 0;
+    }
+    
+    if (is_within(parent_id, source_id)) return false;
+    
+    uint32_t copy_id = create_child(parent_id, name, FS_TYPE_DIRECTORY,
+                                    inode(source_id)->permissions | FS_PERM_WRITE, false);
+    return copy_id != 0 && clone_tree(source_id, copy_id);
+}
+
+static uint32_t apollofs_list(vfs_superblock_t* superblock, const char* path,
+                              fs_dir_entry_t* entries, uint32_t max_entries) {
+    use_superblock(superblock);
+    
+    uint32_t dir_id = resolve_path_to_id(path);
+    if (dir_id == 0 || inode(dir_id)->type != FS_TYPE_DIRECTORY) {
+        return 0;
+    }
+    
+    uint32_t count = 0;
+    
+    fs_directory_index_t* index = *inode_directory_index(dir_id);
+    
+    for (uint32_t bucket = 0; bucket < index->bucket_count; bucket++) {
+        for (uint32_t i = index->buckets[bucket]; i != 0 && count < max_entries; i = *inode_next_id(i)) {
+            fs_inode_t* file = inode(i);
+            string_copy(entries[count].name, file->name);
+            entries[count].type = file->type;
+            entries[count].size = file->size;
+            entries[count].permissions = file->permissions;
+            count++;
+        }
+    }
+    
+    return count;
+}
+
+static uint32_t apollofs_first_child(vfs_superblock_t* superblock, uint32_t directory) {
+    use_superblock(superblock);
+    return inode(directory)->type == FS_TYPE_DIRECTORY ? first_child(directory) : 0;
+}
+
+static uint32_t apollofs_next_sibling(vfs_superblock_t* superblock, uint32_t file_id) {
+    use_superblock(superblock);
+    return file_id == 1 ? 0 : next_sibling(file_id);
+}
+
+static uint32_t apollofs_lookup(vfs_superblock_t* superblock, const char* path) {
+    use_superblock(superblock);
+    return resolve_path_to_id(path);
+}
+
+static bool apollofs_get_info(vfs_superblock_t* superblock, uint32_t file_id, fs_file_info_t* info) {
+    use_superblock(superblock);
+    
+    fs_inode_t* file = inode(file_id);
+    string_copy(info->name, file->name);
+    info->type = file->type;
+    info->size = file->size;
+    info->created_time = file->created_time;
+    info->modified_time = file->modified_time;
+    info->permissions = file->permissions;
+    info->parent_id = *inode_parent(file_id);
+    for (uint32_t i = 0; i < FS_INLINE_EXTENTS; i++) {
+        info->extents[i] = file->is_inline ? (fs_extent_t){0, 0} : file->extents[i];
+    }
+    info->extent_count = file->is_inline ? 0 : file->extent_count;
+    info->indirect_block = file->is_inline ? 0 : file->indirect_block;
+    info->read_only = file->read_only;
+    info->is_inline = file->is_inline;
+    info->is_valid = inode_is_valid(file_id);
+    info->tree_bytes = file->tree_bytes;
+    info->tree_nodes = file->tree_nodes;
+    return true;
+}
+
+static bool apollofs_get_stats(vfs_superblock_t* superblock, fs_stats_t* stats) {
+    use_superblock(superblock);
+    
+    stats->total_files = fs->file_count;
+    stats->total_directories = fs->directory_count;
+    
+    stats->free_blocks = fs->free_block_count;
+    stats->used_blocks = (FS_MAX_BLOCKS - 1) - stats->free_blocks;
+    stats->total_space = (FS_MAX_BLOCKS - 1) * FS_BLOCK_SIZE;
+    stats->free_space = stats->free_blocks * FS_BLOCK_SIZE;
+    stats->dentry_cache_hits = fs->dentry_hits;
+    stats->dentry_cache_misses = fs->dentry_misses;
+    stats->sync_count = fs->sync_count;
+    stats->shared_blocks = fs->shared_references;
+    stats->data_bytes = inode(1)->tree_bytes;
+    stats->persistent = fs->device != NULL;
+    
+    return true;
+}
+
+static void apollofs_release(fs_file_handle_t* handle) {
+    if (handle->mapped_buffer) {
+        buffer_cache_release((buffer_t*)handle->mapped_buffer);
+        handle->mapped_buffer = NULL;
+    }
+}
+
+static uint32_t apollofs_read(fs_file_handle_t* handle, void* buffer, uint32_t size, uint32_t offset) {
+    use_handle(handle);
+    
+    fs_inode_t* file = inode(handle->file_id);
+    bool streaming = offset == handle->position;
+    if (fs->device && streaming) {
+        read_ahead(handle, file, offset, size);
+    }
+    
+    uint32_t bytes_read = read_file_data(file, offset, buffer, size);
+    
+    if (streaming) {
+        handle->next_read_position = offset + bytes_read;
+    }
+    return bytes_read;
+}
+
+static uint32_t apollofs_write(fs_file_handle_t* handle, const void* buffer, uint32_t size, uint32_t offset) {
+    use_handle(handle);
+    
+    fs_inode_t* file = inode(handle->file_id);
+    uint32_t old_size = file->size;
+    uint32_t bytes_written = write_file_data(file, offset, buffer, size);
+    add_to_ancestors(handle->file_id, file->size - old_size, 0);
+    mark_inode_dirty(handle->file_id);
+    
+    if (fs->device && offset == handle->position) {
+        write_behind(handle, file, offset, offset + bytes_written);
+    }
+    return bytes_written;
+}
+
+// Total length of a vector list, capped at the largest possible file.
+static uint32_t vector_total(const fs_iovec_t* vectors, uint32_t count) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (vectors[i].length >= FS_MAX_FILE_SIZE - total) return FS_MAX_FILE_SIZE;
+        total += vectors[i].length;
+    }
+    return total;
+}
+
+static uint32_t apollofs_readv(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count,
+                               uint32_t offset) {
+    use_handle(handle);
+    
+    fs_inode_t* file = inode(handle->file_id);
+    bool streaming = offset == handle->position;
+    if (fs->device && streaming) {
+        read_ahead(handle, file, offset, vector_total(vectors, count));
+    }
+    
+    uint32_t done = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!vectors[i].base) break;
+        
+        uint32_t bytes_read = read_file_data(file, offset + done,
+                                             vectors[i].base, vectors[i].length);
+        done += bytes_read;
+        if (bytes_read < vectors[i].length) break;
+    }
+    
+    if (streaming) {
+        handle->next_read_position = offset + done;
+    }
+    return done;
+}
+
+// Blocks for the whole request are allocated up front, then every vector is
+// copied in turn; size, mtime and the inode's dirty bit are updated once.
+static uint32_t apollofs_writev(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count,
+                                uint32_t offset) {
+    use_handle(handle);
+    
+    fs_inode_t* file = inode(handle->file_id);
+    uint32_t limit = reserve_file_data(file, offset, vector_total(vectors, count));
+    if (limit == 0) return 0;
+    
+    uint32_t done = 0;
+    for (uint32_t i = 0; i < count && done < limit; i++) {
+        uint32_t length = vectors[i].length;
+        if (length > limit - done) length = limit - done;
+        
+        uint32_t bytes_written = copy_file_data(file, offset + done, vectors[i].base, length);
+        done += bytes_written;
+        if (bytes_written < length) break;
+    }
+    
+    uint32_t old_size = file->size;
+    finish_file_write(file, offset + done);
+    add_to_ancestors(handle->file_id, file->size - old_size, 0);
+    mark_inode_dirty(handle->file_id);
+    
+    if (fs->device && offset == handle->position) {
+        write_behind(handle, file, offset, offset + done);
+    }
+    return done;
+}
+
+static bool apollofs_map(fs_file_handle_t* handle, uint32_t offset, const void** data, uint32_t* length) {
+    use_handle(handle);
+    
+    fs_inode_t* file = inode(handle->file_id);
+    if (offset >= file->size) return false;
+    
+    if (file->backing_data || file->is_inline) {
+        const uint8_t* bytes = file->backing_data ? file->backing_data : file->inline_data;
+        *data = bytes + offset;
+        *length = file->size - offset;
+        handle->next_read_position = file->size;
+        return true;
+    }
+    
+    uint32_t block_id, run_blocks;
+    if (!map_file_offset(file, offset, &block_id, &run_blocks)) return false;
+    
+    uint32_t block_offset = offset % FS_BLOCK_SIZE;
+    uint32_t piece;
+    
+    if (!fs->device) {
+        piece = run_blocks * FS_BLOCK_SIZE - block_offset;
+        *data = fs->block_arena + block_id * FS_BLOCK_SIZE + block_offset;
+    } else {
+        piece = FS_BLOCK_SIZE - block_offset;
+        read_ahead(handle, file, offset, piece);
+        
+        buffer_t* buffer = buffer_cache_get(fs->device, FS_DATA_LBA + block_id);
+        if (!buffer) return false;
+        
+        handle->mapped_buffer = buffer;
+        *data = buffer->data + block_offset;
+    }
+    
+    if (piece > file->size - offset) {
+        piece = file->size - offset;
+    }
+    
+    *length = piece;
+    handle->next_read_position = offset + piece;
+    return true;
+}
+
+static bool apollofs_truncate(fs_file_handle_t* handle, uint32_t size) {
+    use_handle(handle);
+    
+    fs_inode_t* file = inode(handle->file_id);
+    if (size >= file->size) return size == file->size;
+    
+    add_to_ancestors(handle->file_id, -(int64_t)(file->size - size), 0);
+    
+    if (!file->is_inline && size <= FS_INLINE_DATA_SIZE) {
+        file->size = size;
+        demote_to_inline(file);
+    }
+    
+    if (file->is_inline) {
+        memory_set(file->inline_data + size, 0, FS_INLINE_DATA_SIZE - size);
+    } else {
+        uint32_t keep_blocks = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+        release_blocks_from(file, keep_blocks);
+        
+        // Zero the tail of the last kept block so a later extension reads zeros.
+        uint32_t block_id, run_blocks;
+        if (size % FS_BLOCK_SIZE != 0 && unshare_blocks(file, size, 1) == 1 &&
+            map_file_offset(file, size, &block_id, &run_blocks)) {
+            storage_zero(block_id, size % FS_BLOCK_SIZE, FS_BLOCK_SIZE - (size % FS_BLOCK_SIZE));
+        }
+    }
+    
+    file->size = size;
+    file->modified_time = get_current_time();
+    mark_inode_dirty(handle->file_id);
+    return true;
+}
+
+static bool apollofs_mount(vfs_superblock_t* superblock, const char* source) {
+    return mount_instance(superblock, source, true);
+}
+
+static bool tmpfs_mount(vfs_superblock_t* superblock, const char* source) {
+    (void)source;
+    return mount_instance(superblock, NULL, false);
+}
+
+static const vfs_superblock_ops_t apollofs_superblock_ops = {
+    .lookup = apollofs_lookup,
+    .get_info = apollofs_get_info,
+    .create = apollofs_create,
+    .remove = apollofs_remove,
+    .list = apollofs_list,
+    .first_child = apollofs_first_child,
+    .next_sibling = apollofs_next_sibling,
+    .attach = apollofs_attach,
+    .clone = apollofs_clone,
+    .sync = apollofs_sync,
+    .get_stats = apollofs_get_stats,
+};
+
+static const vfs_vnode_ops_t apollofs_vnode_ops = {
+    .read = apollofs_read,
+    .write = apollofs_write,
+    .readv = apollofs_readv,
+    .writev = apollofs_writev,
+    .map = apollofs_map,
+    .truncate = apollofs_truncate,
+    .release = apollofs_release,
+};
+
+static const vfs_filesystem_type_t apollofs_type = {
+    .name = "apollofs",
+    .mount = apollofs_mount,
+    .superblock_ops = &apollofs_superblock_ops,
+    .vnode_ops = &apollofs_vnode_ops,
+};
+
+static const vfs_filesystem_type_t tmpfs_type = {
+    .name = "tmpfs",
+    .mount = tmpfs_mount,
+    .superblock_ops = &apollofs_superblock_ops,
+    .vnode_ops = &apollofs_vnode_ops,
+};
+
+void apollofs_register(void) {
+    vfs_register_filesystem(&apollofs_type);
+    vfs_register_filesystem(&tmpfs_type);
+}
@@ -0,0 +1,75 @@
+#include "block_device.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+static struct {
+    block_device_t* devices[BLOCK_DEVICE_MAX_DEVICES];
+    uint32_t device_count;
+} block_state = {0};
+
+static int string_compare(const char* str1, const char* str2) {
+    while (*str1 && *str2 && *str1 == *str2) {
+        str1++;
+        str2++;
+    }
+    return *str1 - *str2;
+}
+
+static bool request_in_range(block_device_t* device, uint64_t block, uint32_t count) {
+    return device && count > 0 && block < device->block_count &&
+           count <= device->block_count - block;
+}
+
+bool block_device_register(block_device_t* device) {
+    if (!device || !device->ops || block_state.device_count >= BLOCK_DEVICE_MAX_DEVICES) {
+        return false;
+    }
+
+    if (block_device_find(device->name)) return false;
+
+    block_state.devices[block_state.device_count++] = device;
+    return true;
+}
+
+block_device_t* block_device_find(const char* name) {
+    if (!name) return NULL;
+
+    for (uint32_t i = 0; i < block_state.device_count; i++) {
+        if (string_compare(block_state.devices[i]->name, name) == 0) {
+            return block_state.devices[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t block_device_get_count(void) {
+    return block_state.device_count;
+}
+
+block_device_t* block_device_get(uint32_t index) {
+    if (index >= block_state.device_count) return NULL;
+    return block_state.devices[index];
+}
+
+bool block_device_read(block_device_t* device, uint64_t block, uint32_t count, void* buffer) {
+    if (!buffer || !request_in_range(device, block, count)) return false;
+
+    device->read_requests++;
+    device->blocks_read += count;
+    return device->ops->read(device, block, count, buffer);
+}
+
+bool block_device_write(block_device_t* device, uint64_t block, uint32_t count, const void* buffer) {
+    if (!buffer || !request_in_range(device, block, count) || device->read_only) return false;
+
+    device->write_requests++;
+    device->blocks_written += count;
+    return device->ops->write(device, block, count, buffer);
+}
+
+bool block_device_flush(block_device_t* device) {
+    if (!device) return false;
+    if (!device->ops->flush) return true;
+    return device->ops->flush(device);
+}
@@ -0,0 +1,383 @@
+#include "buffer_cache.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BUFFER_NONE -1
+
+static uint8_t buffer_data[BUFFER_CACHE_BUFFERS][BUFFER_CACHE_BLOCK_SIZE] __attribute__((aligned(BUFFER_CACHE_BLOCK_SIZE)));
+
+// Staging area for multi-block transfers. Cached buffers are scattered, so
+// a batch is gathered here and moved to or from the device in one request.
+static uint8_t batch_data[BUFFER_CACHE_MAX_BATCH * BUFFER_CACHE_BLOCK_SIZE] __attribute__((aligned(BUFFER_CACHE_BLOCK_SIZE)));
+
+// Every buffer sits on one LRU list, most recently used at the head. Pinned
+// buffers stay on the list and are simply skipped when picking a victim.
+static struct {
+    buffer_t buffers[BUFFER_CACHE_BUFFERS];
+    int16_t hash_heads[BUFFER_CACHE_HASH_BUCKETS];
+    int16_t lru_head;
+    int16_t lru_tail;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writebacks;
+    uint32_t evictions;
+    uint32_t dirty_count;
+    uint32_t readahead_blocks;
+    uint32_t read_batches;
+    uint32_t write_batches;
+    bool is_initialized;
+} cache_state = {0};
+
+static void memory_set(void* dest, uint8_t value, uint32_t size) {
+    uint8_t* d = (uint8_t*)dest;
+    for (uint32_t i = 0; i < size; i++) {
+        d[i] = value;
+    }
+}
+
+static void memory_copy(void* dest, const void* src, uint32_t size) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (uint32_t i = 0; i < size; i++) {
+        d[i] = s[i];
+    }
+}
+
+static uint32_t hash_slot(block_device_t* device, uint64_t block) {
+    uint64_t key = block ^ ((uint64_t)(uintptr_t)device >> 4);
+    return (uint32_t)(key * 2654435761u) & (BUFFER_CACHE_HASH_BUCKETS - 1);
+}
+
+static int16_t buffer_index(buffer_t* buffer) {
+    return (int16_t)(buffer - cache_state.buffers);
+}
+
+static void lru_unlink(int16_t index) {
+    buffer_t* buffer = &cache_state.buffers[index];
+
+    if (buffer->lru_prev != BUFFER_NONE) {
+        cache_state.buffers[buffer->lru_prev].lru_next = buffer->lru_next;
+    } else {
+        cache_state.lru_head = buffer->lru_next;
+    }
+
+    if (buffer->lru_next != BUFFER_NONE) {
+        cache_state.buffers[buffer->lru_next].lru_prev = buffer->lru_prev;
+    } else {
+        cache_state.lru_tail = buffer->lru_prev;
+    }
+}
+
+static void lru_push_front(int16_t index) {
+    buffer_t* buffer = &cache_state.buffers[index];
+
+    buffer->lru_prev = BUFFER_NONE;
+    buffer->lru_next = cache_state.lru_head;
+    if (cache_state.lru_head != BUFFER_NONE) {
+        cache_state.buffers[cache_state.lru_head].lru_prev = index;
+    } else {
+        cache_state.lru_tail = index;
+    }
+    cache_state.lru_head = index;
+}
+
+static void hash_remove(int16_t index) {
+    buffer_t* buffer = &cache_state.buffers[index];
+    int16_t* link = &cache_state.hash_heads[hash_slot(buffer->device, buffer->block)];
+
+    while (*link != BUFFER_NONE) {
+        if (*link == index) {
+            *link = buffer->hash_next;
+            buffer->hash_next = BUFFER_NONE;
+            return;
+        }
+        link = &cache_state.buffers[*link].hash_next;
+    }
+}
+
+static void hash_insert(int16_t index) {
+    buffer_t* buffer = &cache_state.buffers[index];
+    int16_t* head = &cache_state.hash_heads[hash_slot(buffer->device, buffer->block)];
+
+    buffer->hash_next = *head;
+    *head = index;
+}
+
+static buffer_t* lookup(block_device_t* device, uint64_t block) {
+    int16_t index = cache_state.hash_heads[hash_slot(device, block)];
+
+    while (index != BUFFER_NONE) {
+        buffer_t* buffer = &cache_state.buffers[index];
+        if (buffer->device == device && buffer->block == block) {
+            return buffer;
+        }
+        index = buffer->hash_next;
+    }
+    return NULL;
+}
+
+static bool is_dirty_block(block_device_t* device, uint64_t block) {
+    buffer_t* buffer = lookup(device, block);
+    return buffer && buffer->is_dirty;
+}
+
+// Writes the run of consecutive dirty blocks starting at start, up to
+// max_count of them, as a single device request.
+static bool write_run(block_device_t* device, uint64_t start, uint32_t max_count) {
+    buffer_t* run[BUFFER_CACHE_MAX_BATCH];
+    uint32_t count = 0;
+
+    if (max_count > BUFFER_CACHE_MAX_BATCH) max_count = BUFFER_CACHE_MAX_BATCH;
+
+    while (count < max_count) {
+        buffer_t* buffer = lookup(device, start + count);
+        if (!buffer || !buffer->is_dirty) break;
+
+        memory_copy(batch_data + count * BUFFER_CACHE_BLOCK_SIZE, buffer->data, BUFFER_CACHE_BLOCK_SIZE);
+        run[count++] = buffer;
+    }
+
+    if (count == 0) return true;
+    if (!block_device_write(device, start, count, batch_data)) return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        run[i]->is_dirty = false;
+    }
+    cache_state.dirty_count -= count;
+    cache_state.writebacks += count;
+    cache_state.write_batches++;
+    return true;
+}
+
+// Writing one dirty block costs a device round trip, so its dirty
+// neighbours go out in the same request.
+static bool write_back(buffer_t* buffer) {
+    if (!buffer->is_dirty) return true;
+
+    uint64_t start = buffer->block;
+    while (start > 0 && buffer->block - start < BUFFER_CACHE_MAX_BATCH - 1 &&
+           is_dirty_block(buffer->device, start - 1)) {
+        start--;
+    }
+
+    return write_run(buffer->device, start, BUFFER_CACHE_MAX_BATCH);
+}
+
+// Picks the least recently used unpinned buffer, writing it back first if
+// it is dirty. A buffer whose write-back fails keeps its data and is passed
+// over.
+static buffer_t* evict(void) {
+    for (int16_t index = cache_state.lru_tail; index != BUFFER_NONE;
+         index = cache_state.buffers[index].lru_prev) {
+        buffer_t* buffer = &cache_state.buffers[index];
+        if (buffer->reference_count > 0) continue;
+        if (!write_back(buffer)) continue;
+
+        if (buffer->is_valid) {
+            hash_remove(index);
+            buffer->is_valid = false;
+            cache_state.evictions++;
+        }
+        return buffer;
+    }
+    return NULL;
+}
+
+static buffer_t* acquire(block_device_t* device, uint64_t block, bool read_block) {
+    if (!cache_state.is_initialized || !device) return NULL;
+
+    buffer_t* buffer = lookup(device, block);
+    if (buffer) {
+        cache_state.hits++;
+    } else {
+        cache_state.misses++;
+
+        buffer = evict();
+        if (!buffer) return NULL;
+
+        if (read_block) {
+            if (!block_device_read(device, block, 1, buffer->data)) return NULL;
+        } else {
+            memory_set(buffer->data, 0, BUFFER_CACHE_BLOCK_SIZE);
+        }
+
+        buffer->device = device;
+        buffer->block = block;
+        buffer->is_valid = true;
+        hash_insert(buffer_index(buffer));
+    }
+
+    lru_unlink(buffer_index(buffer));
+    lru_push_front(buffer_index(buffer));
+    buffer->reference_count++;
+    return buffer;
+}
+
+void buffer_cache_initialize(void) {
+    if (cache_state.is_initialized) return;
+
+    for (uint32_t i = 0; i < BUFFER_CACHE_HASH_BUCKETS; i++) {
+        cache_state.hash_heads[i] = BUFFER_NONE;
+    }
+
+    cache_state.lru_head = BUFFER_NONE;
+    cache_state.lru_tail = BUFFER_NONE;
+
+    for (int16_t i = 0; i < BUFFER_CACHE_BUFFERS; i++) {
+        buffer_t* buffer = &cache_state.buffers[i];
+        buffer->device = NULL;
+        buffer->block = 0;
+        buffer->data = buffer_data[i];
+        buffer->reference_count = 0;
+        buffer->is_valid = false;
+        buffer->is_dirty = false;
+        buffer->hash_next = BUFFER_NONE;
+        lru_push_front(i);
+    }
+
+    cache_state.hits = 0;
+    cache_state.misses = 0;
+    cache_state.writebacks = 0;
+    cache_state.evictions = 0;
+    cache_state.dirty_count = 0;
+    cache_state.readahead_blocks = 0;
+    cache_state.read_batches = 0;
+    cache_state.write_batches = 0;
+    cache_state.is_initialized = true;
+}
+
+buffer_t* buffer_cache_get(block_device_t* device, uint64_t block) {
+    return acquire(device, block, true);
+}
+
+buffer_t* buffer_cache_get_new(block_device_t* device, uint64_t block) {
+    return acquire(device, block, false);
+}
+
+void buffer_cache_mark_dirty(buffer_t* buffer) {
+    if (!buffer || buffer->is_dirty) return;
+
+    buffer->is_dirty = true;
+    cache_state.dirty_count++;
+}
+
+void buffer_cache_release(buffer_t* buffer) {
+    if (buffer && buffer->reference_count > 0) {
+        buffer->reference_count--;
+    }
+}
+
+uint32_t buffer_cache_prefetch(block_device_t* device, uint64_t block, uint32_t count) {
+    if (!cache_state.is_initialized || !device) return 0;
+
+    uint32_t fetched = 0;
+
+    while (count > 0) {
+        if (lookup(device, block)) {
+            block++;
+            count--;
+            continue;
+        }
+
+        uint32_t run = 1;
+        while (run < count && run < BUFFER_CACHE_MAX_BATCH && !lookup(device, block + run)) {
+            run++;
+        }
+
+        // Claim every victim before reading: eviction may write back through
+        // the staging area. Victims stay pinned so none is picked twice.
+        buffer_t* victims[BUFFER_CACHE_MAX_BATCH];
+        uint32_t claimed = 0;
+        while (claimed < run) {
+            buffer_t* victim = evict();
+            if (!victim) break;
+            victim->reference_count++;
+            victims[claimed++] = victim;
+        }
+
+        bool read_ok = claimed > 0 && block_device_read(device, block, claimed, batch_data);
+
+        for (uint32_t i = 0; i < claimed; i++) {
+            buffer_t* buffer = victims[i];
+            buffer->reference_count--;
+            if (!read_ok) continue;
+
+            memory_copy(buffer->data, batch_data + i * BUFFER_CACHE_BLOCK_SIZE, BUFFER_CACHE_BLOCK_SIZE);
+            buffer->device = device;
+            buffer->block = block + i;
+            buffer->is_valid = true;
+            hash_insert(buffer_index(buffer));
+            lru_unlink(buffer_index(buffer));
+            lru_push_front(buffer_index(buffer));
+        }
+
+        if (!read_ok) break;
+
+        cache_state.read_batches++;
+        cache_state.readahead_blocks += claimed;
+        fetched += claimed;
+        if (claimed < run) break;
+
+        block += run;
+        count -= run;
+    }
+
+    return fetched;
+}
+
+bool buffer_cache_flush_range(block_device_t* device, uint64_t block, uint32_t count) {
+    if (!cache_state.is_initialized) return false;
+
+    bool success = true;
+    uint64_t end = block + count;
+
+    while (block < end && cache_state.dirty_count > 0) {
+        uint32_t run = 0;
+        while (block + run < end && run < BUFFER_CACHE_MAX_BATCH && is_dirty_block(device, block + run)) {
+            run++;
+        }
+
+        if (run == 0) {
+            block++;
+            continue;
+        }
+
+        if (!write_run(device, block, run)) success = false;
+        block += run;
+    }
+    return success;
+}
+
+bool buffer_cache_sync(block_device_t* device) {
+    if (!cache_state.is_initialized) return false;
+
+    bool success = true;
+    for (uint32_t i = 0; i < BUFFER_CACHE_BUFFERS && cache_state.dirty_count > 0; i++) {
+        buffer_t* buffer = &cache_state.buffers[i];
+        if (buffer->is_valid && buffer->device == device && buffer->is_dirty && !write_back(buffer)) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+bool buffer_cache_get_stats(buffer_cache_stats_t* stats) {
+    if (!stats) return false;
+
+    stats->hits = cache_state.hits;
+    stats->misses = cache_state.misses;
+    stats->writebacks = cache_state.writebacks;
+    stats->evictions = cache_state.evictions;
+    stats->dirty_buffers = cache_state.dirty_count;
+    stats->readahead_blocks = cache_state.readahead_blocks;
+    stats->read_batches = cache_state.read_batches;
+    stats->write_batches = cache_state.write_batches;
+    stats->total_buffers = BUFFER_CACHE_BUFFERS;
+
+    stats->cached_buffers = 0;
+    for (uint32_t i = 0; i < BUFFER_CACHE_BUFFERS; i++) {
+        if (cache_state.buffers[i].is_valid) stats->cached_buffers++;
+    }
+    return true;
+}
@@ -6,12 +6,22 @@
 #include "text_editor.h"
 #include "filesystem.h"
 #include "process_manager.h"
+#include "address_space.h"
+#include "system_calls.h"
+#include "pci.h"
+#include "block_device.h"
+#include "buffer_cache.h"
+#include "initrd.h"
+#include "vfs.h"
+#include "text_index.h"
+#include "regex.h"
 #include <stdint.h>
 #include <stdbool.h>
 
 #define MAX_COMMAND_LENGTH 256
 #define MAX_ARGUMENTS 16
 #define COMMAND_HISTORY_SIZE 32
+#define GREP_MAX_LINE_LENGTH 512
 
 typedef struct {
     char buffer[MAX_COMMAND_LENGTH];
@@ -163,6 +173,258 @@ static bool string_contains(const char* haystack, const char* needle) {
     return false;
 }
 
+// A grep pattern. Plain text is found with a Horspool shift table: after a
+// mismatch the scan moves ahead by the shift of the text byte under the
+// pattern's last byte, so bytes that do not occur in the pattern skip its
+// whole length. Anything else is compiled to a regex.
+typedef struct {
+    const char* text;
+    uint32_t length;
+    uint16_t shift[256];
+    regex_t* regex;
+} grep_pattern_t;
+
+static bool grep_prepare(grep_pattern_t* pattern, const char* text, const char** error) {
+    pattern->text = text;
+    pattern->length = string_length(text);
+    pattern->regex = NULL;
+    
+    if (!regex_is_literal(text)) {
+        pattern->regex = regex_compile(text, error);
+        return pattern->regex != NULL;
+    }
+    
+    for (uint32_t c = 0; c < 256; c++) {
+        pattern->shift[c] = (uint16_t)pattern->length;
+    }
+    for (uint32_t i = 0; i + 1 < pattern->length; i++) {
+        pattern->shift[(uint8_t)text[i]] = (uint16_t)(pattern->length - 1 - i);
+    }
+    return true;
+}
+
+static void grep_release(grep_pattern_t* pattern) {
+    if (pattern->regex) {
+        regex_free(pattern->regex);
+        pattern->regex = NULL;
+    }
+}
+
+static void grep_bad_pattern(const char* error) {
+    terminal_write_string("\nError: Bad pattern: ");
+    terminal_write_string(error);
+    terminal_write_string("\n");
+}
+
+static bool text_contains(const char* text, uint32_t length, const grep_pattern_t* pattern) {
+    if (pattern->regex) return regex_search(pattern->regex, text, length);
+    
+    uint32_t needle_len = pattern->length;
+    if (needle_len == 0) return true;
+    if (needle_len > length) return false;
+    
+    uint32_t i = 0;
+    while (i <= length - needle_len) {
+        uint8_t last = (uint8_t)text[i + needle_len - 1];
+        if (last == (uint8_t)pattern->text[needle_len - 1]) {
+            uint32_t j = 0;
+            while (j < needle_len - 1 && text[i + j] == pattern->text[j]) j++;
+            if (j == needle_len - 1) return true;
+        }
+        i += pattern->shift[last];
+    }
+    return false;
+}
+
+static uint32_t carry_append(char* carry, uint32_t carry_length, const char* text, uint32_t length) {
+    for (uint32_t i = 0; i < length && carry_length < GREP_MAX_LINE_LENGTH; i++) {
+        carry[carry_length++] = text[i];
+    }
+    return carry_length;
+}
+
+// Prints one line if it contains pattern. A single-file search announces
+// its first match; a tree search names the file on every line instead.
+static uint32_t grep_line(const char* line, uint32_t length, const grep_pattern_t* pattern,
+                          uint32_t line_num, const char* file_name, bool first_match) {
+    if (!text_contains(line, length, pattern)) return 0;
+    
+    if (file_name) {
+        terminal_set_color(11, 0);
+        terminal_write_string(file_name);
+        terminal_set_color(7, 0);
+        terminal_write_string(":");
+    } else if (first_match) {
+        terminal_set_color(10, 0);
+        terminal_write_string("Pattern found in file!\n");
+        terminal_set_color(7, 0);
+    }
+    
+    terminal_write_uint(line_num);
+    terminal_write_string(": ");
+    for (uint32_t i = 0; i < length; i++) {
+        terminal_write_char(line[i]);
+    }
+    terminal_write_string("\n");
+    return 1;
+}
+
+// Lines are matched in place in the mapped file data. Only a line split
+// across two pieces is stitched together in carry.
+static uint32_t grep_file(fs_file_handle_t* handle, const grep_pattern_t* pattern,
+                          const char* file_name) {
+    char carry[GREP_MAX_LINE_LENGTH];
+    uint32_t carry_length = 0;
+    uint32_t line_num = 1;
+    uint32_t matches = 0;
+    const void* piece;
+    uint32_t piece_length;
+    
+    while (filesystem_map_file(handle, &piece, &piece_length)) {
+        const char* text = (const char*)piece;
+        uint32_t line_start = 0;
+        
+        for (uint32_t i = 0; i < piece_length; i++) {
+            if (text[i] != '\n') continue;
+            
+            if (carry_length > 0) {
+                carry_length = carry_append(carry, carry_length, text, i);
+                matches += grep_line(carry, carry_length, pattern, line_num, file_name, matches == 0);
+                carry_length = 0;
+            } else {
+                matches += grep_line(text + line_start, i - line_start, pattern, line_num,
+                                     file_name, matches == 0);
+            }
+            
+            line_num++;
+            line_start = i + 1;
+        }
+        
+        carry_length = carry_append(carry, carry_length, text + line_start,
+                                    piece_length - line_start);
+    }
+    
+    if (carry_length > 0) {
+        matches += grep_line(carry, carry_length, pattern, line_num, file_name, matches == 0);
+    }
+    
+    return matches;
+}
+
+// Searches every file below start. Files the text index rules out are
+// never opened.
+static void grep_tree(const char* pattern_text, const char* start) {
+    fs_walk_t walk;
+    if (!filesystem_walk_begin(&walk, start)) {
+        terminal_write_string("\nError: '");
+        terminal_write_string(start);
+        terminal_write_string("' is not a directory.\n");
+        return;
+    }
+    
+    grep_pattern_t pattern;
+    const char* error;
+    if (!grep_prepare(&pattern, pattern_text, &error)) {
+        grep_bad_pattern(error);
+        return;
+    }
+    
+    // Trigrams can only be looked up for plain text.
+    text_index_query_t query;
+    if (pattern.regex) {
+        query.is_filtered = false;
+    } else {
+        text_index_query(pattern_text, &query);
+    }
+    
+    terminal_write_string("\n");
+    
+    uint32_t matches = 0;
+    uint32_t matching_files = 0;
+    uint32_t files = 0;
+    uint32_t files_read = 0;
+    
+    while (filesystem_walk_next(&walk)) {
+        if (walk.info.type != FS_TYPE_FILE) continue;
+        
+        files++;
+        if (!filesystem_walk_may_contain(&walk, &query)) continue;
+        
+        fs_file_handle_t handle;
+        if (!filesystem_open_handle(walk.path, false, &handle)) continue;
+        
+        files_read++;
+        uint32_t found = grep_file(&handle, &pattern, walk.path);
+        filesystem_release_handle(&handle);
+        
+        if (found > 0) {
+            matches += found;
+            matching_files++;
+        }
+    }
+    
+    if (matches == 0) {
+        terminal_write_string("Pattern not found.\n");
+    } else {
+        terminal_write_string("\n");
+        terminal_write_uint(matches);
+        terminal_write_string(" matching lines in ");
+        terminal_write_uint(matching_files);
+        terminal_write_string(" files.\n");
+    }
+    
+    terminal_set_color(8, 0);
+    terminal_write_string("Read ");
+    terminal_write_uint(files_read);
+    terminal_write_string(" of ");
+    terminal_write_uint(files);
+    terminal_write_string(" files; the text index ruled out the rest.\n");
+    terminal_set_color(7, 0);
+    
+    grep_release(&pattern);
+}
+
+// One line of du. The filesystem keeps running totals on every directory,
+// so this is one lookup however much lies below path.
+static bool du_line(const char* path) {
+    uint32_t bytes, nodes;
+    if (!filesystem_get_usage(path, &bytes, &nodes)) return false;
+    
+    for (uint32_t limit = 10000000; limit > 1 && bytes < limit; limit /= 10) {
+        terminal_write_char(' ');
+    }
+    terminal_write_uint(bytes);
+    terminal_write_string(" bytes  ");
+    terminal_set_color(12, 0);
+    terminal_write_string(path);
+    terminal_set_color(8, 0);
+    terminal_write_string(" (");
+    terminal_write_uint(nodes);
+    terminal_write_string(" entries)\n");
+    terminal_set_color(7, 0);
+    return true;
+}
+
+// Totals for each directory in start, then for start itself. The walk
+// stays at depth 1, since each total already covers everything below.
+static void du_tree(const char* start) {
+    fs_walk_t walk;
+    
+    terminal_write_string("\n");
+    if (filesystem_walk_begin(&walk, start)) {
+        while (filesystem_walk_next(&walk)) {
+            filesystem_walk_prune(&walk);
+            if (walk.info.type == FS_TYPE_DIRECTORY) du_line(walk.path);
+        }
+    }
+    
+    if (!du_line(start)) {
+        terminal_write_string("Error: '");
+        terminal_write_string(start);
+        terminal_write_string("' does not exist.\n");
+    }
+}
+
 static uint32_t parse_arguments(const char* input, char args[MAX_ARGUMENTS][MAX_COMMAND_LENGTH]) {
     uint32_t arg_count = 0;
     uint32_t arg_pos = 0;
@@ -355,11 +617,15 @@ static void execute_command(const char* input) {
         terminal_write_string("  rm <file>    - Delete file\n");
         terminal_write_string("  cp <s> <d>   - Copy file\n");
         terminal_write_string("  mv <s> <d>   - Move/rename file\n");
+        terminal_write_string("  snapshot     - Copy a directory, sharing data\n");
         terminal_write_string("  cat <file>   - Display file contents\n");
         terminal_write_string("  touch <file> - Create empty file\n");
-        terminal_write_string("  find <pat>   - Search for files\n");
-        terminal_write_string("  tree         - Directory structure\n");
-        terminal_write_string("  grep <p> <f> - Search text in files\n\n");
+        terminal_write_string("  find <pat>   - Search for files below a directory\n");
+        terminal_write_string("  tree [dir]   - Directory structure\n");
+        terminal_write_string("  grep <p> <f> - Search a file for a text or regex pattern\n");
+        terminal_write_string("  grep -r <p>  - Search every file below a directory\n");
+        terminal_write_string("  du [dir]     - Space used below a directory\n");
+        terminal_write_string("  sync         - Write cached data to disk\n\n");
         
         terminal_set_color(12, 0);
         terminal_write_string("System Information:\n");
@@ -367,10 +633,13 @@ static void execute_command(const char* input) {
         terminal_write_string("  sysinfo      - Complete system info\n");
         terminal_write_string("  meminfo      - Memory usage statistics\n");
         terminal_write_string("  df           - Filesystem usage\n");
+        terminal_write_string("  mount        - Mounted filesystems\n");
+        terminal_write_string("  lspci        - PCI devices\n");
         terminal_write_string("  ps           - Process list\n");
         terminal_write_string("  whoami       - User information\n");
         terminal_write_string("  date         - Current date/time\n");
-        terminal_write_string("  uptime       - System uptime\n\n");
+        terminal_write_string("  uptime       - System uptime\n");
+        terminal_write_string("  sysbench [n] - Ring 3 system call cost\n\n");
         
         terminal_set_color(10, 0);
         terminal_write_string("Utilities:\n");
@@ -380,6 +649,7 @@ static void execute_command(const char* input) {
         terminal_write_string("  history      - Command history\n");
         terminal_write_string("  clear        - Clear screen\n");
         terminal_write_string("  edit <file>  - Text editor\n");
+        terminal_write_string("  run <prog>   - Run an ELF64 program in ring 3\n");
         terminal_write_string("  palette      - Color palette demo\n\n");
         
         terminal_set_color(11, 0);
@@ -564,6 +834,19 @@ static void execute_command(const char* input) {
             }
         }
         
+    } else if (string_compare(args[0], "snapshot") == 0) {
+        if (argc < 3) {
+            terminal_write_string("\nUsage: snapshot <directory> <destination>\n");
+        } else if (filesystem_snapshot(args[1], args[2])) {
+            terminal_write_string("\nSnapshot of '");
+            terminal_write_string(args[1]);
+            terminal_write_string("' created at '");
+            terminal_write_string(args[2]);
+            terminal_write_string("'\n");
+        } else {
+            terminal_write_string("\nError: Cannot snapshot directory\n");
+        }
+        
     } else if (string_compare(args[0], "mv") == 0 || string_compare(args[0], "move") == 0) {
         if (argc < 3) {
             terminal_write_string("\nUsage: mv <source> <destination>\n");
@@ -603,7 +886,9 @@ static void execute_command(const char* input) {
                 terminal_write_string(args[1]);
                 terminal_write_string("' does not exist.\n");
             } else {
-                fs_file_handle_t* handle = filesystem_open_file(args[1], false);
+                fs_fd_table_t* files = process_get_fd_table(process_get_current_pid());
+                int32_t fd = filesystem_fd_open(files, args[1], false);
+                fs_file_handle_t* handle = filesystem_fd_get(files, fd);
                 if (!handle) {
                     terminal_write_string("\nError: Cannot open file.\n");
                 } else {
@@ -619,21 +904,21 @@ static void execute_command(const char* input) {
                         terminal_set_color(7, 0);
                     }
                     
-                    char buffer[512];
-                    uint32_t bytes_read;
+                    const void* piece;
+                    uint32_t piece_length;
                     uint32_t total_bytes = 0;
                     uint32_t line_count = 1;
                     
-                    while ((bytes_read = filesystem_read_file(handle, buffer, sizeof(buffer) - 1)) > 0) {
-                        buffer[bytes_read] = '\0';
-                        for (uint32_t i = 0; i < bytes_read; i++) {
-                            if (buffer[i] == '\n') line_count++;
+                    while (filesystem_map_file(handle, &piece, &piece_length)) {
+                        const char* text = (const char*)piece;
+                        for (uint32_t i = 0; i < piece_length; i++) {
+                            if (text[i] == '\n') line_count++;
+                            terminal_write_char(text[i]);
                         }
-                        terminal_write_string(buffer);
-                        total_bytes += bytes_read;
+                        total_bytes += piece_length;
                     }
                     
-                    filesystem_close_file(handle);
+                    filesystem_fd_close(files, fd);
                     terminal_write_string("\n");
                     terminal_set_color(8, 0);
                     terminal_write_string("--- End (");
@@ -648,83 +933,120 @@ static void execute_command(const char* input) {
         
     } else if (string_compare(args[0], "find") == 0) {
         if (argc < 2) {
-            terminal_write_string("\nUsage: find <pattern>\n");
+            terminal_write_string("\nUsage: find <pattern> [directory]\n");
         } else {
-            terminal_write_string("\nSearching for files containing '");
-            terminal_write_string(args[1]);
-            terminal_write_string("':\n\n");
+            const char* start = (argc > 2) ? args[2] : ".";
+            fs_walk_t walk;
             
-            fs_dir_entry_t entries[64];
-            uint32_t count = filesystem_list_directory(NULL, entries, 64);
-            uint32_t found = 0;
-            
-            for (uint32_t i = 0; i < count; i++) {
-                if (string_contains(entries[i].name, args[1])) {
+            if (!filesystem_walk_begin(&walk, start)) {
+                terminal_write_string("\nError: '");
+                terminal_write_string(start);
+                terminal_write_string("' is not a directory.\n");
+            } else {
+                terminal_write_string("\nSearching for files containing '");
+                terminal_write_string(args[1]);
+                terminal_write_string("':\n\n");
+                
+                uint32_t found = 0;
+                
+                while (filesystem_walk_next(&walk)) {
+                    if (!string_contains(walk.info.name, args[1])) continue;
+                    
                     terminal_set_color(11, 0);
                     terminal_write_string("  ");
-                    terminal_write_string(entries[i].name);
+                    terminal_write_string(walk.path);
                     terminal_set_color(7, 0);
-                    if (entries[i].type == FS_TYPE_DIRECTORY) {
+                    if (walk.info.type == FS_TYPE_DIRECTORY) {
                         terminal_write_string(" (directory)");
                     } else {
                         terminal_write_string(" (");
-                        terminal_write_uint(entries[i].size);
+                        terminal_write_uint(walk.info.size);
                         terminal_write_string(" bytes)");
                     }
                     terminal_write_string("\n");
                     found++;
                 }
-            }
-            
-            if (found == 0) {
-                terminal_write_string("No files found matching pattern.\n");
-            } else {
-                terminal_write_string("\nFound ");
-                terminal_write_uint(found);
-                terminal_write_string(" matching files.\n");
+                
+                if (found == 0) {
+                    terminal_write_string("No files found matching pattern.\n");
+                } else {
+                    terminal_write_string("\nFound ");
+                    terminal_write_uint(found);
+                    terminal_write_string(" matching files.\n");
+                }
             }
         }
         
     } else if (string_compare(args[0], "tree") == 0) {
-        terminal_write_string("\nDirectory Structure:\n");
-        terminal_write_string("====================\n");
-        
-        char current_dir[FS_MAX_PATH_LENGTH];
-        filesystem_get_current_directory(current_dir, sizeof(current_dir));
-        
-        terminal_set_color(12, 0);
-        terminal_write_string(current_dir);
-        terminal_set_color(7, 0);
-        terminal_write_string("\n");
-        
-        fs_dir_entry_t entries[64];
-        uint32_t count = filesystem_list_directory(NULL, entries, 64);
+        const char* start = (argc > 1) ? args[1] : ".";
+        fs_walk_t walk;
         
-        for (uint32_t i = 0; i < count; i++) {
-            terminal_write_string("├── ");
-            if (entries[i].type == FS_TYPE_DIRECTORY) {
-                terminal_set_color(12, 0);
-                terminal_write_string(entries[i].name);
-                terminal_write_string("/");
-                terminal_set_color(7, 0);
-            } else {
-                terminal_set_color(11, 0);
-                terminal_write_string(entries[i].name);
-                terminal_set_color(7, 0);
+        if (!filesystem_walk_begin(&walk, start)) {
+            terminal_write_string("\nError: '");
+            terminal_write_string(start);
+            terminal_write_string("' is not a directory.\n");
+        } else {
+            terminal_write_string("\nDirectory Structure:\n");
+            terminal_write_string("====================\n");
+            
+            terminal_set_color(12, 0);
+            terminal_write_string(walk.path);
+            terminal_set_color(7, 0);
+            terminal_write_string("\n");
+            
+            uint32_t directories = 0;
+            uint32_t files = 0;
+            
+            while (filesystem_walk_next(&walk)) {
+                for (uint32_t level = 1; level < walk.depth; level++) {
+                    terminal_write_string("│   ");
+                }
+                terminal_write_string("├── ");
+                if (walk.info.type == FS_TYPE_DIRECTORY) {
+                    terminal_set_color(12, 0);
+                    terminal_write_string(walk.info.name);
+                    terminal_write_string("/");
+                    terminal_set_color(7, 0);
+                    directories++;
+                } else {
+                    terminal_set_color(11, 0);
+                    terminal_write_string(walk.info.name);
+                    terminal_set_color(7, 0);
+                    files++;
+                }
+                terminal_write_string("\n");
             }
+            
             terminal_write_string("\n");
+            terminal_write_uint(directories);
+            terminal_write_string(" directories, ");
+            terminal_write_uint(files);
+            terminal_write_string(" files\n");
         }
         
+    } else if (string_compare(args[0], "du") == 0) {
+        du_tree((argc > 1) ? args[1] : ".");
+        
     } else if (string_compare(args[0], "grep") == 0) {
-        if (argc < 3) {
+        if (argc >= 3 && string_compare(args[1], "-r") == 0) {
+            grep_tree(args[2], (argc > 3) ? args[3] : ".");
+        } else if (argc < 3) {
             terminal_write_string("\nUsage: grep <pattern> <file>\n");
+            terminal_write_string("       grep -r <pattern> [directory]\n");
         } else {
-            if (!filesystem_file_exists(args[2])) {
+            grep_pattern_t pattern;
+            const char* error;
+            
+            if (!grep_prepare(&pattern, args[1], &error)) {
+                grep_bad_pattern(error);
+            } else if (!filesystem_file_exists(args[2])) {
                 terminal_write_string("\nError: File '");
                 terminal_write_string(args[2]);
                 terminal_write_string("' does not exist.\n");
             } else {
-                fs_file_handle_t* handle = filesystem_open_file(args[2], false);
+                fs_fd_table_t* files = process_get_fd_table(process_get_current_pid());
+                int32_t fd = filesystem_fd_open(files, args[2], false);
+                fs_file_handle_t* handle = filesystem_fd_get(files, fd);
                 if (!handle) {
                     terminal_write_string("\nError: Cannot open file.\n");
                 } else {
@@ -734,39 +1056,17 @@ static void execute_command(const char* input) {
                     terminal_write_string(args[2]);
                     terminal_write_string(":\n\n");
                     
-                    char buffer[512];
-                    uint32_t bytes_read = filesystem_read_file(handle, buffer, sizeof(buffer) - 1);
-                    buffer[bytes_read] = '\0';
+                    uint32_t matches = grep_file(handle, &pattern, NULL);
                     
-                    filesystem_close_file(handle);
+                    filesystem_fd_close(files, fd);
                     
-                    if (string_contains(buffer, args[1])) {
-                        terminal_set_color(10, 0);
-                        terminal_write_string("Pattern found in file!\n");
-                        terminal_set_color(7, 0);
-                        
-                        char* line_start = buffer;
-                        uint32_t line_num = 1;
-                        
-                        for (uint32_t i = 0; i < bytes_read; i++) {
-                            if (buffer[i] == '\n' || i == bytes_read - 1) {
-                                buffer[i] = '\0';
-                                if (string_contains(line_start, args[1])) {
-                                    terminal_write_uint(line_num);
-                                    terminal_write_string(": ");
-                                    terminal_write_string(line_start);
-                                    terminal_write_string("\n");
-                                }
-                                line_start = &buffer[i + 1];
-                                line_num++;
-                                buffer[i] = '\n';
-                            }
-                        }
-                    } else {
+                    if (matches == 0) {
                         terminal_write_string("Pattern not found in file.\n");
                     }
                 }
             }
+            
+            grep_release(&pattern);
         }
         
     } else if (string_compare(args[0], "sysinfo") == 0) {
@@ -822,6 +1122,30 @@ static void execute_command(const char* input) {
             terminal_write_string("\n");
         }
         
+        address_space_stats_t as_stats;
+        if (address_space_get_stats(&as_stats)) {
+            terminal_write_string("  PCID:              ");
+            terminal_write_string(as_stats.pcid_supported ? "enabled" : "unavailable");
+            if (as_stats.invpcid_supported) {
+                terminal_write_string(" (INVPCID)");
+            }
+            terminal_write_string("\n");
+            terminal_write_string("  Last CR3 Switch:   ");
+            terminal_write_uint((uint32_t)as_stats.last_switch_cycles);
+            terminal_write_string(" cycles (");
+            terminal_write_uint(as_stats.switches_without_flush);
+            terminal_write_string("/");
+            terminal_write_uint(as_stats.switches);
+            terminal_write_string(" without flush)\n");
+            terminal_write_string("  Copy-on-write:     ");
+            terminal_write_uint(as_stats.pages_shared);
+            terminal_write_string(" pages shared, ");
+            terminal_write_uint(as_stats.cow_pages_copied);
+            terminal_write_string(" copied, ");
+            terminal_write_uint(as_stats.cow_pages_reclaimed);
+            terminal_write_string(" reclaimed\n");
+        }
+        
     } else if (string_compare(args[0], "meminfo") == 0) {
         terminal_write_string("\nMemory Usage Statistics:\n");
         terminal_write_string("========================\n\n");
@@ -894,6 +1218,56 @@ static void execute_command(const char* input) {
             terminal_write_string("Used Blocks:   ");
             terminal_write_uint(stats.used_blocks);
             terminal_write_string("\n");
+            terminal_write_string("Path Cache:    ");
+            terminal_write_uint(stats.dentry_cache_hits);
+            terminal_write_string(" hits, ");
+            terminal_write_uint(stats.dentry_cache_misses);
+            terminal_write_string(" misses\n");
+            terminal_write_string("Shared Blocks: ");
+            terminal_write_uint(stats.shared_blocks);
+            terminal_write_string(" (copy-on-write)\n");
+            terminal_write_string("File Data:     ");
+            terminal_write_uint(stats.data_bytes / 1024);
+            terminal_write_string(" KB\n");
+            terminal_write_string("Storage:       ");
+            block_device_t* disk = stats.persistent ? block_device_find("vda") : NULL;
+            if (disk) {
+                terminal_write_string("vda, ");
+                terminal_write_uint((uint32_t)(disk->block_count * disk->block_size / 1024));
+                terminal_write_string(" KB, ");
+                terminal_write_uint(stats.sync_count);
+                terminal_write_string(" syncs\n");
+                
+                buffer_cache_stats_t cache;
+                buffer_cache_get_stats(&cache);
+                terminal_write_string("Buffer Cache:  ");
+                terminal_write_uint(cache.hits);
+                terminal_write_string(" hits, ");
+                terminal_write_uint(cache.misses);
+                terminal_write_string(" misses, ");
+                terminal_write_uint(cache.dirty_buffers);
+                terminal_write_string(" dirty, ");
+                terminal_write_uint(cache.writebacks);
+                terminal_write_string(" written back\n");
+                terminal_write_string("Batching:      ");
+                terminal_write_uint(cache.readahead_blocks);
+                terminal_write_string(" blocks in ");
+                terminal_write_uint(cache.read_batches);
+                terminal_write_string(" read-ahead requests, ");
+                terminal_write_uint(cache.write_batches);
+                terminal_write_string(" write requests\n");
+            } else {
+                terminal_write_string("memory only (no disk attached)\n");
+            }
+            
+            initrd_info_t initrd;
+            if (initrd_get_info(&initrd)) {
+                terminal_write_string("Initrd:        ");
+                terminal_write_uint(initrd.file_count);
+                terminal_write_string(" files, ");
+                terminal_write_uint((uint32_t)(initrd.data_bytes / 1024));
+                terminal_write_string(" KB read-only at " INITRD_MOUNT_POINT "\n");
+            }
             
             uint32_t usage_percent = ((stats.total_space - stats.free_space) * 100) / stats.total_space;
             terminal_write_string("Usage:         ");
@@ -901,6 +1275,78 @@ static void execute_command(const char* input) {
             terminal_write_string("%\n");
         }
         
+    } else if (string_compare(args[0], "sync") == 0) {
+        if (filesystem_sync()) {
+            terminal_write_string("\nFilesystem synced\n");
+        } else {
+            terminal_set_color(12, 0);
+            terminal_write_string("\nsync: write to disk failed\n");
+            terminal_set_color(7, 0);
+        }
+        
+    } else if (string_compare(args[0], "mount") == 0) {
+        uint32_t count = vfs_get_mount_count();
+        terminal_write_string("\nMOUNT POINT  TYPE      SOURCE  STORAGE  FILES  USED\n");
+        terminal_write_string("-----------  ----      ------  -------  -----  ----\n");
+        
+        for (uint32_t i = 0; i < count; i++) {
+            vfs_mount_info_t mount;
+            if (!vfs_get_mount_info(i, &mount)) continue;
+            
+            terminal_write_string(mount.path);
+            for (uint32_t j = string_length(mount.path); j < 13; j++) {
+                terminal_write_char(' ');
+            }
+            terminal_write_string(mount.type_name);
+            for (uint32_t j = string_length(mount.type_name); j < 10; j++) {
+                terminal_write_char(' ');
+            }
+            terminal_write_string(mount.source);
+            for (uint32_t j = string_length(mount.source); j < 8; j++) {
+                terminal_write_char(' ');
+            }
+            
+            if (!mount.has_stats) {
+                terminal_write_string("-\n");
+                continue;
+            }
+            
+            const char* storage = mount.stats.persistent ? "disk" :
+                                  (mount.stats.total_space > 0) ? "memory" : "none";
+            terminal_write_string(storage);
+            for (uint32_t j = string_length(storage); j < 9; j++) {
+                terminal_write_char(' ');
+            }
+            terminal_write_uint(mount.stats.total_files);
+            terminal_write_string(mount.stats.total_files < 10 ? "      " : "     ");
+            terminal_write_uint((mount.stats.total_space - mount.stats.free_space) / 1024);
+            terminal_write_string(" KB\n");
+        }
+        
+    } else if (string_compare(args[0], "lspci") == 0) {
+        uint32_t count = pci_get_device_count();
+        terminal_write_string("\nBus Slot Fn  Vendor Device Class\n");
+        terminal_write_string("----------------------------------------\n");
+        
+        for (uint32_t i = 0; i < count; i++) {
+            const pci_device_t* device = pci_get_device(i);
+            terminal_write_uint(device->bus);
+            terminal_write_string("   ");
+            terminal_write_uint(device->slot);
+            terminal_write_string(device->slot < 10 ? "    " : "   ");
+            terminal_write_uint(device->function);
+            terminal_write_string("   ");
+            terminal_write_hex(device->vendor_id);
+            terminal_write_string(" ");
+            terminal_write_hex(device->device_id);
+            terminal_write_string(" ");
+            terminal_write_string(pci_get_class_string(device->class_code));
+            terminal_write_string("\n");
+        }
+        
+        terminal_write_uint(count);
+        terminal_write_string(" device(s)\n");
+        
     } else if (string_compare(args[0], "ps") == 0) {
         process_t processes[32];
         uint32_t count = process_list(processes, 32);
@@ -1036,6 +1482,34 @@ static void execute_command(const char* input) {
         terminal_write_uint((uint32_t)uptime);
         terminal_write_string(" seconds\n");
         
+    } else if (string_compare(args[0], "sysbench") == 0) {
+        uint32_t iterations = 100000;
+        if (argc > 1) {
+            int requested;
+            if (!string_to_integer_safe(args[1], &requested) || requested <= 0) {
+                terminal_write_string("\nUsage: sysbench [iterations]\n");
+                terminal_write_string("apollo> ");
+                return;
+            }
+            iterations = (uint32_t)requested;
+        }
+        
+        terminal_write_string("\nSystem Call Benchmark:\n");
+        terminal_write_string("======================\n");
+        terminal_write_string("Path:       SYSCALL/SYSRET (ring 3 -> ring 0)\n");
+        terminal_write_string("Iterations: ");
+        terminal_write_uint(iterations);
+        terminal_write_string("\n");
+        
+        uint64_t cycles = system_call_benchmark(iterations);
+        if (cycles == 0) {
+            terminal_write_string("Error: Cannot start benchmark process.\n");
+        } else {
+            terminal_write_string("Cost:       ");
+            terminal_write_uint((uint32_t)cycles);
+            terminal_write_string(" cycles per call\n");
+        }
+        
     } else if (string_compare(args[0], "calc") == 0) {
         if (argc < 2) {
             terminal_write_string("\nApollo Calculator\n");
@@ -1161,6 +1635,59 @@ static void execute_command(const char* input) {
         terminal_clear();
         terminal_write_string("Returned to shell.\n");
         
+    } else if (string_compare(args[0], "run") == 0) {
+        if (argc < 2) {
+            terminal_write_string("\nUsage: run <program> [arguments]\n");
+        } else {
+            const char* program_argv[MAX_ARGUMENTS];
+            for (uint32_t i = 1; i < argc; i++) {
+                program_argv[i - 1] = args[i];
+            }
+            
+            uint32_t pid = process_create_from_file(args[1], argc - 1, program_argv);
+            if (pid == 0) {
+                terminal_write_string("\nError: Cannot load program '");
+                terminal_write_string(args[1]);
+                terminal_write_string("' (missing, not executable or not ELF64)\n");
+            } else {
+                terminal_write_string("\n");
+                int32_t status = process_run(pid);
+                
+                process_t info;
+                uint32_t pages = 0;
+                if (process_get_info(pid, &info) && info.address_space) {
+                    pages = info.address_space->mapped_pages;
+                }
+                
+                terminal_set_color(8, 0);
+                terminal_write_string("\n[process ");
+                terminal_write_uint(pid);
+                terminal_write_string(" exited with status ");
+                terminal_write_int(status);
+                terminal_write_string(", ");
+                terminal_write_uint(pages);
+                terminal_write_string(" pages touched]\n");
+                terminal_set_color(7, 0);
+                
+                // Forked children run once their parent is done; anything
+                // they fork in turn is reparented to pid and picked up here.
+                uint32_t child;
+                while ((child = process_get_ready_child(pid)) != 0) {
+                    status = process_run(child);
+                    process_terminate(child);
+                    
+                    terminal_set_color(8, 0);
+                    terminal_write_string("[process ");
+                    terminal_write_uint(child);
+                    terminal_write_string(" (forked) exited with status ");
+                    terminal_write_int(status);
+                    terminal_write_string("]\n");
+                    terminal_set_color(7, 0);
+                }
+                process_terminate(pid);
+            }
+        }
+        
     } else if (string_compare(args[0], "reboot") == 0) {
         terminal_write_string("\nRebooting system...\n");
         __asm__ __volatile__("int $0x0");
@@ -0,0 +1,249 @@
+#include "devfs.h"
+#include "vfs.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Vnode 1 is the directory itself; vnode n >= 2 is devfs_nodes[n - 2].
+#define DEVFS_ROOT_ID 1
+#define DEVFS_FIRST_NODE_ID 2
+
+typedef struct {
+    const char* name;
+    const char* content;      // NULL for a sink
+    uint8_t permissions;
+    bool read_only;
+} devfs_node_t;
+
+static const char version_content[] =
+    "Apollo Operating System v1.0\n"
+    "Kernel Build: " __DATE__ " " __TIME__ "\n"
+    "Architecture: x86_64\n"
+    "Compiler: GCC " __VERSION__ "\n"
+    "Features: PAE, Long Mode, SSE, File System, Memory Management\n";
+
+static const devfs_node_t devfs_nodes[] = {
+    {"version", version_content, FS_PERM_READ, true},
+    {"null", NULL, FS_PERM_READ | FS_PERM_WRITE, false},
+};
+
+#define DEVFS_NODE_COUNT (sizeof(devfs_nodes) / sizeof(devfs_nodes[0]))
+
+static uint32_t string_length(const char* str) {
+    uint32_t len = 0;
+    while (str && str[len] != '\0') len++;
+    return len;
+}
+
+static void string_copy(char* dest, const char* src) {
+    while (*src) {
+        *dest++ = *src++;
+    }
+    *dest = '\0';
+}
+
+static int string_compare(const char* str1, const char* str2) {
+    while (*str1 && *str2 && *str1 == *str2) {
+        str1++;
+        str2++;
+    }
+    return *str1 - *str2;
+}
+
+static void memory_copy(void* dest, const void* src, uint32_t size) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (uint32_t i = 0; i < size; i++) {
+        d[i] = s[i];
+    }
+}
+
+static const devfs_node_t* node_of(uint32_t vnode) {
+    return &devfs_nodes[vnode - DEVFS_FIRST_NODE_ID];
+}
+
+static uint32_t content_size(const devfs_node_t* node) {
+    return string_length(node->content);
+}
+
+static uint32_t total_content_size(void) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < DEVFS_NODE_COUNT; i++) {
+        total += content_size(&devfs_nodes[i]);
+    }
+    return total;
+}
+
+static bool devfs_mount(vfs_superblock_t* superblock, const char* source) {
+    (void)source;
+    superblock->private_data = NULL;
+    return true;
+}
+
+static uint32_t devfs_lookup(vfs_superblock_t* superblock, const char* path) {
+    (void)superblock;
+
+    if (string_compare(path, "/") == 0) return DEVFS_ROOT_ID;
+
+    for (uint32_t i = 0; i < DEVFS_NODE_COUNT; i++) {
+        if (string_compare(path + 1, devfs_nodes[i].name) == 0) {
+            return DEVFS_FIRST_NODE_ID + i;
+        }
+    }
+    return 0;
+}
+
+static bool devfs_get_info(vfs_superblock_t* superblock, uint32_t vnode, fs_file_info_t* info) {
+    (void)superblock;
+
+    if (vnode == DEVFS_ROOT_ID) {
+        string_copy(info->name, "/");
+        info->type = FS_TYPE_DIRECTORY;
+        info->size = 0;
+        info->permissions = FS_PERM_READ | FS_PERM_EXECUTE;
+        info->read_only = true;
+        info->tree_bytes = total_content_size();
+        info->tree_nodes = DEVFS_NODE_COUNT;
+    } else {
+        const devfs_node_t* node = node_of(vnode);
+        string_copy(info->name, node->name);
+        info->type = FS_TYPE_FILE;
+        info->size = content_size(node);
+        info->permissions = node->permissions;
+        info->read_only = node->read_only;
+        info->tree_bytes = 0;
+        info->tree_nodes = 0;
+    }
+
+    info->created_time = 0;
+    info->modified_time = 0;
+    info->parent_id = DEVFS_ROOT_ID;
+    for (uint32_t i = 0; i < FS_INLINE_EXTENTS; i++) {
+        info->extents[i].start_block = 0;
+        info->extents[i].block_count = 0;
+    }
+    info->extent_count = 0;
+    info->indirect_block = 0;
+    info->is_valid = true;
+    return true;
+}
+
+static bool devfs_create(vfs_superblock_t* superblock, const char* path, fs_file_type_t type) {
+    (void)superblock;
+    (void)path;
+    (void)type;
+    return false;
+}
+
+static bool devfs_remove(vfs_superblock_t* superblock, const char* path) {
+    (void)superblock;
+    (void)path;
+    return false;
+}
+
+static uint32_t devfs_list(vfs_superblock_t* superblock, const char* path,
+                           fs_dir_entry_t* entries, uint32_t max_entries) {
+    (void)superblock;
+
+    if (string_compare(path, "/") != 0) return 0;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < DEVFS_NODE_COUNT && count < max_entries; i++) {
+        string_copy(entries[count].name, devfs_nodes[i].name);
+        entries[count].type = FS_TYPE_FILE;
+        entries[count].size = content_size(&devfs_nodes[i]);
+        entries[count].permissions = devfs_nodes[i].permissions;
+        count++;
+    }
+    return count;
+}
+
+static uint32_t devfs_first_child(vfs_superblock_t* superblock, uint32_t directory) {
+    (void)superblock;
+    return directory == DEVFS_ROOT_ID ? DEVFS_FIRST_NODE_ID : 0;
+}
+
+static uint32_t devfs_next_sibling(vfs_superblock_t* superblock, uint32_t vnode) {
+    (void)superblock;
+    if (vnode < DEVFS_FIRST_NODE_ID || vnode + 1 >= DEVFS_FIRST_NODE_ID + DEVFS_NODE_COUNT) return 0;
+    return vnode + 1;
+}
+
+static bool devfs_get_stats(vfs_superblock_t* superblock, fs_stats_t* stats) {
+    (void)superblock;
+
+    stats->total_files = DEVFS_NODE_COUNT;
+    stats->total_directories = 1;
+    stats->free_blocks = 0;
+    stats->used_blocks = 0;
+    stats->total_space = 0;
+    stats->free_space = 0;
+    stats->dentry_cache_hits = 0;
+    stats->dentry_cache_misses = 0;
+    stats->sync_count = 0;
+    stats->shared_blocks = 0;
+    stats->data_bytes = total_content_size();
+    stats->persistent = false;
+    return true;
+}
+
+static uint32_t devfs_read(fs_file_handle_t* handle, void* buffer, uint32_t size, uint32_t offset) {
+    const devfs_node_t* node = node_of(handle->file_id);
+    uint32_t total = content_size(node);
+    if (offset >= total) return 0;
+
+    if (size > total - offset) size = total - offset;
+    memory_copy(buffer, node->content + offset, size);
+    return size;
+}
+
+static uint32_t devfs_write(fs_file_handle_t* handle, const void* buffer, uint32_t size, uint32_t offset) {
+    (void)buffer;
+    (void)offset;
+    return node_of(handle->file_id)->content ? 0 : size;
+}
+
+// The content is a constant string, so a mapping is the string itself.
+static bool devfs_map(fs_file_handle_t* handle, uint32_t offset, const void** data, uint32_t* length) {
+    const devfs_node_t* node = node_of(handle->file_id);
+    uint32_t total = content_size(node);
+    if (offset >= total) return false;
+
+    *data = node->content + offset;
+    *length = total - offset;
+    return true;
+}
+
+static bool devfs_truncate(fs_file_handle_t* handle, uint32_t size) {
+    (void)size;
+    return node_of(handle->file_id)->content == NULL;
+}
+
+static const vfs_superblock_ops_t devfs_superblock_ops = {
+    .lookup = devfs_lookup,
+    .get_info = devfs_get_info,
+    .create = devfs_create,
+    .remove = devfs_remove,
+    .list = devfs_list,
+    .first_child = devfs_first_child,
+    .next_sibling = devfs_next_sibling,
+    .get_stats = devfs_get_stats,
+};
+
+static const vfs_vnode_ops_t devfs_vnode_ops = {
+    .read = devfs_read,
+    .write = devfs_write,
+    .map = devfs_map,
+    .truncate = devfs_truncate,
+};
+
+static const vfs_filesystem_type_t devfs_type = {
+    .name = "devfs",
+    .mount = devfs_mount,
+    .superblock_ops = &devfs_superblock_ops,
+    .vnode_ops = &devfs_vnode_ops,
+};
+
+void devfs_register(void) {
+    vfs_register_filesystem(&devfs_type);
+}
@@ -1,20 +1,41 @@
 #include "filesystem.h"
+#include "vfs.h"
+#include "apollofs.h"
+#include "devfs.h"
+#include "text_index.h"
 #include "heap_allocator.h"
-#include "time_keeper.h"
 #include <stdint.h>
 #include <stdbool.h>
 
+#define VFS_ROOT_TYPE "apollofs"
+#define FS_MAX_OPEN_FILE_OBJECTS 128
+
+// One per filesystem_fd_open. Descriptors made by dup or inherited across
+// fork point at the same entry and so share its position; the last close
+// releases the handle.
+typedef struct {
+    fs_file_handle_t handle;
+    uint32_t references;
+} fs_open_file_t;
+
 typedef struct {
-    fs_file_info_t files[FS_MAX_FILES];
-    uint8_t* data_blocks[FS_MAX_BLOCKS];
-    bool block_allocated[FS_MAX_BLOCKS];
-    uint32_t current_directory_id;
+    char path[FS_MAX_PATH_LENGTH];
+    uint32_t path_length;          // 0 for the root mount
+    char source[VFS_SOURCE_LENGTH];
+    vfs_superblock_t superblock;
+} vfs_mount_t;
+
+typedef struct {
+    const vfs_filesystem_type_t* types[VFS_MAX_FILESYSTEM_TYPES];
+    uint32_t type_count;
+    vfs_mount_t mounts[VFS_MAX_MOUNTS];
+    uint32_t mount_count;
+    char current_directory[FS_MAX_PATH_LENGTH];
+    fs_open_file_t open_files[FS_MAX_OPEN_FILE_OBJECTS];
     bool is_initialized;
-    uint32_t next_file_id;
-    uint32_t system_time;
-} filesystem_state_t;
+} vfs_state_t;
 
-static filesystem_state_t fs_state = {0};
+static vfs_state_t vfs_state = {0};
 
 static uint32_t string_length(const char* str) {
     uint32_t len = 0;
@@ -37,705 +58,972 @@ static int string_compare(const char* str1, const char* str2) {
     return *str1 - *str2;
 }
 
-static void string_append(char* dest, const char* src) {
-    while (*dest) dest++;
-    while (*src) *dest++ = *src++;
-    *dest = '\0';
-}
-
-static void memory_copy(void* dest, const void* src, uint32_t size) {
-    uint8_t* d = (uint8_t*)dest;
-    const uint8_t* s = (const uint8_t*)src;
-    for (uint32_t i = 0; i < size; i++) {
-        d[i] = s[i];
+static bool string_copy_bounded(char* dest, const char* src, uint32_t dest_size) {
+    uint32_t len = string_length(src);
+    if (len >= dest_size) return false;
+    
+    for (uint32_t i = 0; i <= len; i++) {
+        dest[i] = src[i];
     }
+    return true;
 }
 
-static void memory_set(void* dest, uint8_t value, uint32_t size) {
-    uint8_t* d = (uint8_t*)dest;
-    for (uint32_t i = 0; i < size; i++) {
-        d[i] = value;
+// Joins path onto the current directory and folds ".", ".." and repeated
+// slashes, giving the absolute path mounts are matched against. ".." is
+// resolved here by name, so it climbs out of a mount like any directory.
+static bool normalize_path(const char* path, char* normalized) {
+    if (!path) path = "";
+    
+    uint32_t length;
+    if (path[0] == '/') {
+        length = 0;
+    } else {
+        string_copy(normalized, vfs_state.current_directory);
+        length = string_length(normalized);
+        if (length == 1) length = 0;   // Root; every component adds its own slash
     }
-}
-
-static uint32_t get_current_time(void) {
-    return ++fs_state.system_time;
-}
-
-static uint32_t allocate_block(void) {
-    for (uint32_t i = 1; i < FS_MAX_BLOCKS; i++) {
-        if (!fs_state.block_allocated[i]) {
-            fs_state.block_allocated[i] = true;
-            if (!fs_state.data_blocks[i]) {
-                fs_state.data_blocks[i] = apollo_allocate_memory(FS_BLOCK_SIZE);
-                if (!fs_state.data_blocks[i]) {
-                    fs_state.block_allocated[i] = false;
-                    return 0;
-                }
-                memory_set(fs_state.data_blocks[i], 0, FS_BLOCK_SIZE);
+    
+    while (*path) {
+        while (*path == '/') path++;
+        if (*path == '\0') break;
+        
+        uint32_t component = 0;
+        while (path[component] && path[component] != '/') component++;
+        
+        if (component == 1 && path[0] == '.') {
+        } else if (component == 2 && path[0] == '.' && path[1] == '.') {
+            while (length > 0 && normalized[length - 1] != '/') length--;
+            if (length > 0) length--;
+        } else {
+            if (component >= FS_MAX_FILENAME_LENGTH) return false;
+            if (length + 1 + component >= FS_MAX_PATH_LENGTH) return false;
+            
+            normalized[length++] = '/';
+            for (uint32_t i = 0; i < component; i++) {
+                normalized[length++] = path[i];
             }
-            return i;
         }
+        path += component;
     }
-    return 0; 
-}
-
-static void free_block(uint32_t block_id) {
-    if (block_id > 0 && block_id < FS_MAX_BLOCKS && fs_state.block_allocated[block_id]) {
-        fs_state.block_allocated[block_id] = false;
-        if (fs_state.data_blocks[block_id]) {
-            memory_set(fs_state.data_blocks[block_id], 0, FS_BLOCK_SIZE);
-        }
+    
+    if (length == 0) {
+        normalized[length++] = '/';
     }
+    normalized[length] = '\0';
+    return true;
 }
 
-static uint32_t allocate_file_id(void) {
-    for (uint32_t i = 2; i < FS_MAX_FILES; i++) {
-        if (!fs_state.files[i].is_valid) {
-            return i;
+// Picks the mount with the longest prefix of a normalized path and returns
+// the rest of the path as seen from that mount's root.
+static vfs_mount_t* find_mount(const char* path, const char** relative) {
+    vfs_mount_t* best = NULL;
+    
+    for (uint32_t i = 0; i < vfs_state.mount_count; i++) {
+        vfs_mount_t* mount = &vfs_state.mounts[i];
+        if (best && mount->path_length <= best->path_length) continue;
+        
+        bool matches = true;
+        for (uint32_t c = 0; c < mount->path_length; c++) {
+            if (path[c] != mount->path[c]) {
+                matches = false;
+                break;
+            }
+        }
+        
+        char next = path[mount->path_length];
+        if (matches && (next == '\0' || next == '/')) {
+            best = mount;
         }
     }
-    return 0;
+    
+    if (best) {
+        *relative = path + best->path_length;
+        if (**relative == '\0') *relative = "/";
+    }
+    return best;
 }
 
-static void extract_filename(const char* path, char* filename) {
-    const char* last_slash = path;
-    const char* current = path;
+// Resolves path to its mount, the path within it and the backend vnode.
+// Returns NULL if the path is malformed or names nothing.
+static vfs_mount_t* resolve(const char* path, char* normalized, const char** relative,
+                            uint32_t* vnode) {
+    if (!normalize_path(path, normalized)) return NULL;
     
-    while (*current) {
-        if (*current == '/') {
-            last_slash = current + 1;
-        }
-        current++;
-    }
+    vfs_mount_t* mount = find_mount(normalized, relative);
+    if (!mount) return NULL;
     
-    string_copy(filename, last_slash);
+    *vnode = mount->superblock.type->superblock_ops->lookup(&mount->superblock, *relative);
+    return (*vnode != 0) ? mount : NULL;
 }
 
-static void extract_directory(const char* path, char* directory) {
-    const char* last_slash = NULL;
-    const char* current = path;
+static bool resolve_info(const char* path, fs_file_info_t* info) {
+    char normalized[FS_MAX_PATH_LENGTH];
+    const char* relative;
+    uint32_t vnode;
     
-    while (*current) {
-        if (*current == '/') {
-            last_slash = current;
-        }
-        current++;
-    }
+    vfs_mount_t* mount = resolve(path, normalized, &relative, &vnode);
+    if (!mount) return false;
     
-    if (last_slash) {
-        uint32_t len = last_slash - path;
-        for (uint32_t i = 0; i < len && i < FS_MAX_PATH_LENGTH - 1; i++) {
-            directory[i] = path[i];
-        }
-        directory[len] = '\0';
-        if (len == 0) {
-            string_copy(directory, "/");
-        }
-    } else {
-        string_copy(directory, "/");
+    return mount->superblock.type->superblock_ops->get_info(&mount->superblock, vnode, info);
+}
+
+static bool is_mount_point(const char* normalized) {
+    for (uint32_t i = 0; i < vfs_state.mount_count; i++) {
+        if (string_compare(vfs_state.mounts[i].path, normalized) == 0) return true;
     }
+    return false;
 }
 
-static uint32_t find_file_in_directory(uint32_t dir_id, const char* name) {
-    for (uint32_t i = 1; i < FS_MAX_FILES; i++) {
-        if (fs_state.files[i].is_valid && 
-            fs_state.files[i].parent_id == dir_id &&
-            string_compare(fs_state.files[i].name, name) == 0) {
-            return i;
-        }
+static const vfs_filesystem_type_t* find_filesystem_type(const char* name) {
+    for (uint32_t i = 0; i < vfs_state.type_count; i++) {
+        if (string_compare(vfs_state.types[i]->name, name) == 0) return vfs_state.types[i];
     }
-    return 0;
+    return NULL;
 }
 
-static uint32_t resolve_path_to_id(const char* path) {
-    if (!path || string_length(path) == 0) {
-        return fs_state.current_directory_id;
+bool vfs_register_filesystem(const vfs_filesystem_type_t* type) {
+    if (!type || !type->name || !type->mount || vfs_state.type_count >= VFS_MAX_FILESYSTEM_TYPES) {
+        return false;
     }
+    if (find_filesystem_type(type->name)) return false;
     
-    uint32_t current_id;
+    vfs_state.types[vfs_state.type_count++] = type;
+    return true;
+}
+
+bool vfs_mount(const char* type_name, const char* source, const char* path) {
+    if (!type_name || vfs_state.mount_count >= VFS_MAX_MOUNTS) return false;
+    if (source && string_length(source) >= VFS_SOURCE_LENGTH) return false;
     
-    if (path[0] == '/') {
-        current_id = 1;
-        path++;
-    } else {
-        current_id = fs_state.current_directory_id;
-    }
+    const vfs_filesystem_type_t* type = find_filesystem_type(type_name);
+    if (!type) return false;
     
-    if (string_length(path) == 0) {
-        return current_id;
-    }
+    char normalized[FS_MAX_PATH_LENGTH];
+    if (!normalize_path(path, normalized) || is_mount_point(normalized)) return false;
     
-    char component[FS_MAX_FILENAME_LENGTH];
-    uint32_t comp_pos = 0;
+    bool is_root = string_compare(normalized, "/") == 0;
+    if (is_root != (vfs_state.mount_count == 0)) return false;
     
-    while (*path) {
-        if (*path == '/') {
-            if (comp_pos > 0) {
-                component[comp_pos] = '\0';
-                
-                if (string_compare(component, ".") == 0) {
-                } else if (string_compare(component, "..") == 0) {
-                    if (current_id != 1) {
-                        current_id = fs_state.files[current_id].parent_id;
-                    }
-                } else {
-                    uint32_t found_id = find_file_in_directory(current_id, component);
-                    if (found_id == 0) {
-                        return 0;
-                    }
-                    current_id = found_id;
-                }
-                comp_pos = 0;
-            }
-        } else {
-            if (comp_pos < FS_MAX_FILENAME_LENGTH - 1) {
-                component[comp_pos++] = *path;
-            }
-        }
-        path++;
+    if (!is_root) {
+        fs_file_info_t info;
+        if (!resolve_info(normalized, &info) || info.type != FS_TYPE_DIRECTORY) return false;
     }
     
-    if (comp_pos > 0) {
-        component[comp_pos] = '\0';
-        
-        if (string_compare(component, ".") == 0) {
-        } else if (string_compare(component, "..") == 0) {
-            if (current_id != 1) {
-                current_id = fs_state.files[current_id].parent_id;
-            }
-        } else {
-            uint32_t found_id = find_file_in_directory(current_id, component);
-            if (found_id == 0) {
-                return 0;
-            }
-            current_id = found_id;
-        }
-    }
+    vfs_mount_t* mount = &vfs_state.mounts[vfs_state.mount_count];
+    string_copy(mount->path, normalized);
+    mount->path_length = is_root ? 0 : string_length(normalized);
+    string_copy(mount->source, source ? source : "none");
+    mount->superblock.type = type;
+    mount->superblock.private_data = NULL;
     
-    return current_id;
-}
-
-static void write_file_content(uint32_t file_id, const char* content) {
-    if (file_id == 0 || !fs_state.files[file_id].is_valid || 
-        fs_state.files[file_id].type != FS_TYPE_FILE) {
-        return;
-    }
-    
-    uint32_t content_len = string_length(content);
-    if (content_len > FS_BLOCK_SIZE) {
-        content_len = FS_BLOCK_SIZE;
-    }
-    
-    if (fs_state.files[file_id].data_block != 0) {
-        memory_copy(fs_state.data_blocks[fs_state.files[file_id].data_block], 
-                   content, content_len);
-        fs_state.files[file_id].size = content_len;
-        fs_state.files[file_id].modified_time = get_current_time();
-    }
-}
-
-static void create_system_files(void) {
-    uint32_t readme_id = find_file_in_directory(
-        find_file_in_directory(1, "home"), "readme.txt");
-    if (readme_id != 0) {
-        const char* readme_content = 
-            "Welcome to Apollo Operating System!\n\n"
-            "This is a fully functional x86_64 kernel with:\n"
-            "- Complete file system implementation\n"
-            "- Text editor with real file I/O\n"
-            "- Memory management\n"
-            "- Process management\n"
-            "- Hardware abstraction layer\n\n"
-            "Commands to try:\n"
-            "- ls        List files\n"
-            "- cd        Change directory\n"
-            "- cat       View file contents\n"
-            "- edit      Edit files\n"
-            "- mkdir     Create directories\n"
-            "- touch     Create files\n"
-            "- cp        Copy files\n"
-            "- mv        Move files\n"
-            "- find      Search files\n"
-            "- grep      Search text\n"
-            "- tree      Directory structure\n"
-            "- help      All commands\n\n"
-            "Apollo Kernel v1.0 - Built with modern C and Assembly\n";
-        write_file_content(readme_id, readme_content);
-    }
-    
-    uint32_t sample_id = find_file_in_directory(
-        find_file_in_directory(1, "home"), "sample.c");
-    if (sample_id != 0) {
-        const char* sample_content = 
-            "/*\n"
-            " * Apollo Operating System\n"
-            " */\n\n"
-            "#include <stdio.h>\n"
-            "#include <stdlib.h>\n\n"
-            "int main(void) {\n"
-            "    printf(\"Hello from Apollo OS!\\n\");\n"
-            "    printf(\"This kernel supports:\\n\");\n"
-            "    printf(\"- Full file system\\n\");\n"
-            "    printf(\"- Memory management\\n\");\n"
-            "    printf(\"- Process management\\n\");\n"
-            "    printf(\"- Hardware drivers\\n\");\n"
-            "    \n"
-            "    // Example of file operations\n"
-            "    FILE* fp = fopen(\"/tmp/output.txt\", \"w\");\n"
-            "    if (fp) {\n"
-            "        fprintf(fp, \"File I/O works!\\n\");\n"
-            "        fclose(fp);\n"
-            "    }\n"
-            "    \n"
-            "    return 0;\n"
-            "}\n\n"
-            "/*\n"
-            " * Compile with: gcc -o sample sample.c\n"
-            " * Run with: ./sample\n"
-            " */\n";
-        write_file_content(sample_id, sample_content);
-    }
-    
-    uint32_t config_id = find_file_in_directory(
-        find_file_in_directory(1, "etc"), "config.cfg");
-    if (config_id != 0) {
-        const char* config_content = 
-            "# Apollo Operating System Configuration\n"
-            "# This file contains system configuration settings\n\n"
-            "[system]\n"
-            "kernel_version=1.0\n"
-            "architecture=x86_64\n"
-            "memory_model=paging\n"
-            "scheduler=round_robin\n\n"
-            "[filesystem]\n"
-            "type=apollo_fs\n"
-            "block_size=512\n"
-            "max_files=256\n"
-            "max_directories=64\n\n"
-            "[display]\n"
-            "mode=vga_text\n"
-            "width=80\n"
-            "height=25\n"
-            "colors=16\n\n"
-            "[input]\n"
-            "keyboard=ps2\n"
-            "mouse=disabled\n\n"
-            "[network]\n"
-            "enabled=false\n"
-            "driver=none\n\n"
-            "[debug]\n"
-            "level=info\n"
-            "serial_output=true\n"
-            "log_file=/var/log/kernel.log\n";
-        write_file_content(config_id, config_content);
-    }
-    
-    uint32_t bin_dir = find_file_in_directory(1, "bin");
-    if (bin_dir != 0) {
-        if (filesystem_create_file("/bin/hello.sh")) {
-            uint32_t script_id = find_file_in_directory(bin_dir, "hello.sh");
-            if (script_id != 0) {
-                const char* script_content = 
-                    "#!/bin/sh\n"
-                    "# Apollo OS Hello Script\n"
-                    "echo \"Hello from Apollo Operating System!\"\n"
-                    "echo \"Current directory: $(pwd)\"\n"
-                    "echo \"Available commands:\"\n"
-                    "ls /bin\n"
-                    "echo \"System information:\"\n"
-                    "sysinfo\n"
-                    "echo \"File system usage:\"\n"
-                    "df\n";
-                write_file_content(script_id, script_content);
-                fs_state.files[script_id].permissions |= FS_PERM_EXECUTE;
-            }
-        }
-    }
+    if (!type->mount(&mount->superblock, source)) return false;
     
-    uint32_t dev_dir = find_file_in_directory(1, "dev");
-    if (dev_dir != 0) {
-        if (filesystem_create_file("/dev/version")) {
-            uint32_t version_id = find_file_in_directory(dev_dir, "version");
-            if (version_id != 0) {
-                const char* version_content = 
-                    "Apollo Operating System v1.0\n"
-                    "Kernel Build: " __DATE__ " " __TIME__ "\n"
-                    "Architecture: x86_64\n"
-                    "Compiler: GCC " __VERSION__ "\n"
-                    "Features: PAE, Long Mode, SSE, File System, Memory Management\n";
-                write_file_content(version_id, version_content);
-            }
-        }
-    }
-    
-    uint32_t tmp_dir = find_file_in_directory(1, "tmp");
-    if (tmp_dir != 0) {
-        if (filesystem_create_file("/tmp/notes.txt")) {
-            uint32_t notes_id = find_file_in_directory(tmp_dir, "notes.txt");
-            if (notes_id != 0) {
-                const char* notes_content = 
-                    "Apollo OS Development Notes\n"
-                    "==========================\n\n"
-                    "TODO List:\n"
-                    "- [x] Basic kernel boot\n"
-                    "- [x] Memory management\n"
-                    "- [x] VGA text mode driver\n"
-                    "- [x] PS/2 keyboard driver\n"
-                    "- [x] File system implementation\n"
-                    "- [x] Text editor\n"
-                    "- [x] Shell commands\n"
-                    "- [ ] Network stack\n"
-                    "- [ ] GUI framework\n"
-                    "- [ ] Audio driver\n\n"
-                    "Performance Notes:\n"
-                    "- Boot time: ~2 seconds\n"
-                    "- Memory usage: ~2MB kernel\n"
-                    "- File I/O: In-memory blocks\n"
-                    "- Keyboard latency: <1ms\n\n"
-                    "Architecture:\n"
-                    "- Monolithic kernel design\n"
-                    "- Modular component system\n"
-                    "- Hardware abstraction layer\n"
-                    "- Clean separation of concerns\n";
-                write_file_content(notes_id, notes_content);
-            }
-        }
-    }
+    vfs_state.mount_count++;
+    return true;
 }
 
-void filesystem_initialize(void) {
-    if (fs_state.is_initialized) return;
+uint32_t vfs_get_mount_count(void) {
+    return vfs_state.mount_count;
+}
+
+bool vfs_get_mount_info(uint32_t index, vfs_mount_info_t* info) {
+    if (index >= vfs_state.mount_count || !info) return false;
     
-    for (uint32_t i = 0; i < FS_MAX_FILES; i++) {
-        fs_state.files[i].is_valid = false;
-    }
+    vfs_mount_t* mount = &vfs_state.mounts[index];
+    string_copy(info->path, mount->path);
+    string_copy(info->source, mount->source);
+    info->type_name = mount->superblock.type->name;
     
-    for (uint32_t i = 0; i < FS_MAX_BLOCKS; i++) {
-        fs_state.block_allocated[i] = false;
-        fs_state.data_blocks[i] = NULL;
-    }
+    const vfs_superblock_ops_t* ops = mount->superblock.type->superblock_ops;
+    info->has_stats = ops->get_stats && ops->get_stats(&mount->superblock, &info->stats);
+    return true;
+}
+
+// The root lives on the disk when there is one. /tmp is always memory
+// backed, since nothing written there needs to survive a reboot, and /dev
+// holds synthetic files with no storage at all. Missing mount points are
+// created on the root first so an empty root still gets both.
+void filesystem_initialize(void) {
+    if (vfs_state.is_initialized) return;
     
-    fs_state.system_time = 1000;
+    apollofs_register();
+    devfs_register();
     
-    fs_state.files[1].is_valid = true;
-    string_copy(fs_state.files[1].name, "/");
-    fs_state.files[1].type = FS_TYPE_DIRECTORY;
-    fs_state.files[1].size = 0;
-    fs_state.files[1].created_time = get_current_time();
-    fs_state.files[1].modified_time = fs_state.files[1].created_time;
-    fs_state.files[1].permissions = FS_PERM_READ | FS_PERM_WRITE | FS_PERM_EXECUTE;
-    fs_state.files[1].parent_id = 1;
-    fs_state.files[1].data_block = 0;
+    string_copy(vfs_state.current_directory, "/");
+    if (!vfs_mount(VFS_ROOT_TYPE, APOLLOFS_DEVICE_NAME, "/")) return;
     
-    fs_state.current_directory_id = 1;
-    fs_state.next_file_id = 2;
-    fs_state.is_initialized = true;
+    vfs_state.is_initialized = true;
     
-    filesystem_create_directory("/home");
-    filesystem_create_directory("/bin");
-    filesystem_create_directory("/etc");
     filesystem_create_directory("/tmp");
-    filesystem_create_directory("/dev");
-    filesystem_create_directory("/var");
-    filesystem_create_directory("/var/log");
-    filesystem_create_directory("/usr");
-    filesystem_create_directory("/usr/bin");
+    vfs_mount("tmpfs", NULL, "/tmp");
     
-    filesystem_create_file("/home/readme.txt");
-    filesystem_create_file("/home/sample.c");
-    filesystem_create_file("/etc/config.cfg");
+    filesystem_create_directory("/dev");
+    vfs_mount("devfs", NULL, "/dev");
     
-    create_system_files();
+    filesystem_sync();
 }
 
-bool filesystem_create_directory(const char* path) {
-    if (!path || string_length(path) == 0) return false;
-    
-    char parent_path[FS_MAX_PATH_LENGTH];
-    char dirname[FS_MAX_FILENAME_LENGTH];
-    
-    extract_directory(path, parent_path);
-    extract_filename(path, dirname);
-    
-    uint32_t parent_id = resolve_path_to_id(parent_path);
-    if (parent_id == 0 || fs_state.files[parent_id].type != FS_TYPE_DIRECTORY) {
-        return false;
+bool filesystem_sync(void) {
+    bool synced = true;
+    
+    for (uint32_t i = 0; i < vfs_state.mount_count; i++) {
+        vfs_superblock_t* superblock = &vfs_state.mounts[i].superblock;
+        if (superblock->type->superblock_ops->sync &&
+            !superblock->type->superblock_ops->sync(superblock)) {
+            synced = false;
+        }
     }
+    return synced;
+}
+
+static bool create_node(const char* path, fs_file_type_t type) {
+    char normalized[FS_MAX_PATH_LENGTH];
+    const char* relative;
     
-    if (find_file_in_directory(parent_id, dirname) != 0) {
-        return false;
-    }
+    if (!path || string_length(path) == 0 || !normalize_path(path, normalized)) return false;
     
-    uint32_t new_id = allocate_file_id();
-    if (new_id == 0) return false;
+    vfs_mount_t* mount = find_mount(normalized, &relative);
+    if (!mount) return false;
     
-    fs_state.files[new_id].is_valid = true;
-    string_copy(fs_state.files[new_id].name, dirname);
-    fs_state.files[new_id].type = FS_TYPE_DIRECTORY;
-    fs_state.files[new_id].size = 0;
-    fs_state.files[new_id].created_time = get_current_time();
-    fs_state.files[new_id].modified_time = fs_state.files[new_id].created_time;
-    fs_state.files[new_id].permissions = FS_PERM_READ | FS_PERM_WRITE | FS_PERM_EXECUTE;
-    fs_state.files[new_id].parent_id = parent_id;
-    fs_state.files[new_id].data_block = 0;
+    const vfs_superblock_ops_t* ops = mount->superblock.type->superblock_ops;
+    if (!ops->create(&mount->superblock, relative, type)) return false;
     
+    if (type == FS_TYPE_FILE) {
+        text_index_file_created(&mount->superblock, ops->lookup(&mount->superblock, relative));
+    }
     return true;
 }
 
+bool filesystem_create_directory(const char* path) {
+    return create_node(path, FS_TYPE_DIRECTORY);
+}
+
 bool filesystem_create_file(const char* path) {
-    if (!path || string_length(path) == 0) return false;
-    
-    char parent_path[FS_MAX_PATH_LENGTH];
-    char filename[FS_MAX_FILENAME_LENGTH];
-    
-    extract_directory(path, parent_path);
-    extract_filename(path, filename);
-    
-    uint32_t parent_id = resolve_path_to_id(parent_path);
-    if (parent_id == 0 || fs_state.files[parent_id].type != FS_TYPE_DIRECTORY) {
-        return false;
-    }
+    return create_node(path, FS_TYPE_FILE);
+}
+
+static bool attach_node(const char* path, fs_file_type_t type, const void* data, uint32_t size,
+                        uint8_t permissions) {
+    char normalized[FS_MAX_PATH_LENGTH];
+    const char* relative;
     
-    if (find_file_in_directory(parent_id, filename) != 0) {
-        return false;
-    }
+    if (!path || string_length(path) == 0 || !normalize_path(path, normalized)) return false;
     
-    uint32_t new_id = allocate_file_id();
-    if (new_id == 0) return false;
+    vfs_mount_t* mount = find_mount(normalized, &relative);
+    if (!mount || !mount->superblock.type->superblock_ops->attach) return false;
     
-    uint32_t block_id = allocate_block();
-    if (block_id == 0) {
-        return false;
-    }
-    
-    fs_state.files[new_id].is_valid = true;
-    string_copy(fs_state.files[new_id].name, filename);
-    fs_state.files[new_id].type = FS_TYPE_FILE;
-    fs_state.files[new_id].size = 0;
-    fs_state.files[new_id].created_time = get_current_time();
-    fs_state.files[new_id].modified_time = fs_state.files[new_id].created_time;
-    fs_state.files[new_id].permissions = FS_PERM_READ | FS_PERM_WRITE;
-    fs_state.files[new_id].parent_id = parent_id;
-    fs_state.files[new_id].data_block = block_id;
+    return mount->superblock.type->superblock_ops->attach(&mount->superblock, relative, type,
+                                                           data, size, permissions);
+}
+
+bool filesystem_attach_directory(const char* path) {
+    return attach_node(path, FS_TYPE_DIRECTORY, NULL, 0, FS_PERM_READ | FS_PERM_EXECUTE);
+}
+
+bool filesystem_attach_file(const char* path, const void* data, uint32_t size, uint8_t permissions) {
+    if (!data && size > 0) return false;
     
-    return true;
+    return attach_node(path, FS_TYPE_FILE, data, size, permissions);
 }
 
 bool filesystem_delete_file(const char* path) {
-    uint32_t file_id = resolve_path_to_id(path);
-    if (file_id == 0 || file_id == 1) return false;
+    char normalized[FS_MAX_PATH_LENGTH];
+    const char* relative;
     
-    if (fs_state.files[file_id].type == FS_TYPE_DIRECTORY) {
-        for (uint32_t i = 1; i < FS_MAX_FILES; i++) {
-            if (fs_state.files[i].is_valid && fs_state.files[i].parent_id == file_id) {
-                return false;
-            }
-        }
-    }
+    if (!normalize_path(path, normalized) || is_mount_point(normalized)) return false;
     
-    if (fs_state.files[file_id].type == FS_TYPE_FILE && fs_state.files[file_id].data_block != 0) {
-        free_block(fs_state.files[file_id].data_block);
-    }
+    vfs_mount_t* mount = find_mount(normalized, &relative);
+    if (!mount) return false;
     
-    fs_state.files[file_id].is_valid = false;
+    const vfs_superblock_ops_t* ops = mount->superblock.type->superblock_ops;
+    uint32_t vnode = ops->lookup(&mount->superblock, relative);
+    if (!ops->remove(&mount->superblock, relative)) return false;
     
+    text_index_file_removed(&mount->superblock, vnode);
     return true;
 }
 
 bool filesystem_change_directory(const char* path) {
-    uint32_t dir_id = resolve_path_to_id(path);
-    if (dir_id == 0 || fs_state.files[dir_id].type != FS_TYPE_DIRECTORY) {
+    char normalized[FS_MAX_PATH_LENGTH];
+    if (!normalize_path(path, normalized)) return false;
+    
+    fs_file_info_t info;
+    if (!resolve_info(normalized, &info) || info.type != FS_TYPE_DIRECTORY) {
         return false;
     }
     
-    fs_state.current_directory_id = dir_id;
+    string_copy(vfs_state.current_directory, normalized);
     return true;
 }
 
 bool filesystem_get_current_directory(char* buffer, uint32_t buffer_size) {
     if (!buffer || buffer_size == 0) return false;
     
-    uint32_t current_id = fs_state.current_directory_id;
+    return string_copy_bounded(buffer, vfs_state.current_directory, buffer_size);
+}
+
+uint32_t filesystem_list_directory(const char* path, fs_dir_entry_t* entries, uint32_t max_entries) {
+    char normalized[FS_MAX_PATH_LENGTH];
+    const char* relative;
+    
+    if (!entries || !normalize_path(path, normalized)) return 0;
+    
+    vfs_mount_t* mount = find_mount(normalized, &relative);
+    if (!mount) return 0;
     
-    if (current_id == 1) {
-        if (buffer_size > 1) {
-            string_copy(buffer, "/");
-            return true;
+    uint32_t count = mount->superblock.type->superblock_ops->list(&mount->superblock, relative,
+                                                                  entries, max_entries);
+    
+    // Hash order is meaningless to a reader, so listings come back by name.
+    for (uint32_t i = 1; i < count; i++) {
+        fs_dir_entry_t entry = entries[i];
+        uint32_t j = i;
+        while (j > 0 && string_compare(entries[j - 1].name, entry.name) > 0) {
+            entries[j] = entries[j - 1];
+            j--;
         }
-        return false;
+        entries[j] = entry;
     }
     
-    char components[32][FS_MAX_FILENAME_LENGTH];
-    uint32_t component_count = 0;
-    
-    while (current_id != 1 && component_count < 32) {
-        string_copy(components[component_count], fs_state.files[current_id].name);
-        component_count++;
-        current_id = fs_state.files[current_id].parent_id;
+    return count;
+}
+
+static vfs_mount_t* mount_of(const vfs_superblock_t* superblock) {
+    for (uint32_t i = 0; i < vfs_state.mount_count; i++) {
+        if (&vfs_state.mounts[i].superblock == superblock) return &vfs_state.mounts[i];
     }
+    return NULL;
+}
+
+// Drops the last component of a normalized path, leaving its directory.
+static void cut_last_component(char* path) {
+    uint32_t length = string_length(path);
+    while (length > 1 && path[length - 1] != '/') length--;
+    if (length > 1) length--;
+    path[length] = '\0';
+}
+
+static bool append_component(char* path, const char* name) {
+    uint32_t length = string_length(path);
+    if (length == 1) length = 0;   // Root; the component adds its own slash
     
-    buffer[0] = '\0';
-    string_append(buffer, "/");
+    if (length + 1 + string_length(name) >= FS_MAX_PATH_LENGTH) return false;
     
-    for (int i = component_count - 1; i >= 0; i--) {
-        if (string_length(buffer) + string_length(components[i]) + 1 < buffer_size) {
-            string_append(buffer, components[i]);
-            if (i > 0) {
-                string_append(buffer, "/");
-            }
+    path[length++] = '/';
+    string_copy(path + length, name);
+    return true;
+}
+
+static bool walk_load(fs_walk_t* walk, vfs_superblock_t* superblock, uint32_t vnode) {
+    walk->superblock = superblock;
+    walk->vnode = vnode;
+    return superblock->type->superblock_ops->get_info(superblock, vnode, &walk->info);
+}
+
+// The first entry in the current directory. A directory that has something
+// mounted on it is read from the root of that mount instead.
+static uint32_t walk_first_child(fs_walk_t* walk, vfs_superblock_t** superblock) {
+    uint32_t directory = walk->vnode;
+    *superblock = walk->superblock;
+    
+    for (uint32_t i = 0; i < vfs_state.mount_count; i++) {
+        vfs_mount_t* mount = &vfs_state.mounts[i];
+        if (&mount->superblock != walk->superblock && string_compare(mount->path, walk->path) == 0) {
+            *superblock = &mount->superblock;
+            directory = mount->superblock.type->superblock_ops->lookup(*superblock, "/");
+            break;
         }
     }
     
-    return true;
+    const vfs_superblock_ops_t* ops = (*superblock)->type->superblock_ops;
+    if (directory == 0 || !ops->first_child || !ops->next_sibling) return 0;
+    
+    return ops->first_child(*superblock, directory);
 }
 
-uint32_t filesystem_list_directory(const char* path, fs_dir_entry_t* entries, uint32_t max_entries) {
-    uint32_t dir_id;
-    
-    if (path && string_length(path) > 0) {
-        dir_id = resolve_path_to_id(path);
-    } else {
-        dir_id = fs_state.current_directory_id;
+// The directory a mount other than the root is mounted on, which lives on
+// the mount below it.
+static uint32_t covered_directory(const vfs_mount_t* mount, vfs_mount_t** below) {
+    char covered[FS_MAX_PATH_LENGTH];
+    const char* relative;
+    string_copy(covered, mount->path);
+    cut_last_component(covered);
+    
+    *below = find_mount(covered, &relative);
+    if (!*below) return 0;
+    
+    relative = mount->path + (*below)->path_length;
+    return (*below)->superblock.type->superblock_ops->lookup(&(*below)->superblock, relative);
+}
+
+// Moves up to the current entry's directory. Climbing onto the root of a
+// mount carries on to the directory it is mounted on, so siblings are then
+// taken from the mount below.
+static bool walk_climb(fs_walk_t* walk) {
+    if (walk->is_named) cut_last_component(walk->path);
+    walk->is_named = true;
+    walk->depth--;
+    
+    vfs_superblock_t* superblock = walk->superblock;
+    if (!walk_load(walk, superblock, walk->info.parent_id)) return false;
+    
+    if (walk->depth == 0 ||
+        superblock->type->superblock_ops->lookup(superblock, "/") != walk->vnode) {
+        return true;
     }
     
-    if (dir_id == 0 || fs_state.files[dir_id].type != FS_TYPE_DIRECTORY) {
-        return 0;
-    }
+    vfs_mount_t* below;
+    uint32_t vnode = covered_directory(mount_of(superblock), &below);
+    return vnode != 0 && walk_load(walk, &below->superblock, vnode);
+}
+
+bool filesystem_walk_begin(fs_walk_t* walk, const char* path) {
+    const char* relative;
+    uint32_t vnode;
     
-    uint32_t count = 0;
+    if (!walk) return false;
     
-    for (uint32_t i = 1; i < FS_MAX_FILES && count < max_entries; i++) {
-        if (fs_state.files[i].is_valid && fs_state.files[i].parent_id == dir_id) {
-            string_copy(entries[count].name, fs_state.files[i].name);
-            entries[count].type = fs_state.files[i].type;
-            entries[count].size = fs_state.files[i].size;
-            entries[count].permissions = fs_state.files[i].permissions;
-            count++;
+    vfs_mount_t* mount = resolve(path, walk->path, &relative, &vnode);
+    if (!mount || !walk_load(walk, &mount->superblock, vnode) ||
+        walk->info.type != FS_TYPE_DIRECTORY) {
+        walk->vnode = 0;
+        return false;
+    }
+    
+    walk->depth = 0;
+    walk->is_named = true;
+    walk->is_started = false;
+    walk->is_pruned = false;
+    return true;
+}
+
+// is_named says whether path names the current entry; while it is false,
+// path still holds the entry's directory. Entries that cannot be named are
+// never returned or descended into, but the walk steps through them to
+// reach their siblings.
+bool filesystem_walk_next(fs_walk_t* walk) {
+    if (!walk || walk->vnode == 0) return false;
+    
+    bool descend = !walk->is_started ||
+                   (walk->is_named && !walk->is_pruned && walk->info.type == FS_TYPE_DIRECTORY);
+    walk->is_started = true;
+    walk->is_pruned = false;
+    
+    while (true) {
+        vfs_superblock_t* superblock = walk->superblock;
+        uint32_t next = 0;
+        
+        if (descend) {
+            next = walk_first_child(walk, &superblock);
+            if (next != 0) {
+                walk->depth++;
+                walk->is_named = false;
+            }
         }
+        
+        while (next == 0 && walk->depth > 0) {
+            superblock = walk->superblock;
+            next = superblock->type->superblock_ops->next_sibling(superblock, walk->vnode);
+            
+            if (next != 0) {
+                if (walk->is_named) cut_last_component(walk->path);
+                walk->is_named = false;
+            } else if (!walk_climb(walk)) {
+                break;
+            }
+        }
+        
+        if (next == 0) {
+            walk->vnode = 0;
+            return false;
+        }
+        
+        walk->is_named = walk_load(walk, superblock, next) &&
+                         append_component(walk->path, walk->info.name);
+        if (walk->is_named) return true;
+        
+        descend = false;
     }
+}
+
+void filesystem_walk_prune(fs_walk_t* walk) {
+    if (walk) walk->is_pruned = true;
+}
+
+bool filesystem_walk_may_contain(const fs_walk_t* walk, const text_index_query_t* query) {
+    if (!walk || !query || walk->vnode == 0) return true;
     
-    return count;
+    return text_index_may_contain(query, walk->superblock, walk->vnode);
+}
+
+// True if mount is mounted somewhere below the normalized directory path.
+static bool is_mounted_below(const vfs_mount_t* mount, const char* directory) {
+    uint32_t length = string_length(directory);
+    if (length == 1) return mount->path_length > 0;
+    if (mount->path_length <= length || mount->path[length] != '/') return false;
+    
+    for (uint32_t c = 0; c < length; c++) {
+        if (mount->path[c] != directory[c]) return false;
+    }
+    return true;
+}
+
+static bool mount_info(vfs_mount_t* mount, uint32_t vnode, fs_file_info_t* info) {
+    return mount->superblock.type->superblock_ops->get_info(&mount->superblock, vnode, info);
+}
+
+// Backends keep their totals per mount, so each mount below path swaps the
+// totals of the directory it covers for those of its own root. That costs
+// one lookup per mount, however big the tree.
+bool filesystem_get_usage(const char* path, uint32_t* bytes, uint32_t* nodes) {
+    char normalized[FS_MAX_PATH_LENGTH];
+    const char* relative;
+    uint32_t vnode;
+    fs_file_info_t info;
+    
+    if (!bytes || !nodes) return false;
+    
+    vfs_mount_t* mount = resolve(path, normalized, &relative, &vnode);
+    if (!mount || !mount_info(mount, vnode, &info)) return false;
+    
+    *bytes = info.size + info.tree_bytes;
+    *nodes = info.tree_nodes;
+    if (info.type != FS_TYPE_DIRECTORY) return true;
+    
+    for (uint32_t i = 0; i < vfs_state.mount_count; i++) {
+        vfs_mount_t* inner = &vfs_state.mounts[i];
+        if (!is_mounted_below(inner, normalized)) continue;
+        
+        vfs_mount_t* below;
+        fs_file_info_t root, covered;
+        uint32_t covered_vnode = covered_directory(inner, &below);
+        uint32_t root_vnode = inner->superblock.type->superblock_ops->lookup(&inner->superblock, "/");
+        if (covered_vnode == 0 || root_vnode == 0 || !mount_info(inner, root_vnode, &root) ||
+            !mount_info(below, covered_vnode, &covered)) {
+            continue;
+        }
+        
+        *bytes += root.tree_bytes - covered.tree_bytes;
+        *nodes += root.tree_nodes - covered.tree_nodes;
+    }
+    return true;
 }
 
 bool filesystem_file_exists(const char* path) {
-    return resolve_path_to_id(path) != 0;
+    fs_file_info_t info;
+    return resolve_info(path, &info);
 }
 
 bool filesystem_get_file_info(const char* path, fs_file_info_t* info) {
-    uint32_t file_id = resolve_path_to_id(path);
-    if (file_id == 0 || !info) return false;
+    if (!info) return false;
     
-    *info = fs_state.files[file_id];
-    return true;
+    return resolve_info(path, info);
 }
 
-fs_file_handle_t* filesystem_open_file(const char* path, bool write_mode) {
-    uint32_t file_id = resolve_path_to_id(path);
-    if (file_id == 0 || fs_state.files[file_id].type != FS_TYPE_FILE) {
-        return NULL;
+bool filesystem_open_handle(const char* path, bool write_mode, fs_file_handle_t* handle) {
+    if (!handle) return false;
+    
+    char normalized[FS_MAX_PATH_LENGTH];
+    const char* relative;
+    uint32_t vnode;
+    
+    vfs_mount_t* mount = resolve(path, normalized, &relative, &vnode);
+    if (!mount) return false;
+    
+    fs_file_info_t info;
+    if (!mount->superblock.type->superblock_ops->get_info(&mount->superblock, vnode, &info) ||
+        info.type != FS_TYPE_FILE) {
+        return false;
     }
     
-    fs_file_handle_t* handle = apollo_allocate_memory(sizeof(fs_file_handle_t));
-    if (!handle) return NULL;
+    if (write_mode && info.read_only) {
+        return false;
+    }
     
-    handle->file_id = file_id;
+    handle->superblock = &mount->superblock;
+    handle->file_id = vnode;
     handle->position = 0;
     handle->is_open = true;
     handle->write_mode = write_mode;
+    handle->next_read_position = 0;
+    handle->readahead_blocks = 0;
+    handle->readahead_limit = 0;
+    handle->next_write_position = 0;
+    handle->write_behind_start = 0;
+    handle->mapped_buffer = NULL;
     
+    return true;
+}
+
+static const vfs_vnode_ops_t* vnode_ops(const fs_file_handle_t* handle) {
+    return handle->superblock->type->vnode_ops;
+}
+
+// The text index follows every change to file contents, and reads let it
+// catch up on files it has not seen in full.
+static void index_written(fs_file_handle_t* handle, const void* data, uint32_t size, uint32_t offset) {
+    text_index_file_written(handle->superblock, handle->file_id, offset, data, size);
+}
+
+static void index_read(fs_file_handle_t* handle, const void* data, uint32_t size, uint32_t offset) {
+    text_index_file_read(handle->superblock, handle->file_id, offset, data, size);
+}
+
+static void index_end_of_file(fs_file_handle_t* handle) {
+    fs_file_info_t info;
+    vfs_superblock_t* superblock = handle->superblock;
+    
+    if (superblock->type->superblock_ops->get_info(superblock, handle->file_id, &info)) {
+        text_index_file_read_done(superblock, handle->file_id, info.size);
+    }
+}
+
+static void release_mapping(fs_file_handle_t* handle) {
+    if (vnode_ops(handle)->release) {
+        vnode_ops(handle)->release(handle);
+    }
+}
+
+void filesystem_release_handle(fs_file_handle_t* handle) {
+    if (handle && handle->is_open) {
+        release_mapping(handle);
+        handle->is_open = false;
+    }
+}
+
+fs_file_handle_t* filesystem_open_file(const char* path, bool write_mode) {
+    fs_file_handle_t* handle = apollo_allocate_memory(sizeof(fs_file_handle_t));
+    if (!handle) return NULL;
+    
+    if (!filesystem_open_handle(path, write_mode, handle)) {
+        apollo_free_memory(handle);
+        return NULL;
+    }
     return handle;
 }
 
+fs_file_handle_t* filesystem_duplicate_handle(const fs_file_handle_t* handle) {
+    if (!handle || !handle->is_open) return NULL;
+    
+    fs_file_handle_t* copy = apollo_allocate_memory(sizeof(fs_file_handle_t));
+    if (!copy) return NULL;
+    
+    *copy = *handle;
+    copy->mapped_buffer = NULL;
+    return copy;
+}
+
 void filesystem_close_file(fs_file_handle_t* handle) {
     if (handle) {
-        handle->is_open = false;
+        filesystem_release_handle(handle);
         apollo_free_memory(handle);
     }
 }
 
-uint32_t filesystem_read_file(fs_file_handle_t* handle, void* buffer, uint32_t size) {
-    if (!handle || !handle->is_open || !buffer) return 0;
+static int32_t lowest_free_fd(const fs_fd_table_t* table) {
+    uint32_t free_mask = ~table->open_mask & ((1U << FS_MAX_OPEN_FILES) - 1);
+    if (free_mask == 0) return -1;
+    return (int32_t)__builtin_ctz(free_mask);
+}
+
+static int32_t free_open_file(void) {
+    for (uint32_t i = 0; i < FS_MAX_OPEN_FILE_OBJECTS; i++) {
+        if (vfs_state.open_files[i].references == 0) return (int32_t)i;
+    }
+    return -1;
+}
+
+static void release_open_file(uint16_t index) {
+    fs_open_file_t* file = &vfs_state.open_files[index];
     
-    fs_file_info_t* file = &fs_state.files[handle->file_id];
-    if (file->data_block == 0) return 0;
+    if (--file->references == 0) {
+        filesystem_release_handle(&file->handle);
+    }
+}
+
+void filesystem_fd_table_initialize(fs_fd_table_t* table) {
+    if (!table) return;
     
-    uint32_t bytes_to_read = size;
-    if (handle->position + bytes_to_read > file->size) {
-        bytes_to_read = file->size - handle->position;
+    table->open_mask = 0;
+}
+
+fs_file_handle_t* filesystem_fd_get(fs_fd_table_t* table, int32_t fd) {
+    if (!table || fd < 0 || fd >= FS_MAX_OPEN_FILES) return NULL;
+    if (!(table->open_mask & (1U << fd))) return NULL;
+    return &vfs_state.open_files[table->files[fd]].handle;
+}
+
+int32_t filesystem_fd_open(fs_fd_table_t* table, const char* path, bool write_mode) {
+    if (!table) return -1;
+    
+    int32_t fd = lowest_free_fd(table);
+    int32_t index = free_open_file();
+    if (fd < 0 || index < 0) return -1;
+    
+    fs_open_file_t* file = &vfs_state.open_files[index];
+    if (!filesystem_open_handle(path, write_mode, &file->handle)) {
+        return -1;
     }
     
-    if (bytes_to_read == 0) return 0;
+    file->references = 1;
+    table->files[fd] = (uint16_t)index;
+    table->open_mask |= 1U << fd;
+    return fd;
+}
+
+int32_t filesystem_fd_dup(fs_fd_table_t* table, int32_t fd) {
+    if (!filesystem_fd_get(table, fd)) return -1;
     
-    uint8_t* src = fs_state.data_blocks[file->data_block] + handle->position;
-    uint8_t* dest = (uint8_t*)buffer;
+    int32_t copy = lowest_free_fd(table);
+    if (copy < 0) return -1;
     
-    memory_copy(dest, src, bytes_to_read);
+    table->files[copy] = table->files[fd];
+    vfs_state.open_files[table->files[fd]].references++;
+    table->open_mask |= 1U << copy;
+    return copy;
+}
+
+bool filesystem_fd_close(fs_fd_table_t* table, int32_t fd) {
+    if (!filesystem_fd_get(table, fd)) return false;
     
-    handle->position += bytes_to_read;
-    return bytes_to_read;
+    release_open_file(table->files[fd]);
+    table->open_mask &= ~(1U << fd);
+    return true;
+}
+
+void filesystem_fd_close_all(fs_fd_table_t* table) {
+    if (!table) return;
+    
+    while (table->open_mask != 0) {
+        filesystem_fd_close(table, (int32_t)__builtin_ctz(table->open_mask));
+    }
+}
+
+void filesystem_fd_table_copy(fs_fd_table_t* dest, const fs_fd_table_t* source) {
+    if (!dest || !source) return;
+    
+    filesystem_fd_table_initialize(dest);
+    for (uint32_t fd = 0; fd < FS_MAX_OPEN_FILES; fd++) {
+        if (source->open_mask & (1U << fd)) {
+            dest->files[fd] = source->files[fd];
+            vfs_state.open_files[source->files[fd]].references++;
+        }
+    }
+    dest->open_mask = source->open_mask;
+}
+
+uint32_t filesystem_read_file(fs_file_handle_t* handle, void* buffer, uint32_t size) {
+    if (!handle || !handle->is_open || !buffer) return 0;
+    
+    uint32_t bytes_read = vnode_ops(handle)->read(handle, buffer, size, handle->position);
+    index_read(handle, buffer, bytes_read, handle->position);
+    if (bytes_read < size) index_end_of_file(handle);
+    
+    handle->position += bytes_read;
+    return bytes_read;
 }
 
 uint32_t filesystem_write_file(fs_file_handle_t* handle, const void* buffer, uint32_t size) {
     if (!handle || !handle->is_open || !handle->write_mode || !buffer) return 0;
     
-    fs_file_info_t* file = &fs_state.files[handle->file_id];
-    if (file->data_block == 0) return 0;
+    uint32_t bytes_written = vnode_ops(handle)->write(handle, buffer, size, handle->position);
+    index_written(handle, buffer, bytes_written, handle->position);
+    
+    handle->position += bytes_written;
+    return bytes_written;
+}
+
+uint32_t filesystem_readv(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count) {
+    if (!handle || !handle->is_open || !vectors) return 0;
+    
+    const vfs_vnode_ops_t* ops = vnode_ops(handle);
+    uint32_t done = 0;
+    
+    if (ops->readv) {
+        done = ops->readv(handle, vectors, count, handle->position);
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            if (!vectors[i].base) break;
+            
+            uint32_t bytes_read = ops->read(handle, vectors[i].base, vectors[i].length,
+                                            handle->position + done);
+            done += bytes_read;
+            if (bytes_read < vectors[i].length) break;
+        }
+    }
+    
+    handle->position += done;
+    return done;
+}
+
+uint32_t filesystem_writev(fs_file_handle_t* handle, const fs_iovec_t* vectors, uint32_t count) {
+    if (!handle || !handle->is_open || !handle->write_mode || !vectors) return 0;
     
-    uint32_t bytes_to_write = size;
-    if (handle->position + bytes_to_write > FS_BLOCK_SIZE) {
-        bytes_to_write = FS_BLOCK_SIZE - handle->position;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!vectors[i].base && vectors[i].length > 0) return 0;
     }
     
-    if (bytes_to_write == 0) return 0;
+    const vfs_vnode_ops_t* ops = vnode_ops(handle);
+    uint32_t done = 0;
+    
+    if (ops->writev) {
+        done = ops->writev(handle, vectors, count, handle->position);
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t bytes_written = ops->write(handle, vectors[i].base, vectors[i].length,
+                                                handle->position + done);
+            done += bytes_written;
+            if (bytes_written < vectors[i].length) break;
+        }
+    }
+    
+    uint32_t indexed = 0;
+    for (uint32_t i = 0; i < count && indexed < done; i++) {
+        uint32_t length = vectors[i].length;
+        if (length > done - indexed) length = done - indexed;
+        
+        index_written(handle, vectors[i].base, length, handle->position + indexed);
+        indexed += length;
+    }
+    
+    handle->position += done;
+    return done;
+}
+
+bool filesystem_map_file(fs_file_handle_t* handle, const void** data, uint32_t* length) {
+    if (!handle || !handle->is_open || !data || !length) return false;
+    
+    release_mapping(handle);
+    
+    if (!vnode_ops(handle)->map ||
+        !vnode_ops(handle)->map(handle, handle->position, data, length)) {
+        index_end_of_file(handle);
+        return false;
+    }
+    
+    index_read(handle, *data, *length, handle->position);
+    handle->position += *length;
+    return true;
+}
+
+uint32_t filesystem_pread(fs_file_handle_t* handle, void* buffer, uint32_t size, uint32_t offset) {
+    if (!handle || !handle->is_open || !buffer) return 0;
+    
+    uint32_t bytes_read = vnode_ops(handle)->read(handle, buffer, size, offset);
+    index_read(handle, buffer, bytes_read, offset);
+    if (bytes_read < size) index_end_of_file(handle);
+    
+    return bytes_read;
+}
+
+uint32_t filesystem_pwrite(fs_file_handle_t* handle, const void* buffer, uint32_t size, uint32_t offset) {
+    if (!handle || !handle->is_open || !handle->write_mode || !buffer) return 0;
+    
+    uint32_t bytes_written = vnode_ops(handle)->write(handle, buffer, size, offset);
+    index_written(handle, buffer, bytes_written, offset);
+    return bytes_written;
+}
+
+bool filesystem_seek_file(fs_file_handle_t* handle, uint32_t position) {
+    if (!handle || !handle->is_open || position > FS_MAX_FILE_SIZE) return false;
+    
+    handle->position = position;
+    return true;
+}
+
+bool filesystem_truncate_file(fs_file_handle_t* handle, uint32_t size) {
+    if (!handle || !handle->is_open || !handle->write_mode) return false;
     
-    uint8_t* dest = fs_state.data_blocks[file->data_block] + handle->position;
-    const uint8_t* src = (const uint8_t*)buffer;
+    if (!vnode_ops(handle)->truncate(handle, size)) return false;
     
-    memory_copy(dest, src, bytes_to_write);
+    text_index_file_truncated(handle->superblock, handle->file_id, size);
     
-    handle->position += bytes_to_write;
+    if (handle->position > size) {
+        handle->position = size;
+    }
+    return true;
+}
+
+// Hands a copy to the backend when both ends share a mount that can clone.
+static bool clone_node(const char* source, const char* destination) {
+    char source_path[FS_MAX_PATH_LENGTH];
+    char destination_path[FS_MAX_PATH_LENGTH];
+    const char* source_relative;
+    const char* destination_relative;
+    
+    if (!normalize_path(source, source_path) || !normalize_path(destination, destination_path)) {
+        return false;
+    }
     
-    if (handle->position > file->size) {
-        file->size = handle->position;
-        file->modified_time = get_current_time();
+    vfs_mount_t* mount = find_mount(source_path, &source_relative);
+    if (!mount || find_mount(destination_path, &destination_relative) != mount ||
+        !mount->superblock.type->superblock_ops->clone) {
+        return false;
     }
     
-    return bytes_to_write;
+    return mount->superblock.type->superblock_ops->clone(&mount->superblock, source_relative,
+                                                          destination_relative);
 }
 
+// Prefers a clone, which shares the data; otherwise the bytes go through
+// handles on both ends, so source and destination may sit on different
+// mounts.
 bool filesystem_copy_file(const char* source, const char* destination) {
-    uint32_t src_id = resolve_path_to_id(source);
-    if (src_id == 0 || fs_state.files[src_id].type != FS_TYPE_FILE) {
+    fs_file_info_t info;
+    if (!resolve_info(source, &info) || info.type != FS_TYPE_FILE) {
         return false;
     }
     
+    if (clone_node(source, destination)) {
+        return true;
+    }
+    
     if (!filesystem_create_file(destination)) {
         return false;
     }
     
-    fs_file_handle_t* src_handle = filesystem_open_file(source, false);
-    fs_file_handle_t* dst_handle = filesystem_open_file(destination, true);
+    fs_file_handle_t src_handle;
+    fs_file_handle_t dst_handle;
     
-    if (!src_handle || !dst_handle) {
-        if (src_handle) filesystem_close_file(src_handle);
-        if (dst_handle) filesystem_close_file(dst_handle);
+    if (!filesystem_open_handle(source, false, &src_handle)) {
+        return false;
+    }
+    if (!filesystem_open_handle(destination, true, &dst_handle)) {
+        filesystem_release_handle(&src_handle);
         return false;
     }
     
     uint8_t buffer[FS_BLOCK_SIZE];
-    uint32_t bytes_read = filesystem_read_file(src_handle, buffer, FS_BLOCK_SIZE);
-    if (bytes_read > 0) {
-        filesystem_write_file(dst_handle, buffer, bytes_read);
+    uint32_t bytes_read;
+    bool copied = true;
+    while ((bytes_read = filesystem_read_file(&src_handle, buffer, FS_BLOCK_SIZE)) > 0) {
+        if (filesystem_write_file(&dst_handle, buffer, bytes_read) != bytes_read) {
+            copied = false;
+            break;
+        }
     }
     
-    filesystem_close_file(src_handle);
-    filesystem_close_file(dst_handle);
+    filesystem_release_handle(&src_handle);
+    filesystem_release_handle(&dst_handle);
     
-    return true;
+    return copied;
+}
+
+bool filesystem_snapshot(const char* source, const char* destination) {
+    fs_file_info_t info;
+    if (!resolve_info(source, &info) || info.type != FS_TYPE_DIRECTORY) {
+        return false;
+    }
+    
+    return clone_node(source, destination);
 }
 
 bool filesystem_move_file(const char* source, const char* destination) {
+    fs_file_info_t info;
+    if (!resolve_info(source, &info) || info.read_only) {
+        return false;
+    }
+    
     if (!filesystem_copy_file(source, destination)) {
         return false;
     }
@@ -743,52 +1031,21 @@ bool filesystem_move_file(const char* source, const char* destination) {
     return filesystem_delete_file(source);
 }
 
+// Space and counts describe the root mount; the mount table has the rest.
+bool filesystem_get_stats(fs_stats_t* stats) {
+    if (!stats || vfs_state.mount_count == 0) return false;
+    
+    vfs_superblock_t* root = &vfs_state.mounts[0].superblock;
+    return root->type->superblock_ops->get_stats &&
+           root->type->superblock_ops->get_stats(root, stats);
+}
+
 uint32_t filesystem_get_free_space(void) {
-    uint32_t free_blocks = 0;
-    for (uint32_t i = 1; i < FS_MAX_BLOCKS; i++) {
-        if (!fs_state.block_allocated[i]) {
-            free_blocks++;
-        }
-    }
-    return free_blocks * FS_BLOCK_SIZE;
+    fs_stats_t stats;
+    return filesystem_get_stats(&stats) ? stats.free_space : 0;
 }
 
 uint32_t filesystem_get_used_space(void) {
-    uint32_t used_blocks = 0;
-    for (uint32_t i = 1; i < FS_MAX_BLOCKS; i++) {
-        if (fs_state.block_allocated[i]) {
-            used_blocks++;
-        }
-    }
-    return used_blocks * FS_BLOCK_SIZE;
+    fs_stats_t stats;
+    return filesystem_get_stats(&stats) ? stats.total_space - stats.free_space : 0;
 }
-
-bool filesystem_get_stats(fs_stats_t* stats) {
-    if (!stats) return false;
-    
-    stats->total_files = 0;
-    stats->total_directories = 0;
-    
-    for (uint32_t i = 1; i < FS_MAX_FILES; i++) {
-        if (fs_state.files[i].is_valid) {
-            if (fs_state.files[i].type == FS_TYPE_FILE) {
-                stats->total_files++;
-            } else {
-                stats->total_directories++;
-            }
-        }
-    }
-    
-    stats->used_blocks = 0;
-    for (uint32_t i = 1; i < FS_MAX_BLOCKS; i++) {
-        if (fs_state.block_allocated[i]) {
-            stats->used_blocks++;
-        }
-    }
-    
-    stats->free_blocks = (FS_MAX_BLOCKS - 1) - stats->used_blocks;
-    stats->total_space = (FS_MAX_BLOCKS - 1) * FS_BLOCK_SIZE;
-    stats->free_space = stats->free_blocks * FS_BLOCK_SIZE;
-    
-    return true;
-}
\ No newline at end of file
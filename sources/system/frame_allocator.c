@@ -0,0 +1,128 @@
+#include "frame_allocator.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FRAME_POOL_FRAMES 2048  // 8MB of page-table and user frames
+#define FRAME_BITMAP_WORDS (FRAME_POOL_FRAMES / 64)
+
+typedef struct {
+    uint64_t used_bitmap[FRAME_BITMAP_WORDS];
+    uint16_t reference_counts[FRAME_POOL_FRAMES];
+    uint32_t next_word_hint;
+    uint32_t free_frames;
+    bool is_initialized;
+} frame_allocator_state_t;
+
+static uint8_t frame_pool[FRAME_POOL_FRAMES * FRAME_SIZE] __attribute__((aligned(4096)));
+static frame_allocator_state_t frame_state = {0};
+
+// Never handed out by the allocator and never written: anonymous pages map
+// it read-only until their first write.
+static const uint8_t shared_zero_frame[FRAME_SIZE] __attribute__((aligned(4096))) = {0};
+
+static void zero_frame(void* frame) {
+    uint64_t* words = (uint64_t*)frame;
+    for (uint32_t i = 0; i < FRAME_SIZE / sizeof(uint64_t); i++) {
+        words[i] = 0;
+    }
+}
+
+void frame_allocator_initialize(void) {
+    if (frame_state.is_initialized) return;
+
+    for (uint32_t i = 0; i < FRAME_BITMAP_WORDS; i++) {
+        frame_state.used_bitmap[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < FRAME_POOL_FRAMES; i++) {
+        frame_state.reference_counts[i] = 0;
+    }
+
+    frame_state.next_word_hint = 0;
+    frame_state.free_frames = FRAME_POOL_FRAMES;
+    frame_state.is_initialized = true;
+}
+
+void* frame_allocator_allocate(void) {
+    if (!frame_state.is_initialized) {
+        frame_allocator_initialize();
+    }
+
+    if (frame_state.free_frames == 0) return NULL;
+
+    for (uint32_t scanned = 0; scanned < FRAME_BITMAP_WORDS; scanned++) {
+        uint32_t word = (frame_state.next_word_hint + scanned) % FRAME_BITMAP_WORDS;
+        uint64_t free_bits = ~frame_state.used_bitmap[word];
+
+        if (free_bits != 0) {
+            uint32_t bit = (uint32_t)__builtin_ctzll(free_bits);
+            frame_state.used_bitmap[word] |= (1ULL << bit);
+            frame_state.reference_counts[word * 64 + bit] = 1;
+            frame_state.free_frames--;
+            frame_state.next_word_hint = word;
+
+            void* frame = &frame_pool[(word * 64 + bit) * FRAME_SIZE];
+            zero_frame(frame);
+            return frame;
+        }
+    }
+
+    return NULL;
+}
+
+static bool frame_index(const void* frame, uint32_t* index) {
+    uintptr_t address = (uintptr_t)frame;
+    if (!frame_allocator_owns(address) || (address & (FRAME_SIZE - 1)) != 0) {
+        return false;
+    }
+
+    *index = (uint32_t)((address - (uintptr_t)frame_pool) / FRAME_SIZE);
+    return (frame_state.used_bitmap[*index / 64] & (1ULL << (*index % 64))) != 0;
+}
+
+void frame_allocator_free(void* frame) {
+    uint32_t index;
+    if (!frame_index(frame, &index)) return;
+
+    if (frame_state.reference_counts[index] > 1) {
+        frame_state.reference_counts[index]--;
+        return;
+    }
+
+    frame_state.reference_counts[index] = 0;
+    frame_state.used_bitmap[index / 64] &= ~(1ULL << (index % 64));
+    frame_state.free_frames++;
+}
+
+bool frame_allocator_reference(void* frame) {
+    uint32_t index;
+    if (!frame_index(frame, &index) || frame_state.reference_counts[index] == UINT16_MAX) {
+        return false;
+    }
+
+    frame_state.reference_counts[index]++;
+    return true;
+}
+
+uint32_t frame_allocator_get_references(const void* frame) {
+    uint32_t index;
+    if (!frame_index(frame, &index)) return 0;
+    return frame_state.reference_counts[index];
+}
+
+const void* frame_allocator_get_zero_frame(void) {
+    return shared_zero_frame;
+}
+
+bool frame_allocator_owns(uintptr_t physical_address) {
+    return physical_address >= (uintptr_t)frame_pool &&
+           physical_address < (uintptr_t)frame_pool + sizeof(frame_pool);
+}
+
+size_t frame_allocator_get_free_frames(void) {
+    return frame_state.free_frames;
+}
+
+size_t frame_allocator_get_total_frames(void) {
+    return FRAME_POOL_FRAMES;
+}
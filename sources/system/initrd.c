@@ -0,0 +1,217 @@
+#include "initrd.h"
+#include "multiboot.h"
+#include "filesystem.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_TYPE_FILE '0'
+#define TAR_TYPE_FILE_OLD '\0'
+#define TAR_TYPE_DIRECTORY '5'
+#define TAR_MODE_EXECUTE 0100
+
+typedef struct {
+    char name[100];
+    char mode[8];
+    char owner[8];
+    char group[8];
+    char size[12];
+    char modified_time[12];
+    char checksum[8];
+    char type;
+    char link_name[100];
+    char magic[6];
+    char version[2];
+    char owner_name[32];
+    char group_name[32];
+    char device_major[8];
+    char device_minor[8];
+    char prefix[155];
+    char padding[12];
+} __attribute__((packed)) tar_header_t;
+
+static initrd_info_t initrd_state = {0};
+
+static uint32_t string_length(const char* str) {
+    uint32_t len = 0;
+    while (str && str[len] != '\0') len++;
+    return len;
+}
+
+static uint64_t parse_octal(const char* field, uint32_t size) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+static bool is_zero_block(const uint8_t* block) {
+    for (uint32_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+        if (block[i] != 0) return false;
+    }
+    return true;
+}
+
+// The checksum is the byte sum of the header with the checksum field
+// counted as spaces.
+static bool checksum_matches(const tar_header_t* header) {
+    const uint8_t* bytes = (const uint8_t*)header;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+        bool in_checksum = i >= offsetof(tar_header_t, checksum) &&
+                           i < offsetof(tar_header_t, checksum) + sizeof(header->checksum);
+        sum += in_checksum ? ' ' : bytes[i];
+    }
+    return sum == parse_octal(header->checksum, sizeof(header->checksum));
+}
+
+static bool append(char* path, uint32_t* length, const char* text, uint32_t max_text) {
+    for (uint32_t i = 0; i < max_text && text[i]; i++) {
+        if (*length >= FS_MAX_PATH_LENGTH - 1) return false;
+        path[(*length)++] = text[i];
+    }
+    path[*length] = '\0';
+    return true;
+}
+
+// Builds the full path of an entry under the mount point, dropping "./",
+// leading and trailing slashes. Returns false for an over-long name.
+static bool build_path(const tar_header_t* header, char* path) {
+    uint32_t length = 0;
+    path[0] = '\0';
+
+    if (!append(path, &length, INITRD_MOUNT_POINT, FS_MAX_PATH_LENGTH)) return false;
+
+    char name[sizeof(header->prefix) + 1 + sizeof(header->name) + 1];
+    uint32_t name_length = 0;
+    for (uint32_t i = 0; i < sizeof(header->prefix) && header->prefix[i]; i++) {
+        name[name_length++] = header->prefix[i];
+    }
+    if (name_length > 0) name[name_length++] = '/';
+    for (uint32_t i = 0; i < sizeof(header->name) && header->name[i]; i++) {
+        name[name_length++] = header->name[i];
+    }
+    name[name_length] = '\0';
+
+    const char* component = name;
+    while (*component) {
+        while (*component == '/') component++;
+        if (!*component) break;
+
+        uint32_t component_length = 0;
+        while (component[component_length] && component[component_length] != '/') {
+            component_length++;
+        }
+
+        bool is_dot = component_length == 1 && component[0] == '.';
+        if (!is_dot) {
+            if (component_length >= FS_MAX_FILENAME_LENGTH) return false;
+            if (!append(path, &length, "/", 1)) return false;
+            if (!append(path, &length, component, component_length)) return false;
+        }
+        component += component_length;
+    }
+
+    return true;
+}
+
+// Archives need not list every directory, so each missing parent is
+// attached on the way down.
+static void attach_parents(char* path) {
+    uint32_t length = string_length(path);
+
+    for (uint32_t i = string_length(INITRD_MOUNT_POINT) + 1; i < length; i++) {
+        if (path[i] != '/') continue;
+
+        path[i] = '\0';
+        if (!filesystem_file_exists(path) && filesystem_attach_directory(path)) {
+            initrd_state.directory_count++;
+        }
+        path[i] = '/';
+    }
+}
+
+static void attach_entry(const tar_header_t* header, const uint8_t* data, uint64_t size) {
+    char path[FS_MAX_PATH_LENGTH];
+    if (!build_path(header, path)) {
+        initrd_state.skipped_entries++;
+        return;
+    }
+
+    // The archive's own root, usually "./".
+    if (string_length(path) == string_length(INITRD_MOUNT_POINT)) return;
+
+    attach_parents(path);
+
+    if (header->type == TAR_TYPE_DIRECTORY) {
+        if (filesystem_file_exists(path)) return;
+        if (filesystem_attach_directory(path)) {
+            initrd_state.directory_count++;
+        } else {
+            initrd_state.skipped_entries++;
+        }
+    } else if ((header->type == TAR_TYPE_FILE || header->type == TAR_TYPE_FILE_OLD) &&
+               size <= UINT32_MAX) {
+        uint8_t permissions = FS_PERM_READ;
+        if (parse_octal(header->mode, sizeof(header->mode)) & TAR_MODE_EXECUTE) {
+            permissions |= FS_PERM_EXECUTE;
+        }
+
+        if (filesystem_attach_file(path, data, (uint32_t)size, permissions)) {
+            initrd_state.file_count++;
+            initrd_state.data_bytes += size;
+        } else {
+            initrd_state.skipped_entries++;
+        }
+    } else {
+        // Links, devices and the like have no equivalent here.
+        initrd_state.skipped_entries++;
+    }
+}
+
+bool initrd_initialize(void) {
+    if (initrd_state.mounted) return true;
+
+    const multiboot_module_t* module = multiboot_find_module(INITRD_MODULE_NAME);
+    if (!module && multiboot_get_module_count() == 1) {
+        module = multiboot_get_module(0);
+    }
+    if (!module || module->end - module->start < TAR_BLOCK_SIZE ||
+        module->end - module->start > UINT32_MAX) {
+        return false;
+    }
+
+    const uint8_t* archive = (const uint8_t*)(uintptr_t)module->start;
+    uint64_t archive_size = module->end - module->start;
+
+    if (!filesystem_attach_directory(INITRD_MOUNT_POINT)) return false;
+
+    initrd_state.archive_address = module->start;
+    initrd_state.archive_size = (uint32_t)archive_size;
+    initrd_state.mounted = true;
+
+    uint64_t offset = 0;
+    while (offset + TAR_BLOCK_SIZE <= archive_size) {
+        const tar_header_t* header = (const tar_header_t*)(archive + offset);
+        if (is_zero_block(archive + offset) || !checksum_matches(header)) break;
+
+        uint64_t size = parse_octal(header->size, sizeof(header->size));
+        uint64_t data_offset = offset + TAR_BLOCK_SIZE;
+        if (size > archive_size - data_offset) break;
+
+        attach_entry(header, archive + data_offset, size);
+
+        offset = data_offset + ((size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE) * TAR_BLOCK_SIZE;
+    }
+
+    return true;
+}
+
+bool initrd_get_info(initrd_info_t* info) {
+    if (!info) return false;
+
+    *info = initrd_state;
+    return initrd_state.mounted;
+}
@@ -0,0 +1,146 @@
+#include "multiboot.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MULTIBOOT1_FLAG_MODULES (1 << 3)
+#define MULTIBOOT2_TAG_END 0
+#define MULTIBOOT2_TAG_MODULE 3
+
+typedef struct {
+    uint32_t flags;
+    uint32_t memory_lower;
+    uint32_t memory_upper;
+    uint32_t boot_device;
+    uint32_t command_line;
+    uint32_t module_count;
+    uint32_t module_address;
+} __attribute__((packed)) multiboot1_info_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint32_t command_line;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot1_module_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} __attribute__((packed)) multiboot2_tag_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t start;
+    uint32_t end;
+    char command_line[];
+} __attribute__((packed)) multiboot2_module_tag_t;
+
+static struct {
+    multiboot_module_t modules[MULTIBOOT_MAX_MODULES];
+    uint32_t module_count;
+} multiboot_state = {0};
+
+static bool is_mapped(uint64_t start, uint64_t end) {
+    return start <= end && end <= MULTIBOOT_MAPPED_LIMIT;
+}
+
+static void add_module(uint64_t start, uint64_t end, const char* command_line) {
+    if (multiboot_state.module_count >= MULTIBOOT_MAX_MODULES || !is_mapped(start, end)) return;
+
+    multiboot_module_t* module = &multiboot_state.modules[multiboot_state.module_count++];
+    module->start = start;
+    module->end = end;
+
+    uint32_t length = 0;
+    if (command_line && is_mapped((uint64_t)(uintptr_t)command_line, (uint64_t)(uintptr_t)command_line)) {
+        while (command_line[length] && length < MULTIBOOT_MAX_COMMAND_LINE - 1) {
+            module->command_line[length] = command_line[length];
+            length++;
+        }
+    }
+    module->command_line[length] = '\0';
+}
+
+static void parse_multiboot1(uint64_t info_address) {
+    const multiboot1_info_t* info = (const multiboot1_info_t*)(uintptr_t)info_address;
+    if (!(info->flags & MULTIBOOT1_FLAG_MODULES)) return;
+
+    uint64_t table_end = (uint64_t)info->module_address +
+                         (uint64_t)info->module_count * sizeof(multiboot1_module_t);
+    if (!is_mapped(info->module_address, table_end)) return;
+
+    const multiboot1_module_t* modules = (const multiboot1_module_t*)(uintptr_t)info->module_address;
+    for (uint32_t i = 0; i < info->module_count; i++) {
+        add_module(modules[i].start, modules[i].end,
+                   modules[i].command_line ? (const char*)(uintptr_t)modules[i].command_line : NULL);
+    }
+}
+
+// Tags follow an 8-byte total_size/reserved header and are each padded to
+// 8 bytes.
+static void parse_multiboot2(uint64_t info_address) {
+    uint32_t total_size = *(const uint32_t*)(uintptr_t)info_address;
+    if (!is_mapped(info_address, info_address + total_size)) return;
+
+    uint64_t offset = 8;
+    while (offset + sizeof(multiboot2_tag_t) <= total_size) {
+        const multiboot2_tag_t* tag = (const multiboot2_tag_t*)(uintptr_t)(info_address + offset);
+        if (tag->type == MULTIBOOT2_TAG_END || tag->size < sizeof(multiboot2_tag_t)) break;
+
+        if (tag->type == MULTIBOOT2_TAG_MODULE && tag->size >= sizeof(multiboot2_module_tag_t)) {
+            const multiboot2_module_tag_t* module = (const multiboot2_module_tag_t*)tag;
+            add_module(module->start, module->end, module->command_line);
+        }
+
+        offset += (tag->size + 7) & ~7U;
+    }
+}
+
+void multiboot_initialize(uint32_t magic, uint64_t info_address) {
+    multiboot_state.module_count = 0;
+    if (info_address == 0 || !is_mapped(info_address, info_address)) return;
+
+    if (magic == MULTIBOOT1_BOOTLOADER_MAGIC) {
+        parse_multiboot1(info_address);
+    } else if (magic == MULTIBOOT2_BOOTLOADER_MAGIC) {
+        parse_multiboot2(info_address);
+    }
+}
+
+uint32_t multiboot_get_module_count(void) {
+    return multiboot_state.module_count;
+}
+
+const multiboot_module_t* multiboot_get_module(uint32_t index) {
+    if (index >= multiboot_state.module_count) return NULL;
+    return &multiboot_state.modules[index];
+}
+
+static bool has_word(const char* text, const char* word) {
+    while (*text) {
+        while (*text == ' ') text++;
+
+        const char* candidate = word;
+        while (*text && *text != ' ' && *text == *candidate) {
+            text++;
+            candidate++;
+        }
+        if (*candidate == '\0' && (*text == ' ' || *text == '\0')) return true;
+
+        while (*text && *text != ' ') text++;
+    }
+    return false;
+}
+
+const multiboot_module_t* multiboot_find_module(const char* name) {
+    if (!name) return NULL;
+
+    for (uint32_t i = 0; i < multiboot_state.module_count; i++) {
+        if (has_word(multiboot_state.modules[i].command_line, name)) {
+            return &multiboot_state.modules[i];
+        }
+    }
+    return NULL;
+}
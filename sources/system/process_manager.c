@@ -1,22 +1,36 @@
 #include "process_manager.h"
 #include "heap_allocator.h"
+#include "address_space.h"
+#include "program_loader.h"
+#include "time_keeper.h"
+#include "filesystem.h"
 #include <stdint.h>
 #include <stdbool.h>
 
 #define MAX_PROCESSES 64
 #define SCHEDULER_TIME_SLICE 10
 
+// Ring 3 starts with interrupts off; a forked child keeps only the status
+// flags and DF of its parent.
+#define PROCESS_USER_RFLAGS      0x002ULL
+#define PROCESS_USER_RFLAGS_MASK 0xCD5ULL
+
 typedef struct {
     process_t processes[MAX_PROCESSES];
+    fs_fd_table_t fd_tables[MAX_PROCESSES];  // Indexed by process slot
     uint32_t next_pid;
     uint32_t current_pid;
     uint32_t total_context_switches;
     uint32_t system_uptime;
+    bool in_user_mode;
     bool is_initialized;
 } process_manager_state_t;
 
 static process_manager_state_t pm_state = {0};
 
+extern uint64_t user_mode_enter(const user_registers_t* registers);
+extern void user_mode_exit(uint64_t status) __attribute__((noreturn));
+
 static void string_copy(char* dest, const char* src) {
     while (*src) {
         *dest++ = *src++;
@@ -43,6 +57,26 @@ static uint32_t find_free_process_slot(void) {
     return MAX_PROCESSES; // No free slot
 }
 
+static void set_start_registers(user_registers_t* registers, uint64_t entry,
+                                uint64_t stack_pointer, uint64_t arg0, uint64_t arg1) {
+    *registers = (user_registers_t){0};
+    registers->rip = entry;
+    registers->rsp = stack_pointer;
+    registers->rdi = arg0;
+    registers->rsi = arg1;
+    registers->rflags = PROCESS_USER_RFLAGS;
+}
+
+static const char* path_basename(const char* path) {
+    const char* name = path;
+    for (const char* current = path; *current; current++) {
+        if (*current == '/' && current[1] != '\0') {
+            name = current + 1;
+        }
+    }
+    return name;
+}
+
 static process_t* find_process_by_pid(uint32_t pid) {
     for (uint32_t i = 0; i < MAX_PROCESSES; i++) {
         if (pm_state.processes[i].is_active && pm_state.processes[i].pid == pid) {
@@ -52,6 +86,10 @@ static process_t* find_process_by_pid(uint32_t pid) {
     return NULL;
 }
 
+static fs_fd_table_t* fd_table_of(process_t* proc) {
+    return &pm_state.fd_tables[proc - pm_state.processes];
+}
+
 static void create_system_processes(void) {
     uint32_t kernel_slot = find_free_process_slot();
     if (kernel_slot < MAX_PROCESSES) {
@@ -66,7 +104,10 @@ static void create_system_processes(void) {
         kernel->parent_pid = 0; // Kernel has no parent
         kernel->start_time = get_system_time();
         kernel->entry_point = NULL;
+        kernel->address_space = address_space_get_kernel();
+        kernel->exit_status = 0;
         kernel->is_active = true;
+        filesystem_fd_table_initialize(fd_table_of(kernel));
     }
     
     process_create("memory_manager", PROCESS_TYPE_SYSTEM, (void*)0x100000);
@@ -102,14 +143,15 @@ void process_manager_initialize(void) {
     pm_state.system_uptime = 0;
     pm_state.is_initialized = true;
     
+    address_space_initialize();
+    
     create_system_processes();
 }
 
-uint32_t process_create(const char* name, process_type_t type, void* entry_point) {
-    if (!name || string_length(name) == 0) return 0;
-    
+static process_t* allocate_process(const char* name, process_type_t type, void* entry_point,
+                                   address_space_t* space) {
     uint32_t slot = find_free_process_slot();
-    if (slot >= MAX_PROCESSES) return 0; // No free slots
+    if (slot >= MAX_PROCESSES) return NULL; // No free slots
     
     process_t* proc = &pm_state.processes[slot];
     
@@ -130,16 +172,79 @@ uint32_t process_create(const char* name, process_type_t type, void* entry_point
             break;
     }
     
+    proc->address_space = space;
     proc->cpu_time = 0;
     proc->memory_usage = 64 * 1024; // Default 64KB
     proc->parent_pid = pm_state.current_pid;
     proc->start_time = get_system_time();
     proc->entry_point = entry_point;
+    proc->user_start.entry = (uint64_t)(uintptr_t)entry_point;
+    proc->user_start.stack_pointer = 0;
+    proc->user_start.argc = 0;
+    proc->user_start.argv = 0;
+    proc->user_registers = (user_registers_t){0};
+    proc->exit_status = 0;
     proc->is_active = true;
+    filesystem_fd_table_initialize(fd_table_of(proc));
+    
+    return proc;
+}
+
+uint32_t process_create(const char* name, process_type_t type, void* entry_point) {
+    if (!name || string_length(name) == 0) return 0;
+    if (find_free_process_slot() >= MAX_PROCESSES) return 0;
+    
+    address_space_t* space = address_space_get_kernel();
+    
+    // Kernel and system processes run in the shared kernel address space;
+    // user processes get their own PML4 with the kernel half linked in.
+    if (type == PROCESS_TYPE_USER) {
+        space = address_space_create();
+        if (!space) return 0;
+        
+        if (!address_space_map_page(space, TIME_PAGE_USER_ADDRESS,
+                                    (uint64_t)(uintptr_t)time_keeper_get_time_page(), PAGE_USER)) {
+            address_space_destroy(space);
+            return 0;
+        }
+    }
+    
+    process_t* proc = allocate_process(name, type, entry_point, space);
+    if (!proc) {
+        if (space != address_space_get_kernel()) address_space_destroy(space);
+        return 0;
+    }
     
     return proc->pid;
 }
 
+uint32_t process_fork(uint32_t pid, const user_registers_t* registers) {
+    process_t* parent = find_process_by_pid(pid);
+    if (!parent || parent->type != PROCESS_TYPE_USER || !parent->address_space) return 0;
+    if (find_free_process_slot() >= MAX_PROCESSES) return 0;
+    
+    address_space_t* space = address_space_clone(parent->address_space);
+    if (!space) return 0;
+    
+    process_t* child = allocate_process(parent->name, PROCESS_TYPE_USER, parent->entry_point, space);
+    if (!child) {
+        address_space_destroy(space);
+        return 0;
+    }
+    
+    child->parent_pid = parent->pid;
+    child->priority = parent->priority;
+    child->memory_usage = parent->memory_usage;
+    child->user_start = parent->user_start;
+    child->user_registers = registers ? *registers : parent->user_registers;
+    child->user_registers.rax = 0;
+    child->user_registers.rflags = (child->user_registers.rflags & PROCESS_USER_RFLAGS_MASK) |
+                                   PROCESS_USER_RFLAGS;
+    filesystem_fd_table_copy(fd_table_of(child), fd_table_of(parent));
+    
+    return child->pid;
+}
+
 bool process_terminate(uint32_t pid) {
     if (pid == 0) return false; // Cannot terminate kernel
     
@@ -148,6 +253,19 @@ bool process_terminate(uint32_t pid) {
     
     proc->state = PROCESS_STATE_TERMINATED;
     proc->is_active = false;
+    filesystem_fd_close_all(fd_table_of(proc));
+    
+    // Orphans are handed to the grandparent so forked jobs stay reachable.
+    for (uint32_t i = 0; i < MAX_PROCESSES; i++) {
+        if (pm_state.processes[i].is_active && pm_state.processes[i].parent_pid == pid) {
+            pm_state.processes[i].parent_pid = proc->parent_pid;
+        }
+    }
+    
+    if (proc->address_space != address_space_get_kernel()) {
+        address_space_destroy(proc->address_space);
+    }
+    proc->address_space = NULL;
     
     return true;
 }
@@ -237,6 +355,11 @@ uint32_t process_get_current_pid(void) {
     return pm_state.current_pid;
 }
 
+fs_fd_table_t* process_get_fd_table(uint32_t pid) {
+    process_t* proc = find_process_by_pid(pid);
+    return proc ? fd_table_of(proc) : NULL;
+}
+
 void process_yield(void) {
     uint32_t start_search = (pm_state.current_pid + 1) % MAX_PROCESSES;
     uint32_t search_pos = start_search;
@@ -252,6 +375,7 @@ void process_yield(void) {
             
             pm_state.current_pid = pm_state.processes[search_pos].pid;
             pm_state.processes[search_pos].state = PROCESS_STATE_RUNNING;
+            address_space_activate(pm_state.processes[search_pos].address_space);
             pm_state.total_context_switches++;
             
             return;
@@ -276,6 +400,101 @@ void process_scheduler_tick(void) {
     pm_state.system_uptime++;
 }
 
+uint32_t process_create_from_file(const char* path, uint32_t argc, const char* const* argv) {
+    if (!path) return 0;
+    
+    char name[64];
+    const char* base = path_basename(path);
+    uint32_t length = 0;
+    while (base[length] && base[length] != '/' && length < sizeof(name) - 1) {
+        name[length] = base[length];
+        length++;
+    }
+    name[length] = '\0';
+    
+    uint32_t pid = process_create(name, PROCESS_TYPE_USER, NULL);
+    if (pid == 0) return 0;
+    
+    process_t* proc = find_process_by_pid(pid);
+    if (!program_loader_load(proc->address_space, path, argc, argv, &proc->user_start)) {
+        process_terminate(pid);
+        return 0;
+    }
+    
+    proc->entry_point = (void*)(uintptr_t)proc->user_start.entry;
+    proc->memory_usage = PROCESS_USER_STACK_SIZE;
+    set_start_registers(&proc->user_registers, proc->user_start.entry,
+                        proc->user_start.stack_pointer, proc->user_start.argc,
+                        proc->user_start.argv);
+    return pid;
+}
+
+static int32_t enter_user_mode(process_t* proc, const user_registers_t* registers) {
+    if (pm_state.in_user_mode) return -1;
+    
+    process_t* previous = find_process_by_pid(pm_state.current_pid);
+    uint32_t previous_pid = pm_state.current_pid;
+    
+    if (previous && previous->state == PROCESS_STATE_RUNNING) {
+        previous->state = PROCESS_STATE_READY;
+    }
+    
+    pm_state.current_pid = proc->pid;
+    proc->state = PROCESS_STATE_RUNNING;
+    pm_state.total_context_switches++;
+    pm_state.in_user_mode = true;
+    
+    address_space_activate(proc->address_space);
+    int32_t status = (int32_t)user_mode_enter(registers);
+    address_space_activate(previous ? previous->address_space : address_space_get_kernel());
+    
+    pm_state.in_user_mode = false;
+    proc->exit_status = status;
+    proc->state = PROCESS_STATE_TERMINATED;
+    
+    pm_state.current_pid = previous_pid;
+    if (previous && previous->state == PROCESS_STATE_READY) {
+        previous->state = PROCESS_STATE_RUNNING;
+    }
+    
+    return status;
+}
+
+int32_t process_run(uint32_t pid) {
+    process_t* proc = find_process_by_pid(pid);
+    if (!proc || proc->type != PROCESS_TYPE_USER || proc->user_registers.rsp == 0) return -1;
+    
+    return enter_user_mode(proc, &proc->user_registers);
+}
+
+uint32_t process_get_ready_child(uint32_t parent_pid) {
+    for (uint32_t i = 0; i < MAX_PROCESSES; i++) {
+        process_t* proc = &pm_state.processes[i];
+        if (proc->is_active && proc->pid != parent_pid && proc->parent_pid == parent_pid &&
+            proc->type == PROCESS_TYPE_USER && proc->state == PROCESS_STATE_READY &&
+            proc->user_registers.rsp != 0) {
+            return proc->pid;
+        }
+    }
+    return 0;
+}
+
+int32_t process_run_user_mode(uint32_t pid, uint64_t entry, uint64_t stack_pointer,
+                              uint64_t arg0, uint64_t arg1) {
+    process_t* proc = find_process_by_pid(pid);
+    if (!proc || proc->type != PROCESS_TYPE_USER) return -1;
+    
+    user_registers_t registers;
+    set_start_registers(&registers, entry, stack_pointer, arg0, arg1);
+    return enter_user_mode(proc, &registers);
+}
+
+void process_exit_user_mode(int32_t status) {
+    if (!pm_state.in_user_mode) return;
+    
+    user_mode_exit((uint64_t)(int64_t)status);
+}
+
 void process_update_memory_usage(uint32_t pid, uint32_t memory_bytes) {
     process_t* proc = find_process_by_pid(pid);
     if (proc) {
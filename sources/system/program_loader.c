@@ -0,0 +1,337 @@
+#include "program_loader.h"
+#include "address_space.h"
+#include "descriptor_tables.h"
+#include "frame_allocator.h"
+#include "filesystem.h"
+#include "process_manager.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ELF_MAGIC 0x464C457F  // "\x7FELF"
+#define ELF_CLASS_64 2
+#define ELF_DATA_LITTLE_ENDIAN 1
+#define ELF_TYPE_EXECUTABLE 2
+#define ELF_MACHINE_X86_64 62
+
+#define ELF_SEGMENT_LOAD 1
+#define ELF_SEGMENT_WRITE 0x2
+#define ELF_SEGMENT_EXECUTE 0x1
+
+#define PAGE_FAULT_PRESENT 0x01
+#define PAGE_FAULT_WRITE 0x02
+
+#define AUXV_NULL 0
+
+typedef struct {
+    uint32_t magic;
+    uint8_t file_class;
+    uint8_t data_encoding;
+    uint8_t version;
+    uint8_t os_abi;
+    uint8_t padding[8];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t elf_version;
+    uint64_t entry;
+    uint64_t program_header_offset;
+    uint64_t section_header_offset;
+    uint32_t flags;
+    uint16_t header_size;
+    uint16_t program_header_size;
+    uint16_t program_header_count;
+    uint16_t section_header_size;
+    uint16_t section_header_count;
+    uint16_t section_name_index;
+} __attribute__((packed)) elf64_header_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t virtual_address;
+    uint64_t physical_address;
+    uint64_t file_size;
+    uint64_t memory_size;
+    uint64_t alignment;
+} __attribute__((packed)) elf64_program_header_t;
+
+static program_loader_stats_t loader_stats = {0};
+
+static const char* const default_environment[] = {
+    "PATH=/bin:/usr/bin",
+    "HOME=/home",
+};
+
+static inline uint64_t read_cr2(void) {
+    uint64_t value;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static uint32_t string_length(const char* str) {
+    uint32_t len = 0;
+    while (str && str[len] != '\0') len++;
+    return len;
+}
+
+static void memory_copy(void* dest, const void* src, uint32_t size) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (uint32_t i = 0; i < size; i++) {
+        d[i] = s[i];
+    }
+}
+
+// ELF offsets are 64-bit but files are not; anything past 4GiB is no
+// place in the file at all.
+static bool read_exact(fs_file_handle_t* handle, uint64_t offset, void* buffer, uint32_t size) {
+    if (offset > UINT32_MAX) return false;
+    return filesystem_pread(handle, buffer, size, (uint32_t)offset) == size;
+}
+
+static bool region_page_is_anonymous(address_region_t* region, uint64_t page) {
+    return !region->file || page - region->start >= region->file_bytes;
+}
+
+static bool fill_page(address_region_t* region, uint64_t page, uint8_t* frame) {
+    uint64_t offset = page - region->start;
+    if (region_page_is_anonymous(region, page)) {
+        loader_stats.zero_pages_filled++;
+        return true;
+    }
+
+    uint64_t bytes = region->file_bytes - offset;
+    if (bytes > FRAME_SIZE) bytes = FRAME_SIZE;
+
+    loader_stats.file_pages_read++;
+    return read_exact(region->file, region->file_offset + offset, frame, (uint32_t)bytes);
+}
+
+static bool map_region_page(address_space_t* space, address_region_t* region,
+                            uint64_t page, bool write) {
+    // Reads of untouched anonymous pages all share one frame of zeros; the
+    // first write takes the copy-on-write path for a private frame.
+    if (!write && region_page_is_anonymous(region, page)) {
+        uint64_t flags = region->page_flags & ~PAGE_WRITABLE;
+        if (region->page_flags & PAGE_WRITABLE) flags |= PAGE_COPY_ON_WRITE;
+
+        if (!address_space_map_page(space, page,
+                                    (uint64_t)(uintptr_t)frame_allocator_get_zero_frame(), flags)) {
+            return false;
+        }
+
+        loader_stats.zero_pages_shared++;
+        return true;
+    }
+
+    uint8_t* page_frame = frame_allocator_allocate();
+
+    if (page_frame && fill_page(region, page, page_frame) &&
+        address_space_map_page(space, page, (uint64_t)(uintptr_t)page_frame, region->page_flags)) {
+        return true;
+    }
+
+    frame_allocator_free(page_frame);
+    return false;
+}
+
+static bool handle_page_fault(interrupt_frame_t* frame) {
+    uint64_t address = read_cr2();
+    address_space_t* space = address_space_get_current();
+    bool write = (frame->error_code & PAGE_FAULT_WRITE) != 0;
+
+    bool resolved = false;
+    address_region_t* region = NULL;
+
+    if (space != address_space_get_kernel()) {
+        if (frame->error_code & PAGE_FAULT_PRESENT) {
+            resolved = write && address_space_resolve_copy_on_write(space, address);
+        } else {
+            region = address_space_find_region(space, address);
+        }
+    }
+
+    if (region && (!write || (region->page_flags & PAGE_WRITABLE))) {
+        uint64_t page = address & ~(uint64_t)(FRAME_SIZE - 1);
+        if (map_region_page(space, region, page, write)) {
+            loader_stats.pages_faulted++;
+            resolved = true;
+        }
+    }
+
+    // A kernel access to a bad user pointer during a system call ends the
+    // calling process instead of the kernel.
+    if (!resolved && (frame->cs & 3) == 0 &&
+        address >= ADDRESS_SPACE_USER_BASE && address < ADDRESS_SPACE_USER_TOP) {
+        process_exit_user_mode(-(int32_t)INTERRUPT_VECTOR_PAGE_FAULT - 1);
+    }
+
+    return resolved;
+}
+
+static bool validate_header(const elf64_header_t* header, uint32_t file_size) {
+    uint64_t table_size = (uint64_t)header->program_header_count * sizeof(elf64_program_header_t);
+
+    return header->magic == ELF_MAGIC &&
+           header->file_class == ELF_CLASS_64 &&
+           header->data_encoding == ELF_DATA_LITTLE_ENDIAN &&
+           header->type == ELF_TYPE_EXECUTABLE &&
+           header->machine == ELF_MACHINE_X86_64 &&
+           header->program_header_size == sizeof(elf64_program_header_t) &&
+           header->program_header_count > 0 &&
+           header->program_header_count <= PROGRAM_MAX_SEGMENTS &&
+           header->program_header_offset <= file_size &&
+           table_size <= file_size - header->program_header_offset;
+}
+
+static bool map_segment(address_space_t* space, const char* path,
+                        const elf64_program_header_t* segment, uint32_t file_size) {
+    if (segment->file_size > segment->memory_size) return false;
+    if (segment->offset > file_size || segment->file_size > file_size - segment->offset) return false;
+    if ((segment->offset & (FRAME_SIZE - 1)) != (segment->virtual_address & (FRAME_SIZE - 1))) return false;
+
+    uint64_t start = segment->virtual_address & ~(uint64_t)(FRAME_SIZE - 1);
+    uint64_t lead = segment->virtual_address - start;
+    uint64_t end = segment->virtual_address + segment->memory_size;
+
+    if (end < segment->virtual_address || end > ADDRESS_SPACE_USER_LIMIT) return false;
+    end = (end + FRAME_SIZE - 1) & ~(uint64_t)(FRAME_SIZE - 1);
+
+    fs_file_handle_t* file = NULL;
+    if (segment->file_size > 0) {
+        file = filesystem_open_file(path, false);
+        if (!file) return false;
+    }
+
+    uint64_t flags = (segment->flags & ELF_SEGMENT_WRITE) ? PAGE_WRITABLE : 0;
+    if (!address_space_add_region(space, start, end, flags, file,
+                                  segment->offset - lead, segment->file_size + lead)) {
+        if (file) filesystem_close_file(file);
+        return false;
+    }
+
+    return true;
+}
+
+static bool build_initial_stack(address_space_t* space, uint32_t argc, const char* const* argv,
+                                program_start_t* start) {
+    uint32_t envc = sizeof(default_environment) / sizeof(default_environment[0]);
+    uint64_t stack_bottom = PROCESS_USER_STACK_TOP - PROCESS_USER_STACK_SIZE;
+
+    if (!address_space_add_region(space, stack_bottom, PROCESS_USER_STACK_TOP,
+                                  PAGE_WRITABLE, NULL, 0, 0)) {
+        return false;
+    }
+
+    // The top page is built through its kernel mapping so loading never
+    // needs the new address space to be active.
+    uint8_t* page = frame_allocator_allocate();
+    if (!page) return false;
+
+    uint64_t page_base = PROCESS_USER_STACK_TOP - FRAME_SIZE;
+    uint64_t cursor = FRAME_SIZE;
+    uint64_t string_addresses[PROGRAM_MAX_ARGUMENTS + 2];
+
+    for (uint32_t i = 0; i < argc + envc; i++) {
+        const char* text = (i < argc) ? argv[i] : default_environment[i - argc];
+        uint32_t length = string_length(text) + 1;
+
+        if (length > cursor) {
+            frame_allocator_free(page);
+            return false;
+        }
+
+        cursor -= length;
+        memory_copy(page + cursor, text, length);
+        string_addresses[i] = page_base + cursor;
+    }
+
+    // argc, argv[] + NULL, envp[] + NULL, then an empty auxiliary vector.
+    uint64_t words = 1 + (argc + 1) + (envc + 1) + 2;
+    cursor &= ~(uint64_t)15;
+    if (words * 8 + 16 > cursor) {
+        frame_allocator_free(page);
+        return false;
+    }
+    cursor = (cursor - words * 8) & ~(uint64_t)15;
+
+    uint64_t* slots = (uint64_t*)(page + cursor);
+    uint32_t slot = 0;
+
+    slots[slot++] = argc;
+    for (uint32_t i = 0; i < argc; i++) slots[slot++] = string_addresses[i];
+    slots[slot++] = 0;
+    for (uint32_t i = 0; i < envc; i++) slots[slot++] = string_addresses[argc + i];
+    slots[slot++] = 0;
+    slots[slot++] = AUXV_NULL;
+    slots[slot++] = 0;
+
+    if (!address_space_map_page(space, page_base, (uint64_t)(uintptr_t)page,
+                                PAGE_USER | PAGE_WRITABLE)) {
+        frame_allocator_free(page);
+        return false;
+    }
+
+    start->stack_pointer = page_base + cursor;
+    start->argc = argc;
+    start->argv = page_base + cursor + 8;
+    return true;
+}
+
+void program_loader_initialize(void) {
+    descriptor_tables_set_handler(INTERRUPT_VECTOR_PAGE_FAULT, handle_page_fault);
+}
+
+bool program_loader_load(address_space_t* space, const char* path,
+                         uint32_t argc, const char* const* argv, program_start_t* start) {
+    if (!space || !path || !start || argc > PROGRAM_MAX_ARGUMENTS) return false;
+
+    fs_file_info_t info;
+    if (!filesystem_get_file_info(path, &info) || info.type != FS_TYPE_FILE ||
+        !(info.permissions & FS_PERM_EXECUTE)) {
+        return false;
+    }
+
+    fs_file_handle_t handle;
+    if (!filesystem_open_handle(path, false, &handle)) return false;
+
+    elf64_header_t header;
+    elf64_program_header_t segments[PROGRAM_MAX_SEGMENTS];
+
+    bool valid = read_exact(&handle, 0, &header, sizeof(header)) && validate_header(&header, info.size) &&
+                 read_exact(&handle, header.program_header_offset, segments,
+                            header.program_header_count * sizeof(elf64_program_header_t));
+    filesystem_release_handle(&handle);
+
+    if (!valid) return false;
+
+    bool entry_mapped = false;
+    for (uint32_t i = 0; i < header.program_header_count; i++) {
+        if (segments[i].type != ELF_SEGMENT_LOAD || segments[i].memory_size == 0) continue;
+
+        if (!map_segment(space, path, &segments[i], info.size)) {
+            return false;
+        }
+
+        if ((segments[i].flags & ELF_SEGMENT_EXECUTE) &&
+            header.entry >= segments[i].virtual_address &&
+            header.entry < segments[i].virtual_address + segments[i].memory_size) {
+            entry_mapped = true;
+        }
+    }
+
+    if (!entry_mapped || !build_initial_stack(space, argc, argv, start)) {
+        return false;
+    }
+
+    start->entry = header.entry;
+    loader_stats.programs_loaded++;
+    return true;
+}
+
+bool program_loader_get_stats(program_loader_stats_t* stats) {
+    if (!stats) return false;
+
+    *stats = loader_stats;
+    return true;
+}
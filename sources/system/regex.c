@@ -0,0 +1,520 @@
+#include "regex.h"
+#include "heap_allocator.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define REGEX_SET_WORDS (REGEX_MAX_NODES / 32)
+#define REGEX_NO_NODE -1
+#define REGEX_UNKNOWN_STATE 0xFF
+
+typedef enum {
+    REGEX_NODE_CLASS,      // Consumes one byte in class
+    REGEX_NODE_SPLIT,      // Continues at both out and out1
+    REGEX_NODE_JUMP,       // Continues at out
+    REGEX_NODE_LINE_START,
+    REGEX_NODE_LINE_END,
+    REGEX_NODE_MATCH
+} regex_node_type_t;
+
+typedef struct {
+    uint8_t type;
+    int16_t out;
+    int16_t out1;
+    uint32_t class[8];
+} regex_node_t;
+
+// A set of NFA nodes. Only the nodes that consume a byte, assert the end
+// of the line or match are kept, so equal sets mean equal futures.
+typedef struct {
+    uint32_t words[REGEX_SET_WORDS];
+} regex_set_t;
+
+typedef struct {
+    regex_set_t nodes;
+    bool at_line_start;
+    bool accepts;            // A match has been seen
+    bool accepts_at_end;     // A match is seen if the line ends here
+    bool is_dead;            // No match is possible any more
+    uint8_t next[256];       // REGEX_UNKNOWN_STATE until first taken
+} regex_state_t;
+
+struct regex {
+    regex_node_t nodes[REGEX_MAX_NODES];
+    uint32_t node_count;
+    int16_t start;
+    // Where a match may begin after the first byte of a line.
+    regex_set_t restart;
+    regex_state_t states[REGEX_MAX_DFA_STATES];
+    uint32_t state_count;
+    uint32_t start_state;    // REGEX_UNKNOWN_STATE when not built
+    uint32_t flush_count;
+};
+
+// A piece of NFA under construction. end is a jump whose out is not set.
+typedef struct {
+    int16_t start;
+    int16_t end;
+} regex_fragment_t;
+
+typedef struct {
+    regex_t* regex;
+    const char* pattern;
+    uint32_t position;
+    const char* error;
+} regex_parser_t;
+
+static bool set_has(const regex_set_t* set, uint32_t node) {
+    return (set->words[node / 32] >> (node % 32)) & 1;
+}
+
+static void set_add(regex_set_t* set, uint32_t node) {
+    set->words[node / 32] |= 1U << (node % 32);
+}
+
+static void set_clear(regex_set_t* set) {
+    for (uint32_t i = 0; i < REGEX_SET_WORDS; i++) set->words[i] = 0;
+}
+
+static bool set_is_empty(const regex_set_t* set) {
+    for (uint32_t i = 0; i < REGEX_SET_WORDS; i++) {
+        if (set->words[i] != 0) return false;
+    }
+    return true;
+}
+
+static bool set_equal(const regex_set_t* a, const regex_set_t* b) {
+    for (uint32_t i = 0; i < REGEX_SET_WORDS; i++) {
+        if (a->words[i] != b->words[i]) return false;
+    }
+    return true;
+}
+
+static void class_add(regex_node_t* node, uint8_t c) {
+    node->class[c / 32] |= 1U << (c % 32);
+}
+
+static void class_add_range(regex_node_t* node, uint8_t first, uint8_t last) {
+    for (uint32_t c = first; c <= last; c++) class_add(node, (uint8_t)c);
+}
+
+static bool class_has(const regex_node_t* node, uint8_t c) {
+    return (node->class[c / 32] >> (c % 32)) & 1;
+}
+
+static void class_invert(regex_node_t* node) {
+    for (uint32_t i = 0; i < 8; i++) node->class[i] = ~node->class[i];
+}
+
+// Parsing
+
+static int16_t new_node(regex_parser_t* parser, regex_node_type_t type) {
+    regex_t* regex = parser->regex;
+    if (regex->node_count >= REGEX_MAX_NODES) {
+        parser->error = "pattern too complex";
+        return REGEX_NO_NODE;
+    }
+
+    regex_node_t* node = &regex->nodes[regex->node_count];
+    node->type = (uint8_t)type;
+    node->out = REGEX_NO_NODE;
+    node->out1 = REGEX_NO_NODE;
+    for (uint32_t i = 0; i < 8; i++) node->class[i] = 0;
+    return (int16_t)regex->node_count++;
+}
+
+static char peek(const regex_parser_t* parser) {
+    return parser->pattern[parser->position];
+}
+
+// A node of the given type followed by an open end.
+static bool single(regex_parser_t* parser, regex_node_type_t type, regex_fragment_t* fragment) {
+    int16_t node = new_node(parser, type);
+    int16_t end = new_node(parser, REGEX_NODE_JUMP);
+    if (end == REGEX_NO_NODE) return false;
+
+    parser->regex->nodes[node].out = end;
+    fragment->start = node;
+    fragment->end = end;
+    return true;
+}
+
+// Adds the byte class named by a backslash escape, or the escaped byte.
+static void add_escape(regex_node_t* node, char c) {
+    regex_node_t named = {0};
+
+    switch (c) {
+        case 'd':
+        case 'D':
+            class_add_range(&named, '0', '9');
+            break;
+        case 'w':
+        case 'W':
+            class_add_range(&named, 'a', 'z');
+            class_add_range(&named, 'A', 'Z');
+            class_add_range(&named, '0', '9');
+            class_add(&named, '_');
+            break;
+        case 's':
+        case 'S':
+            class_add(&named, ' ');
+            class_add(&named, '\t');
+            class_add(&named, '\r');
+            class_add(&named, '\f');
+            class_add(&named, '\v');
+            break;
+        case 't':
+            class_add(&named, '\t');
+            break;
+        default:
+            class_add(&named, (uint8_t)c);
+            break;
+    }
+
+    if (c == 'D' || c == 'W' || c == 'S') class_invert(&named);
+    for (uint32_t i = 0; i < 8; i++) node->class[i] |= named.class[i];
+}
+
+static bool parse_class(regex_parser_t* parser, regex_node_t* node) {
+    bool negate = false;
+    if (peek(parser) == '^') {
+        negate = true;
+        parser->position++;
+    }
+
+    bool first = true;
+    while (peek(parser) != ']' || first) {
+        char c = peek(parser);
+        if (c == '\0') {
+            parser->error = "missing ']'";
+            return false;
+        }
+        parser->position++;
+        first = false;
+
+        if (c == '\\' && peek(parser) != '\0') {
+            add_escape(node, parser->pattern[parser->position++]);
+            continue;
+        }
+
+        char next = (peek(parser) == '-') ? parser->pattern[parser->position + 1] : '\0';
+        if (next != ']' && next != '\0') {
+            parser->position += 2;
+            if ((uint8_t)next < (uint8_t)c) {
+                parser->error = "bad range in '[]'";
+                return false;
+            }
+            class_add_range(node, (uint8_t)c, (uint8_t)next);
+        } else {
+            class_add(node, (uint8_t)c);
+        }
+    }
+    parser->position++;
+
+    if (negate) {
+        class_invert(node);
+        node->class['\n' / 32] &= ~(1U << ('\n' % 32));
+    }
+    return true;
+}
+
+static bool parse_alternation(regex_parser_t* parser, regex_fragment_t* fragment);
+
+static bool parse_atom(regex_parser_t* parser, regex_fragment_t* fragment) {
+    regex_t* regex = parser->regex;
+    char c = parser->pattern[parser->position++];
+
+    switch (c) {
+        case '(':
+            if (!parse_alternation(parser, fragment)) return false;
+            if (peek(parser) != ')') {
+                parser->error = "missing ')'";
+                return false;
+            }
+            parser->position++;
+            return true;
+        case '^':
+            return single(parser, REGEX_NODE_LINE_START, fragment);
+        case '$':
+            return single(parser, REGEX_NODE_LINE_END, fragment);
+        case '*':
+        case '+':
+        case '?':
+            parser->error = "nothing to repeat";
+            return false;
+        default:
+            break;
+    }
+
+    if (!single(parser, REGEX_NODE_CLASS, fragment)) return false;
+    regex_node_t* node = &regex->nodes[fragment->start];
+
+    if (c == '.') {
+        class_add_range(node, 0, 255);
+        node->class['\n' / 32] &= ~(1U << ('\n' % 32));
+    } else if (c == '[') {
+        return parse_class(parser, node);
+    } else if (c == '\\') {
+        if (peek(parser) == '\0') {
+            parser->error = "trailing '\\'";
+            return false;
+        }
+        add_escape(node, parser->pattern[parser->position++]);
+    } else {
+        class_add(node, (uint8_t)c);
+    }
+    return true;
+}
+
+static bool parse_repeat(regex_parser_t* parser, regex_fragment_t* fragment) {
+    if (!parse_atom(parser, fragment)) return false;
+
+    regex_t* regex = parser->regex;
+    while (peek(parser) == '*' || peek(parser) == '+' || peek(parser) == '?') {
+        char c = parser->pattern[parser->position++];
+        int16_t split = new_node(parser, REGEX_NODE_SPLIT);
+        int16_t end = new_node(parser, REGEX_NODE_JUMP);
+        if (end == REGEX_NO_NODE) return false;
+
+        regex->nodes[split].out = fragment->start;
+        regex->nodes[split].out1 = end;
+        regex->nodes[fragment->end].out = (c == '?') ? end : split;
+
+        if (c != '+') fragment->start = split;
+        fragment->end = end;
+    }
+    return true;
+}
+
+static bool parse_concatenation(regex_parser_t* parser, regex_fragment_t* fragment) {
+    int16_t empty = new_node(parser, REGEX_NODE_JUMP);
+    if (empty == REGEX_NO_NODE) return false;
+
+    fragment->start = empty;
+    fragment->end = empty;
+
+    while (peek(parser) != '\0' && peek(parser) != '|' && peek(parser) != ')') {
+        regex_fragment_t next;
+        if (!parse_repeat(parser, &next)) return false;
+
+        parser->regex->nodes[fragment->end].out = next.start;
+        fragment->end = next.end;
+    }
+    return true;
+}
+
+static bool parse_alternation(regex_parser_t* parser, regex_fragment_t* fragment) {
+    if (!parse_concatenation(parser, fragment)) return false;
+
+    regex_t* regex = parser->regex;
+    while (peek(parser) == '|') {
+        parser->position++;
+
+        regex_fragment_t other;
+        if (!parse_concatenation(parser, &other)) return false;
+
+        int16_t split = new_node(parser, REGEX_NODE_SPLIT);
+        int16_t end = new_node(parser, REGEX_NODE_JUMP);
+        if (end == REGEX_NO_NODE) return false;
+
+        regex->nodes[split].out = fragment->start;
+        regex->nodes[split].out1 = other.start;
+        regex->nodes[fragment->end].out = end;
+        regex->nodes[other.end].out = end;
+        fragment->start = split;
+        fragment->end = end;
+    }
+    return true;
+}
+
+// Matching
+
+// Adds every node reachable from node without consuming a byte. Line
+// anchors are passed only where they hold.
+static void add_closure(const regex_t* regex, int16_t node, bool at_line_start, bool at_line_end,
+                        regex_set_t* set) {
+    int16_t stack[2 * REGEX_MAX_NODES + 1];
+    regex_set_t visited;
+    uint32_t depth = 0;
+
+    set_clear(&visited);
+    stack[depth++] = node;
+
+    while (depth > 0) {
+        int16_t current = stack[--depth];
+        if (current == REGEX_NO_NODE || set_has(&visited, (uint32_t)current)) continue;
+        set_add(&visited, (uint32_t)current);
+
+        const regex_node_t* n = &regex->nodes[current];
+        switch (n->type) {
+            case REGEX_NODE_SPLIT:
+                stack[depth++] = n->out1;
+                stack[depth++] = n->out;
+                break;
+            case REGEX_NODE_JUMP:
+                stack[depth++] = n->out;
+                break;
+            case REGEX_NODE_LINE_START:
+                if (at_line_start) stack[depth++] = n->out;
+                break;
+            case REGEX_NODE_LINE_END:
+                if (at_line_end) {
+                    stack[depth++] = n->out;
+                } else {
+                    set_add(set, (uint32_t)current);
+                }
+                break;
+            default:
+                set_add(set, (uint32_t)current);
+                break;
+        }
+    }
+}
+
+// Returns the index of the state for nodes, building it if needed. A full
+// cache is emptied first, which drops every state the caller knew of.
+static uint32_t find_state(regex_t* regex, const regex_set_t* nodes, bool at_line_start) {
+    for (uint32_t i = 0; i < regex->state_count; i++) {
+        regex_state_t* state = &regex->states[i];
+        if (state->at_line_start == at_line_start && set_equal(&state->nodes, nodes)) return i;
+    }
+
+    if (regex->state_count == REGEX_MAX_DFA_STATES) {
+        regex->state_count = 0;
+        regex->start_state = REGEX_UNKNOWN_STATE;
+        regex->flush_count++;
+    }
+
+    uint32_t index = regex->state_count++;
+    regex_state_t* state = &regex->states[index];
+    state->nodes = *nodes;
+    state->at_line_start = at_line_start;
+    state->accepts = false;
+    state->accepts_at_end = false;
+    state->is_dead = set_is_empty(nodes);
+    for (uint32_t c = 0; c < 256; c++) state->next[c] = REGEX_UNKNOWN_STATE;
+
+    for (uint32_t node = 0; node < regex->node_count; node++) {
+        if (!set_has(nodes, node)) continue;
+
+        if (regex->nodes[node].type == REGEX_NODE_MATCH) {
+            state->accepts = true;
+            state->accepts_at_end = true;
+        } else if (regex->nodes[node].type == REGEX_NODE_LINE_END && !state->accepts_at_end) {
+            regex_set_t at_end;
+            set_clear(&at_end);
+            add_closure(regex, (int16_t)node, at_line_start, true, &at_end);
+
+            for (uint32_t other = 0; other < regex->node_count; other++) {
+                if (set_has(&at_end, other) && regex->nodes[other].type == REGEX_NODE_MATCH) {
+                    state->accepts_at_end = true;
+                }
+            }
+        }
+    }
+    return index;
+}
+
+static uint32_t start_state(regex_t* regex) {
+    if (regex->start_state == REGEX_UNKNOWN_STATE) {
+        regex_set_t nodes;
+        set_clear(&nodes);
+        add_closure(regex, regex->start, true, false, &nodes);
+        regex->start_state = find_state(regex, &nodes, true);
+    }
+    return regex->start_state;
+}
+
+// Builds the transition from state on byte c.
+static uint32_t step(regex_t* regex, uint32_t index, uint8_t c) {
+    regex_set_t nodes = regex->restart;
+    const regex_state_t* state = &regex->states[index];
+
+    for (uint32_t node = 0; node < regex->node_count; node++) {
+        if (!set_has(&state->nodes, node)) continue;
+
+        const regex_node_t* n = &regex->nodes[node];
+        if (n->type == REGEX_NODE_CLASS && class_has(n, c)) {
+            add_closure(regex, n->out, false, false, &nodes);
+        }
+    }
+
+    uint32_t flush_count = regex->flush_count;
+    uint32_t next = find_state(regex, &nodes, false);
+
+    // If the cache was emptied, index now names some other state.
+    if (regex->flush_count == flush_count) {
+        regex->states[index].next[c] = (uint8_t)next;
+    }
+    return next;
+}
+
+regex_t* regex_compile(const char* pattern, const char** error) {
+    regex_t* regex = apollo_allocate_memory(sizeof(regex_t));
+    if (!regex) {
+        if (error) *error = "out of memory";
+        return NULL;
+    }
+
+    regex->node_count = 0;
+    regex->state_count = 0;
+    regex->start_state = REGEX_UNKNOWN_STATE;
+    regex->flush_count = 0;
+
+    regex_parser_t parser = {regex, pattern, 0, NULL};
+    regex_fragment_t fragment;
+
+    if (parse_alternation(&parser, &fragment) && peek(&parser) == ')') {
+        parser.error = "unmatched ')'";
+    }
+
+    int16_t match = REGEX_NO_NODE;
+    if (!parser.error) match = new_node(&parser, REGEX_NODE_MATCH);
+
+    if (parser.error) {
+        if (error) *error = parser.error;
+        apollo_free_memory(regex);
+        return NULL;
+    }
+
+    regex->nodes[fragment.end].out = match;
+    regex->start = fragment.start;
+
+    set_clear(&regex->restart);
+    add_closure(regex, regex->start, false, false, &regex->restart);
+    return regex;
+}
+
+void regex_free(regex_t* regex) {
+    apollo_free_memory(regex);
+}
+
+// The scan is one table lookup per byte; a transition is only built the
+// first time it is taken.
+bool regex_search(regex_t* regex, const char* line, uint32_t length) {
+    uint32_t index = start_state(regex);
+
+    for (uint32_t i = 0; i < length; i++) {
+        const regex_state_t* state = &regex->states[index];
+        if (state->accepts) return true;
+        if (state->is_dead) return false;
+
+        uint8_t c = (uint8_t)line[i];
+        uint8_t next = state->next[c];
+        index = (next != REGEX_UNKNOWN_STATE) ? next : step(regex, index, c);
+    }
+    return regex->states[index].accepts_at_end;
+}
+
+bool regex_is_literal(const char* pattern) {
+    for (const char* p = pattern; *p; p++) {
+        switch (*p) {
+            case '.': case '[': case ']': case '(': case ')': case '|':
+            case '*': case '+': case '?': case '^': case '$': case '\\':
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
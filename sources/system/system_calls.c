@@ -0,0 +1,263 @@
+#include "system_calls.h"
+#include "descriptor_tables.h"
+#include "process_manager.h"
+#include "address_space.h"
+#include "frame_allocator.h"
+#include "terminal.h"
+#include "filesystem.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MSR_EFER 0xC0000080
+#define MSR_STAR 0xC0000081
+#define MSR_LSTAR 0xC0000082
+#define MSR_SFMASK 0xC0000084
+
+#define EFER_SYSCALL_ENABLE 0x01
+
+// IF, TF, DF, NT and AC are cleared on entry.
+#define SYSCALL_RFLAGS_MASK 0x44700
+
+// SYSRET loads CS from STAR[63:48] + 16 and SS from STAR[63:48] + 8, so the
+// user base selector sits just below the user data descriptor.
+#define STAR_SYSRET_BASE (GDT_USER_DATA_SELECTOR - 8 - 3)
+
+#define SYSTEM_CALL_MAX_WRITE 4096
+#define SYSTEM_CALL_MAX_IO (64 * 1024)
+
+typedef uint64_t (*system_call_handler_t)(uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                                          uint64_t arg3, uint64_t arg4);
+
+extern void system_call_entry(void);
+extern uint8_t user_benchmark_blob_start[];
+extern uint8_t user_benchmark_blob_end[];
+extern user_registers_t user_saved_registers;
+
+static inline uint64_t read_msr(uint32_t msr) {
+    uint32_t low, high;
+    __asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void write_msr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t read_timestamp(void) {
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static bool is_user_range(uint64_t address, uint64_t length) {
+    return address >= ADDRESS_SPACE_USER_BASE &&
+           address <= ADDRESS_SPACE_USER_LIMIT &&
+           length <= ADDRESS_SPACE_USER_LIMIT - address;
+}
+
+static bool copy_user_path(uint64_t address, char* path) {
+    if (!is_user_range(address, 1)) return false;
+
+    const char* source = (const char*)(uintptr_t)address;
+    for (uint32_t i = 0; i < FS_MAX_PATH_LENGTH; i++) {
+        if (!is_user_range(address + i, 1)) return false;
+        path[i] = source[i];
+        if (path[i] == '\0') return true;
+    }
+    return false;
+}
+
+static fs_file_handle_t* current_file(uint64_t fd) {
+    if (fd >= FS_MAX_OPEN_FILES) return NULL;
+    return filesystem_fd_get(process_get_fd_table(process_get_current_pid()), (int32_t)fd);
+}
+
+static uint64_t sys_exit(uint64_t status, uint64_t arg1, uint64_t arg2,
+                         uint64_t arg3, uint64_t arg4) {
+    (void)arg1; (void)arg2; (void)arg3; (void)arg4;
+    process_exit_user_mode((int32_t)status);
+    return SYSTEM_CALL_ERROR;
+}
+
+static uint64_t sys_write(uint64_t buffer, uint64_t length, uint64_t arg2,
+                          uint64_t arg3, uint64_t arg4) {
+    (void)arg2; (void)arg3; (void)arg4;
+
+    if (length > SYSTEM_CALL_MAX_WRITE || !is_user_range(buffer, length)) {
+        return SYSTEM_CALL_ERROR;
+    }
+
+    const char* text = (const char*)(uintptr_t)buffer;
+    for (uint64_t i = 0; i < length; i++) {
+        terminal_write_char(text[i]);
+    }
+
+    return length;
+}
+
+static uint64_t sys_getpid(uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                           uint64_t arg3, uint64_t arg4) {
+    (void)arg0; (void)arg1; (void)arg2; (void)arg3; (void)arg4;
+    return process_get_current_pid();
+}
+
+// The child is left READY and resumes just after the syscall instruction
+// with the parent's registers and rax = 0 once it is run; the parent gets
+// the child's pid.
+static uint64_t sys_fork(uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                         uint64_t arg3, uint64_t arg4) {
+    (void)arg0; (void)arg1; (void)arg2; (void)arg3; (void)arg4;
+
+    uint32_t child = process_fork(process_get_current_pid(), &user_saved_registers);
+
+    return child ? child : SYSTEM_CALL_ERROR;
+}
+
+static uint64_t sys_open(uint64_t path_address, uint64_t write_mode, uint64_t arg2,
+                         uint64_t arg3, uint64_t arg4) {
+    (void)arg2; (void)arg3; (void)arg4;
+
+    char path[FS_MAX_PATH_LENGTH];
+    if (!copy_user_path(path_address, path)) return SYSTEM_CALL_ERROR;
+
+    int32_t fd = filesystem_fd_open(process_get_fd_table(process_get_current_pid()),
+                                    path, write_mode != 0);
+    return fd >= 0 ? (uint64_t)fd : SYSTEM_CALL_ERROR;
+}
+
+static uint64_t sys_close(uint64_t fd, uint64_t arg1, uint64_t arg2,
+                          uint64_t arg3, uint64_t arg4) {
+    (void)arg1; (void)arg2; (void)arg3; (void)arg4;
+
+    if (!current_file(fd)) return SYSTEM_CALL_ERROR;
+    filesystem_fd_close(process_get_fd_table(process_get_current_pid()), (int32_t)fd);
+    return 0;
+}
+
+static uint64_t sys_dup(uint64_t fd, uint64_t arg1, uint64_t arg2,
+                        uint64_t arg3, uint64_t arg4) {
+    (void)arg1; (void)arg2; (void)arg3; (void)arg4;
+
+    if (!current_file(fd)) return SYSTEM_CALL_ERROR;
+    int32_t copy = filesystem_fd_dup(process_get_fd_table(process_get_current_pid()), (int32_t)fd);
+    return copy >= 0 ? (uint64_t)copy : SYSTEM_CALL_ERROR;
+}
+
+static uint64_t sys_read(uint64_t fd, uint64_t buffer, uint64_t length,
+                         uint64_t arg3, uint64_t arg4) {
+    (void)arg3; (void)arg4;
+
+    fs_file_handle_t* handle = current_file(fd);
+    if (!handle || length > SYSTEM_CALL_MAX_IO || !is_user_range(buffer, length)) {
+        return SYSTEM_CALL_ERROR;
+    }
+
+    return filesystem_read_file(handle, (void*)(uintptr_t)buffer, (uint32_t)length);
+}
+
+static uint64_t sys_pread(uint64_t fd, uint64_t buffer, uint64_t length,
+                          uint64_t offset, uint64_t arg4) {
+    (void)arg4;
+
+    fs_file_handle_t* handle = current_file(fd);
+    if (!handle || length > SYSTEM_CALL_MAX_IO || offset > UINT32_MAX ||
+        !is_user_range(buffer, length)) {
+        return SYSTEM_CALL_ERROR;
+    }
+
+    return filesystem_pread(handle, (void*)(uintptr_t)buffer, (uint32_t)length, (uint32_t)offset);
+}
+
+static uint64_t sys_pwrite(uint64_t fd, uint64_t buffer, uint64_t length,
+                           uint64_t offset, uint64_t arg4) {
+    (void)arg4;
+
+    fs_file_handle_t* handle = current_file(fd);
+    if (!handle || length > SYSTEM_CALL_MAX_IO || offset > UINT32_MAX ||
+        !is_user_range(buffer, length)) {
+        return SYSTEM_CALL_ERROR;
+    }
+
+    return filesystem_pwrite(handle, (const void*)(uintptr_t)buffer, (uint32_t)length,
+                             (uint32_t)offset);
+}
+
+static const system_call_handler_t system_call_table[SYSTEM_CALL_COUNT] = {
+    [SYS_EXIT] = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_GETPID] = sys_getpid,
+    [SYS_FORK] = sys_fork,
+    [SYS_OPEN] = sys_open,
+    [SYS_CLOSE] = sys_close,
+    [SYS_DUP] = sys_dup,
+    [SYS_READ] = sys_read,
+    [SYS_PREAD] = sys_pread,
+    [SYS_PWRITE] = sys_pwrite,
+};
+
+uint64_t system_call_dispatch(uint64_t number, uint64_t arg0, uint64_t arg1,
+                              uint64_t arg2, uint64_t arg3, uint64_t arg4) {
+    if (number >= SYSTEM_CALL_COUNT || !system_call_table[number]) {
+        return SYSTEM_CALL_ERROR;
+    }
+
+    return system_call_table[number](arg0, arg1, arg2, arg3, arg4);
+}
+
+void system_calls_initialize(void) {
+    write_msr(MSR_EFER, read_msr(MSR_EFER) | EFER_SYSCALL_ENABLE);
+    write_msr(MSR_STAR, ((uint64_t)STAR_SYSRET_BASE << 48) |
+                        ((uint64_t)GDT_KERNEL_CODE_SELECTOR << 32));
+    write_msr(MSR_LSTAR, (uint64_t)(uintptr_t)system_call_entry);
+    write_msr(MSR_SFMASK, SYSCALL_RFLAGS_MASK);
+}
+
+uint64_t system_call_benchmark(uint32_t iterations) {
+    if (iterations == 0) return 0;
+
+    uint32_t pid = process_create("sysbench", PROCESS_TYPE_USER, NULL);
+    process_t info;
+    if (pid == 0 || !process_get_info(pid, &info)) return 0;
+
+    uint8_t* code = frame_allocator_allocate();
+    uint8_t* stack = frame_allocator_allocate();
+    uint64_t blob_size = (uint64_t)(user_benchmark_blob_end - user_benchmark_blob_start);
+
+    if (!code || !stack || blob_size > FRAME_SIZE) {
+        frame_allocator_free(code);
+        frame_allocator_free(stack);
+        process_terminate(pid);
+        return 0;
+    }
+
+    for (uint64_t i = 0; i < blob_size; i++) {
+        code[i] = user_benchmark_blob_start[i];
+    }
+
+    uint64_t code_address = ADDRESS_SPACE_USER_BASE;
+    uint64_t stack_address = PROCESS_USER_STACK_TOP - FRAME_SIZE;
+
+    if (!address_space_map_page(info.address_space, code_address,
+                                (uint64_t)(uintptr_t)code, PAGE_USER)) {
+        frame_allocator_free(code);
+        frame_allocator_free(stack);
+        process_terminate(pid);
+        return 0;
+    }
+
+    if (!address_space_map_page(info.address_space, stack_address,
+                                (uint64_t)(uintptr_t)stack, PAGE_USER | PAGE_WRITABLE)) {
+        frame_allocator_free(stack);
+        process_terminate(pid);
+        return 0;
+    }
+
+    uint64_t start = read_timestamp();
+    int32_t status = process_run_user_mode(pid, code_address, PROCESS_USER_STACK_TOP,
+                                           iterations, 0);
+    uint64_t elapsed = read_timestamp() - start;
+
+    process_terminate(pid);
+
+    return status == 0 ? elapsed / iterations : 0;
+}
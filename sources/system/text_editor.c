@@ -20,6 +20,10 @@ typedef struct {
 
 static text_editor_state_t editor = {0};
 
+// Each line and its newline, so a save is a single vectored write.
+static fs_iovec_t save_vectors[TEXT_EDITOR_MAX_LINES * 2];
+static char newline[] = "\n";
+
 static uint32_t string_length(const char* str) {
     uint32_t len = 0;
     while (str && str[len] != '\0') len++;
@@ -384,8 +388,8 @@ static bool save_file(void) {
         return false;
     }
     
-    fs_file_handle_t* handle = filesystem_open_file(editor.filename, true);
-    if (!handle) {
+    fs_file_handle_t handle;
+    if (!filesystem_open_handle(editor.filename, true, &handle)) {
         if (!filesystem_create_file(editor.filename)) {
             terminal_clear();
             terminal_set_color(12, 0); // Red
@@ -401,8 +405,7 @@ static bool save_file(void) {
             return false;
         }
         
-        handle = filesystem_open_file(editor.filename, true);
-        if (!handle) {
+        if (!filesystem_open_handle(editor.filename, true, &handle)) {
             terminal_clear();
             terminal_set_color(12, 0); // Red
             terminal_write_string("Error: Cannot open file for writing\n");
@@ -416,17 +419,45 @@ static bool save_file(void) {
         }
     }
     
+    filesystem_truncate_file(&handle, 0);
+    
+    uint32_t vector_count = 0;
+    uint32_t total_length = 0;
     for (uint32_t i = 0; i < editor.line_count; i++) {
         uint32_t line_len = string_length(editor.lines[i]);
         if (line_len > 0) {
-            filesystem_write_file(handle, editor.lines[i], line_len);
+            save_vectors[vector_count].base = editor.lines[i];
+            save_vectors[vector_count++].length = line_len;
+            total_length += line_len;
         }
         if (i < editor.line_count - 1) {
-            filesystem_write_file(handle, "\n", 1);
+            save_vectors[vector_count].base = newline;
+            save_vectors[vector_count++].length = 1;
+            total_length++;
         }
     }
+    uint32_t written = filesystem_writev(&handle, save_vectors, vector_count);
     
-    filesystem_close_file(handle);
+    filesystem_release_handle(&handle);
+    
+    if (written != total_length) {
+        terminal_clear();
+        terminal_set_color(12, 0); // Red
+        terminal_write_string("Error: Only ");
+        terminal_write_uint(written);
+        terminal_write_string(" of ");
+        terminal_write_uint(total_length);
+        terminal_write_string(" bytes were written to ");
+        terminal_write_string(editor.filename);
+        terminal_write_string("\n");
+        terminal_set_color(7, 0);
+        terminal_write_string("Press any key to continue...");
+        while (!input_manager_has_input()) {
+            __asm__ volatile("pause");
+        }
+        input_manager_read_scancode();
+        return false;
+    }
     
     terminal_clear();
     terminal_set_color(10, 0); // Green
@@ -612,32 +643,35 @@ bool text_editor_load_file(const char* filename) {
         return true;
     }
     
-    fs_file_handle_t* handle = filesystem_open_file(filename, false);
-    if (!handle) {
+    fs_file_handle_t handle;
+    if (!filesystem_open_handle(filename, false, &handle)) {
         return false;
     }
     
     text_editor_new_file();
     
-    char buffer[FS_BLOCK_SIZE];
-    uint32_t bytes_read = filesystem_read_file(handle, buffer, FS_BLOCK_SIZE - 1);
-    buffer[bytes_read] = '\0';
-    
-    filesystem_close_file(handle);
-    
+    const void* piece;
+    uint32_t piece_length;
     uint32_t line_pos = 0;
     uint32_t char_pos = 0;
     
-    for (uint32_t i = 0; i < bytes_read && line_pos < TEXT_EDITOR_MAX_LINES; i++) {
-        if (buffer[i] == '\n') {
-            editor.lines[line_pos][char_pos] = '\0';
-            line_pos++;
-            char_pos = 0;
-        } else if (char_pos < TEXT_EDITOR_MAX_LINE_LENGTH - 1) {
-            editor.lines[line_pos][char_pos++] = buffer[i];
+    // Lines are filled straight from the mapped file data.
+    while (line_pos < TEXT_EDITOR_MAX_LINES &&
+           filesystem_map_file(&handle, &piece, &piece_length)) {
+        const char* text = (const char*)piece;
+        for (uint32_t i = 0; i < piece_length && line_pos < TEXT_EDITOR_MAX_LINES; i++) {
+            if (text[i] == '\n') {
+                editor.lines[line_pos][char_pos] = '\0';
+                line_pos++;
+                char_pos = 0;
+            } else if (char_pos < TEXT_EDITOR_MAX_LINE_LENGTH - 1) {
+                editor.lines[line_pos][char_pos++] = text[i];
+            }
         }
     }
     
+    filesystem_release_handle(&handle);
+    
     if (char_pos > 0 || line_pos == 0) {
         editor.lines[line_pos][char_pos] = '\0';
         line_pos++;
@@ -0,0 +1,343 @@
+#include "text_index.h"
+#include "heap_allocator.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// What the postings say about a file's current contents.
+typedef enum {
+    TEXT_FILE_FREE = 0,
+    TEXT_FILE_COMPLETE,    // Every trigram of the file is posted
+    TEXT_FILE_BUILDING,    // Posted up to length while being read through
+    TEXT_FILE_STALE        // Changed in a way the index did not follow
+} text_file_state_t;
+
+// File ids run from 1; 0 ends the hash chains and the free list.
+typedef struct {
+    const void* volume;
+    uint32_t node;
+    uint32_t length;       // Bytes from the start of the file already posted
+    uint8_t tail[2];       // The last two of them
+    uint8_t tail_run;      // How many of tail follow the last line break
+    uint8_t state;
+    bool has_postings;
+    uint16_t next;
+} text_file_t;
+
+// Sorted file ids.
+typedef struct {
+    uint16_t* ids;
+    uint16_t count;
+    uint16_t capacity;
+} text_posting_list_t;
+
+typedef struct {
+    text_file_t files[TEXT_INDEX_MAX_FILES + 1];
+    uint16_t file_buckets[TEXT_INDEX_FILE_BUCKETS];
+    uint16_t free_head;
+    text_posting_list_t postings[TEXT_INDEX_BUCKETS];
+    bool is_initialized;
+} text_index_state_t;
+
+static text_index_state_t text_index = {0};
+
+static void memory_move_ids(uint16_t* dest, const uint16_t* src, uint32_t count) {
+    if (dest < src) {
+        for (uint32_t i = 0; i < count; i++) dest[i] = src[i];
+    } else {
+        for (uint32_t i = count; i > 0; i--) dest[i - 1] = src[i - 1];
+    }
+}
+
+static void initialize(void) {
+    if (text_index.is_initialized) return;
+
+    for (uint32_t id = TEXT_INDEX_MAX_FILES; id >= 1; id--) {
+        text_index.files[id].next = text_index.free_head;
+        text_index.free_head = (uint16_t)id;
+    }
+    text_index.is_initialized = true;
+}
+
+static uint32_t file_bucket(const void* volume, uint32_t node) {
+    uint32_t key = (uint32_t)((uintptr_t)volume >> 4) ^ node;
+    return ((key * 2654435761U) >> 24) & (TEXT_INDEX_FILE_BUCKETS - 1);
+}
+
+static uint32_t trigram_bucket(uint8_t a, uint8_t b, uint8_t c) {
+    uint32_t trigram = (uint32_t)a << 16 | (uint32_t)b << 8 | c;
+    return ((trigram * 2654435761U) >> 20) & (TEXT_INDEX_BUCKETS - 1);
+}
+
+// Trigrams never span a line, since a search never does, and never hold a
+// NUL, which no pattern can contain.
+static bool breaks_trigrams(uint8_t c) {
+    return c == '\n' || c == '\0';
+}
+
+static uint16_t find_file(const void* volume, uint32_t node) {
+    uint16_t id = text_index.file_buckets[file_bucket(volume, node)];
+    while (id != 0) {
+        text_file_t* file = &text_index.files[id];
+        if (file->volume == volume && file->node == node) return id;
+        id = file->next;
+    }
+    return 0;
+}
+
+static uint16_t add_file(const void* volume, uint32_t node) {
+    initialize();
+
+    uint16_t id = text_index.free_head;
+    if (id == 0) return 0;
+
+    text_file_t* file = &text_index.files[id];
+    text_index.free_head = file->next;
+
+    uint32_t bucket = file_bucket(volume, node);
+    file->volume = volume;
+    file->node = node;
+    file->length = 0;
+    file->tail_run = 0;
+    file->state = TEXT_FILE_STALE;
+    file->has_postings = false;
+    file->next = text_index.file_buckets[bucket];
+    text_index.file_buckets[bucket] = id;
+    return id;
+}
+
+// First position in list not below id.
+static uint32_t posting_position(const text_posting_list_t* list, uint16_t id) {
+    uint32_t low = 0;
+    uint32_t high = list->count;
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        if (list->ids[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static bool posting_contains(const text_posting_list_t* list, uint16_t id) {
+    uint32_t position = posting_position(list, id);
+    return position < list->count && list->ids[position] == id;
+}
+
+static bool posting_insert(text_posting_list_t* list, uint16_t id) {
+    uint32_t position = posting_position(list, id);
+    if (position < list->count && list->ids[position] == id) return true;
+
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 4;
+        if (capacity > TEXT_INDEX_MAX_FILES) capacity = TEXT_INDEX_MAX_FILES;
+
+        uint16_t* ids = apollo_reallocate_memory(list->ids, capacity * sizeof(uint16_t));
+        if (!ids) return false;
+
+        list->ids = ids;
+        list->capacity = (uint16_t)capacity;
+    }
+
+    memory_move_ids(list->ids + position + 1, list->ids + position, list->count - position);
+    list->ids[position] = id;
+    list->count++;
+    return true;
+}
+
+static void posting_remove(text_posting_list_t* list, uint16_t id) {
+    uint32_t position = posting_position(list, id);
+    if (position == list->count || list->ids[position] != id) return;
+
+    memory_move_ids(list->ids + position, list->ids + position + 1, list->count - position - 1);
+    list->count--;
+}
+
+// Forgets everything posted for the file, leaving it empty.
+static void clear_file(uint16_t id) {
+    text_file_t* file = &text_index.files[id];
+
+    if (file->has_postings) {
+        for (uint32_t bucket = 0; bucket < TEXT_INDEX_BUCKETS; bucket++) {
+            posting_remove(&text_index.postings[bucket], id);
+        }
+        file->has_postings = false;
+    }
+    file->length = 0;
+    file->tail_run = 0;
+}
+
+static void remove_file(uint16_t id) {
+    clear_file(id);
+
+    text_file_t* file = &text_index.files[id];
+    uint16_t* link = &text_index.file_buckets[file_bucket(file->volume, file->node)];
+    while (*link != id) link = &text_index.files[*link].next;
+    *link = file->next;
+
+    file->state = TEXT_FILE_FREE;
+    file->volume = NULL;
+    file->next = text_index.free_head;
+    text_index.free_head = id;
+}
+
+// Posts the trigrams of data, which continues the file from its length.
+// Each bucket is touched at most once per call.
+static bool append_text(uint16_t id, const uint8_t* data, uint32_t size) {
+    text_file_t* file = &text_index.files[id];
+    uint64_t seen[TEXT_INDEX_BUCKETS / 64] = {0};
+    uint8_t a = file->tail[0];
+    uint8_t b = file->tail[1];
+    uint32_t run = file->tail_run;
+
+    for (uint32_t i = 0; i < size; i++) {
+        uint8_t c = data[i];
+
+        if (breaks_trigrams(c)) {
+            run = 0;
+        } else if (++run >= 3) {
+            uint32_t bucket = trigram_bucket(a, b, c);
+            uint64_t bit = 1ULL << (bucket % 64);
+
+            if (!(seen[bucket / 64] & bit)) {
+                seen[bucket / 64] |= bit;
+                if (!posting_insert(&text_index.postings[bucket], id)) return false;
+                file->has_postings = true;
+            }
+        }
+
+        a = b;
+        b = c;
+    }
+
+    file->tail[0] = a;
+    file->tail[1] = b;
+    file->tail_run = (uint8_t)(run < 2 ? run : 2);
+    file->length += size;
+    return true;
+}
+
+void text_index_file_created(const void* volume, uint32_t node) {
+    uint16_t id = find_file(volume, node);
+    if (id == 0) id = add_file(volume, node);
+    if (id == 0) return;
+
+    clear_file(id);
+    text_index.files[id].state = TEXT_FILE_COMPLETE;
+}
+
+// Appends keep a file complete. Any other write could have replaced bytes
+// whose trigrams are posted, or sit next to bytes the index never saw.
+void text_index_file_written(const void* volume, uint32_t node, uint32_t offset,
+                             const void* data, uint32_t size) {
+    uint16_t id = find_file(volume, node);
+    if (id == 0 || size == 0) return;
+
+    text_file_t* file = &text_index.files[id];
+    if (file->state != TEXT_FILE_COMPLETE) {
+        file->state = TEXT_FILE_STALE;
+        return;
+    }
+
+    if (offset != file->length || !append_text(id, data, size)) {
+        file->state = TEXT_FILE_STALE;
+    }
+}
+
+void text_index_file_truncated(const void* volume, uint32_t node, uint32_t size) {
+    uint16_t id = find_file(volume, node);
+    if (id == 0) return;
+
+    text_file_t* file = &text_index.files[id];
+    if (size == 0) {
+        clear_file(id);
+        file->state = TEXT_FILE_COMPLETE;
+    } else if (file->state != TEXT_FILE_COMPLETE || size != file->length) {
+        file->state = TEXT_FILE_STALE;
+    }
+}
+
+void text_index_file_removed(const void* volume, uint32_t node) {
+    uint16_t id = find_file(volume, node);
+    if (id != 0) remove_file(id);
+}
+
+// A read from offset 0 of a file the index cannot vouch for starts it over;
+// reads that carry on from where the last one stopped are posted as they go.
+void text_index_file_read(const void* volume, uint32_t node, uint32_t offset,
+                          const void* data, uint32_t size) {
+    uint16_t id = find_file(volume, node);
+    if (id != 0 && text_index.files[id].state == TEXT_FILE_COMPLETE) return;
+
+    if (offset == 0) {
+        if (id == 0) id = add_file(volume, node);
+        if (id == 0) return;
+
+        clear_file(id);
+        text_index.files[id].state = TEXT_FILE_BUILDING;
+    }
+    if (id == 0) return;
+
+    text_file_t* file = &text_index.files[id];
+    if (file->state != TEXT_FILE_BUILDING || offset != file->length) return;
+
+    if (!append_text(id, data, size)) {
+        file->state = TEXT_FILE_STALE;
+    }
+}
+
+void text_index_file_read_done(const void* volume, uint32_t node, uint32_t file_size) {
+    uint16_t id = find_file(volume, node);
+    if (id == 0) return;
+
+    text_file_t* file = &text_index.files[id];
+    if (file->state == TEXT_FILE_BUILDING && file->length == file_size) {
+        file->state = TEXT_FILE_COMPLETE;
+    }
+}
+
+// Intersects the posting lists of the pattern's trigrams, walking the
+// shortest and probing the others.
+void text_index_query(const char* pattern, text_index_query_t* query) {
+    for (uint32_t i = 0; i < TEXT_INDEX_MAX_FILES / 32; i++) {
+        query->candidates[i] = 0;
+    }
+
+    uint32_t length = 0;
+    while (pattern[length] != '\0') length++;
+
+    const text_posting_list_t* shortest = NULL;
+    for (uint32_t i = 0; i + 3 <= length; i++) {
+        uint32_t bucket = trigram_bucket(pattern[i], pattern[i + 1], pattern[i + 2]);
+        const text_posting_list_t* list = &text_index.postings[bucket];
+        if (!shortest || list->count < shortest->count) shortest = list;
+    }
+
+    query->is_filtered = shortest != NULL;
+    if (!shortest) return;
+
+    for (uint32_t n = 0; n < shortest->count; n++) {
+        uint16_t id = shortest->ids[n];
+        bool everywhere = true;
+
+        for (uint32_t i = 0; i + 3 <= length && everywhere; i++) {
+            uint32_t bucket = trigram_bucket(pattern[i], pattern[i + 1], pattern[i + 2]);
+            everywhere = posting_contains(&text_index.postings[bucket], id);
+        }
+
+        if (everywhere) {
+            query->candidates[(id - 1) / 32] |= 1U << ((id - 1) % 32);
+        }
+    }
+}
+
+bool text_index_may_contain(const text_index_query_t* query, const void* volume, uint32_t node) {
+    if (!query->is_filtered) return true;
+
+    uint16_t id = find_file(volume, node);
+    if (id == 0 || text_index.files[id].state != TEXT_FILE_COMPLETE) return true;
+
+    return (query->candidates[(id - 1) / 32] >> ((id - 1) % 32)) & 1;
+}
@@ -1,5 +1,6 @@
 #include "time_keeper.h"
 #include <stdint.h>
+#include <stddef.h>
 
 #define CMOS_ADDRESS_PORT 0x70
 #define CMOS_DATA_PORT 0x71
@@ -14,6 +15,27 @@
 #define RTC_STATUS_A 0x0A
 #define RTC_STATUS_B 0x0B
 
+#define PIT_CHANNEL2_PORT 0x42
+#define PIT_COMMAND_PORT 0x43
+#define PIT_GATE_PORT 0x61
+#define PIT_FREQUENCY 1193182
+#define PIT_CALIBRATION_HZ 100  // 10ms calibration window
+#define PIT_CALIBRATION_POLL_LIMIT 10000000  // Well past 10ms of port reads
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+#define TSC_SCALE_SHIFT 32
+
+// Padded to a whole page because it is mapped into user address spaces.
+static union {
+    time_page_t page;
+    uint8_t padding[4096];
+} time_page_storage __attribute__((aligned(4096)));
+
+static time_page_t* const time_page = &time_page_storage.page;
+
+// RTC time at boot, counted from for uptime while the TSC is uncalibrated.
+static uint64_t rtc_boot_seconds = 0;
+
 static inline void outb(uint16_t port, uint8_t data) {
     __asm__ volatile("outb %0, %1" : : "a"(data), "Nd"(port));
 }
@@ -37,7 +59,7 @@ static bool rtc_update_in_progress(void) {
     return (read_rtc_register(RTC_STATUS_A) & 0x80) != 0;
 }
 
-void time_keeper_get_datetime(int* year, int* month, int* day, int* hour, int* minute, int* second) {
+static void read_rtc_datetime(int* year, int* month, int* day, int* hour, int* minute, int* second) {
     uint8_t century;
     uint8_t last_second, last_minute, last_hour, last_day, last_month, last_year, last_century;
     
@@ -102,6 +124,79 @@ void time_keeper_get_datetime(int* year, int* month, int* day, int* hour, int* m
     }
 }
 
+static int64_t days_from_civil(int64_t year, int64_t month, int64_t day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+static void civil_from_days(int64_t days, int* year, int* month, int* day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t day_of_era = days - era * 146097;
+    int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int64_t month_index = (5 * day_of_year + 2) / 153;
+
+    *day = (int)(day_of_year - (153 * month_index + 2) / 5 + 1);
+    *month = (int)(month_index < 10 ? month_index + 3 : month_index - 9);
+    *year = (int)(year_of_era + era * 400 + (*month <= 2));
+}
+
+static uint64_t rtc_epoch_seconds(void) {
+    int year, month, day, hour, minute, second;
+    read_rtc_datetime(&year, &month, &day, &hour, &minute, &second);
+
+    return (uint64_t)days_from_civil(year, month, day) * 86400 +
+           (uint64_t)hour * 3600 + (uint64_t)minute * 60 + (uint64_t)second;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    __asm__ volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static uint64_t calibrate_tsc_frequency(void) {
+    uint16_t count = PIT_FREQUENCY / PIT_CALIBRATION_HZ;
+
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (gate & ~0x02) | 0x01);  // Speaker off, gate on
+
+    outb(PIT_COMMAND_PORT, 0xB0);  // Channel 2, lobyte/hibyte, mode 0
+    outb(PIT_CHANNEL2_PORT, count & 0xFF);
+    outb(PIT_CHANNEL2_PORT, count >> 8);
+
+    gate = inb(PIT_GATE_PORT) & ~0x01;
+    outb(PIT_GATE_PORT, gate);
+    outb(PIT_GATE_PORT, gate | 0x01);
+
+    // Some hypervisors never raise channel 2's output; give up rather than
+    // hang the boot.
+    uint64_t start = time_page_read_tsc();
+    uint32_t polls = 0;
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        if (++polls == PIT_CALIBRATION_POLL_LIMIT) return 0;
+        __asm__ volatile("pause");
+    }
+    uint64_t end = time_page_read_tsc();
+
+    return (end - start) * PIT_CALIBRATION_HZ;
+}
+
+static void publish_time_page(uint64_t tsc_base, uint64_t monotonic_base_ns, uint64_t wall_base_ns) {
+    time_page->sequence++;
+    __asm__ volatile("" ::: "memory");
+
+    time_page->tsc_base = tsc_base;
+    time_page->monotonic_base_ns = monotonic_base_ns;
+    time_page->wall_base_ns = wall_base_ns;
+
+    __asm__ volatile("" ::: "memory");
+    time_page->sequence++;
+}
+
 void time_keeper_initialize(void) {
     uint8_t status_b = read_rtc_register(RTC_STATUS_B);
     status_b |= 0x02; // 24-hour format
@@ -111,36 +206,84 @@ void time_keeper_initialize(void) {
     outb(CMOS_DATA_PORT, status_b);
     
     read_rtc_register(0x0C);
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000007) {
+        cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        if (edx & (1U << 8)) {
+            time_page->flags |= TIME_PAGE_FLAG_INVARIANT_TSC;
+        }
+    }
+
+    uint64_t frequency = calibrate_tsc_frequency();
+    if (frequency == 0) {
+        rtc_boot_seconds = rtc_epoch_seconds();
+        return;
+    }
+
+    uint64_t epoch_seconds = rtc_epoch_seconds();
+    uint64_t tsc_base = time_page_read_tsc();
+
+    time_page->tsc_frequency = frequency;
+    time_page->tsc_multiplier = (NANOSECONDS_PER_SECOND << TSC_SCALE_SHIFT) / frequency;
+    time_page->tsc_shift = TSC_SCALE_SHIFT;
+    publish_time_page(tsc_base, 0, epoch_seconds * NANOSECONDS_PER_SECOND);
+    time_page->flags |= TIME_PAGE_FLAG_CALIBRATED;
+}
+
+void time_keeper_get_datetime(int* year, int* month, int* day, int* hour, int* minute, int* second) {
+    if (!(time_page->flags & TIME_PAGE_FLAG_CALIBRATED)) {
+        read_rtc_datetime(year, month, day, hour, minute, second);
+        return;
+    }
+
+    uint64_t seconds = time_keeper_get_wall_ns() / NANOSECONDS_PER_SECOND;
+    uint64_t seconds_of_day = seconds % 86400;
+
+    civil_from_days((int64_t)(seconds / 86400), year, month, day);
+    *hour = (int)(seconds_of_day / 3600);
+    *minute = (int)((seconds_of_day % 3600) / 60);
+    *second = (int)(seconds_of_day % 60);
 }
 
+// Without a calibrated TSC, uptime is counted in whole seconds on the RTC.
 uint64_t time_keeper_get_uptime_seconds(void) {
-    // In the feuture, this would track time since boot
-    static uint64_t boot_time = 0;
-    static bool initialized = false;
-    
-    if (!initialized) {
-        int year, month, day, hour, minute, second;
-        time_keeper_get_datetime(&year, &month, &day, &hour, &minute, &second);
-        
-        boot_time = (uint64_t)year * 365 * 24 * 3600 + 
-                   (uint64_t)month * 30 * 24 * 3600 + 
-                   (uint64_t)day * 24 * 3600 + 
-                   (uint64_t)hour * 3600 + 
-                   (uint64_t)minute * 60 + 
-                   (uint64_t)second;
-        initialized = true;
-        return 0;
+    if (!(time_page->flags & TIME_PAGE_FLAG_CALIBRATED)) {
+        uint64_t now = rtc_epoch_seconds();
+        if (rtc_boot_seconds == 0) rtc_boot_seconds = now;
+        return now - rtc_boot_seconds;
     }
-    
-    int year, month, day, hour, minute, second;
-    time_keeper_get_datetime(&year, &month, &day, &hour, &minute, &second);
-    
-    uint64_t current_time = (uint64_t)year * 365 * 24 * 3600 + 
-                           (uint64_t)month * 30 * 24 * 3600 + 
-                           (uint64_t)day * 24 * 3600 + 
-                           (uint64_t)hour * 3600 + 
-                           (uint64_t)minute * 60 + 
-                           (uint64_t)second;
-    
-    return current_time - boot_time;
+
+    return time_keeper_get_monotonic_ns() / NANOSECONDS_PER_SECOND;
+}
+
+uint64_t time_keeper_get_monotonic_ns(void) {
+    if (!(time_page->flags & TIME_PAGE_FLAG_CALIBRATED)) return 0;
+
+    uint64_t monotonic_ns;
+    time_page_read(time_page, &monotonic_ns, NULL);
+    return monotonic_ns;
+}
+
+uint64_t time_keeper_get_wall_ns(void) {
+    if (!(time_page->flags & TIME_PAGE_FLAG_CALIBRATED)) return 0;
+
+    uint64_t wall_ns;
+    time_page_read(time_page, NULL, &wall_ns);
+    return wall_ns;
+}
+
+const time_page_t* time_keeper_get_time_page(void) {
+    return time_page;
+}
+
+void time_keeper_update_time_page(void) {
+    if (!(time_page->flags & TIME_PAGE_FLAG_CALIBRATED)) return;
+
+    uint64_t now = time_page_read_tsc();
+    uint64_t elapsed = time_page_scale_ticks(now - time_page->tsc_base,
+                                             time_page->tsc_multiplier, time_page->tsc_shift);
+
+    publish_time_page(now, time_page->monotonic_base_ns + elapsed, time_page->wall_base_ns + elapsed);
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+// Host-side tool: serializes a directory tree into the root filesystem image
+// that is linked into the kernel and mounted at first boot.
+//
+//     mkrootfs <directory> <image>
+//
+// Directories and regular files are copied; names starting with '.' are
+// skipped, so empty directories can be kept in git with a .keep file. A file
+// whose owner execute bit is set gets FS_PERM_EXECUTE. Files of up to
+// FS_INLINE_DATA_SIZE bytes are stored inline in their record; every other
+// file's data is laid out contiguously, so each file is a single extent.
+
+#define _DEFAULT_SOURCE
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "filesystem_image.h"
+
+#define FIRST_TIMESTAMP 1000
+
+static fs_disk_inode_t* records;
+static uint32_t record_count;
+static uint32_t record_capacity;
+
+static uint8_t* data;
+static uint32_t data_blocks;
+
+static uint32_t timestamp = FIRST_TIMESTAMP;
+
+static void fail(const char* message, const char* path) {
+    fprintf(stderr, "mkrootfs: %s: %s\n", path, message);
+    exit(1);
+}
+
+static uint32_t add_record(const char* path, const char* name, uint32_t parent_id,
+                           fs_file_type_t type, uint8_t permissions) {
+    if (strlen(name) >= FS_MAX_FILENAME_LENGTH) fail("name too long", path);
+    if (record_count >= FS_MAX_FILES) fail("too many files", path);
+
+    if (record_count == record_capacity) {
+        record_capacity = record_capacity ? record_capacity * 2 : 64;
+        records = realloc(records, record_capacity * sizeof(fs_disk_inode_t));
+        if (!records) fail("out of memory", path);
+    }
+
+    fs_disk_inode_t* record = &records[record_count];
+    memset(record, 0, sizeof(*record));
+    strcpy(record->name, name);
+    record->parent_id = parent_id;
+    record->type = type;
+    record->permissions = permissions;
+    record->created_time = ++timestamp;
+    record->modified_time = record->created_time;
+
+    return record_count++;
+}
+
+static void read_contents(const char* path, void* dest, uint32_t size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) fail("cannot open", path);
+    if (fread(dest, 1, size, file) != size) fail("short read", path);
+    fclose(file);
+}
+
+static void add_file(const char* path, const char* name, uint32_t parent_id, const struct stat* info) {
+    if (info->st_size > FS_MAX_FILE_SIZE) fail("file too large", path);
+
+    uint8_t permissions = FS_PERM_READ | FS_PERM_WRITE;
+    if (info->st_mode & S_IXUSR) permissions |= FS_PERM_EXECUTE;
+
+    uint32_t file_id = add_record(path, name, parent_id, FS_TYPE_FILE, permissions);
+    uint32_t size = (uint32_t)info->st_size;
+
+    if (size <= FS_INLINE_DATA_SIZE) {
+        fs_disk_inode_t* record = &records[file_id];
+        record->size = size;
+        record->flags = FS_DISK_INODE_INLINE;
+        read_contents(path, record->inline_data, size);
+        return;
+    }
+
+    uint32_t blocks = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+
+    // Data block 0 means "no block", so the image's data starts at block 1.
+    if (data_blocks + blocks >= FS_MAX_BLOCKS) fail("image out of data blocks", path);
+
+    data = realloc(data, (size_t)(data_blocks + blocks) * FS_BLOCK_SIZE);
+    if (!data) fail("out of memory", path);
+
+    uint8_t* dest = data + (size_t)data_blocks * FS_BLOCK_SIZE;
+    memset(dest, 0, (size_t)blocks * FS_BLOCK_SIZE);
+
+    read_contents(path, dest, size);
+
+    fs_disk_inode_t* record = &records[file_id];
+    record->size = size;
+    record->extents[0].start_block = data_blocks + 1;
+    record->extents[0].block_count = blocks;
+    record->extent_count = 1;
+
+    data_blocks += blocks;
+}
+
+// Entries are visited in name order so the same tree always gives the same
+// image.
+static void add_directory(const char* path, uint32_t dir_id) {
+    struct dirent** entries;
+    int count = scandir(path, &entries, NULL, alphasort);
+    if (count < 0) fail("cannot read directory", path);
+
+    for (int i = 0; i < count; i++) {
+        const char* name = entries[i]->d_name;
+        if (name[0] == '.') {
+            free(entries[i]);
+            continue;
+        }
+
+        char child[4096];
+        if (snprintf(child, sizeof(child), "%s/%s", path, name) >= (int)sizeof(child)) {
+            fail("path too long", path);
+        }
+
+        struct stat info;
+        if (lstat(child, &info) != 0) fail("cannot stat", child);
+
+        if (S_ISDIR(info.st_mode)) {
+            uint32_t child_id = add_record(child, name, dir_id, FS_TYPE_DIRECTORY,
+                                           FS_PERM_READ | FS_PERM_WRITE | FS_PERM_EXECUTE);
+            add_directory(child, child_id);
+        } else if (S_ISREG(info.st_mode)) {
+            add_file(child, name, dir_id, &info);
+        } else {
+            fprintf(stderr, "mkrootfs: %s: skipping, not a file or directory\n", child);
+        }
+
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: mkrootfs <directory> <image>\n");
+        return 1;
+    }
+
+    // Id 0 is never used and id 1 is the root, its own parent.
+    uint32_t unused_id = add_record(argv[1], "", 0, 0, 0);
+    memset(&records[unused_id], 0, sizeof(fs_disk_inode_t));
+    add_record(argv[1], "/", 1, FS_TYPE_DIRECTORY, FS_PERM_READ | FS_PERM_WRITE | FS_PERM_EXECUTE);
+
+    add_directory(argv[1], 1);
+
+    fs_image_header_t header = {
+        .magic = FS_IMAGE_MAGIC,
+        .version = FS_IMAGE_VERSION,
+        .block_size = FS_BLOCK_SIZE,
+        .inode_count = record_count,
+        .data_blocks = data_blocks,
+        .system_time = timestamp,
+    };
+
+    FILE* image = fopen(argv[2], "wb");
+    if (!image) fail("cannot create", argv[2]);
+
+    if (fwrite(&header, sizeof(header), 1, image) != 1 ||
+        fwrite(records, sizeof(fs_disk_inode_t), record_count, image) != record_count ||
+        (data_blocks > 0 && fwrite(data, FS_BLOCK_SIZE, data_blocks, image) != data_blocks)) {
+        fail("write failed", argv[2]);
+    }
+
+    if (fclose(image) != 0) fail("write failed", argv[2]);
+
+    printf("mkrootfs: %u inodes, %u data blocks\n", record_count - 1, data_blocks);
+    return 0;
+}